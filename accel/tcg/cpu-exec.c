@@ -222,9 +222,9 @@ static bool tb_lookup_cmp(const void *p, const void *d)
     return false;
 }
 
-static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
-                                          uint64_t cs_base, uint32_t flags,
-                                          uint32_t cflags)
+TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
+                                   uint64_t cs_base, uint32_t flags,
+                                   uint32_t cflags)
 {
     tb_page_addr_t phys_pc;
     struct tb_desc desc;
@@ -245,6 +245,53 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+/*
+ * Called by the owning CPU every tb_jmp_cache_size() misses.  Like
+ * tlb_mmu_resize_locked() does for the TLB, grow the jump cache when
+ * most misses were because another TB held their entry, i.e. the code
+ * does not fit, and shrink it back towards tcg_jmp_cache_bits when
+ * misses rarely conflict and most entries are unused.  Hits are not
+ * counted, so the decision is based on misses alone.  Returns the
+ * cache to use from now on.
+ */
+static CPUJumpCache *tb_jmp_cache_resize(CPUState *cpu, CPUJumpCache *jc)
+{
+    size_t misses = jc->misses - jc->window_misses;
+    size_t conflicts = jc->conflicts - jc->window_conflicts;
+    unsigned int bits = jc->bits;
+    CPUJumpCache *new_jc;
+
+    if (conflicts > misses / 2) {
+        bits = MIN(bits + 1, TB_JMP_CACHE_MAX_BITS);
+    } else if (conflicts < misses / 16 && bits > tcg_jmp_cache_bits) {
+        size_t used = 0;
+
+        for (size_t i = 0; i < tb_jmp_cache_size(jc); i++) {
+            used += qatomic_read(&jc->array[i].tb) != NULL;
+        }
+        if (used < tb_jmp_cache_size(jc) / 4) {
+            bits--;
+        }
+    }
+
+    jc->window_misses = jc->misses;
+    jc->window_conflicts = jc->conflicts;
+    if (bits == jc->bits) {
+        return jc;
+    }
+
+    trace_tb_jmp_cache_resize(cpu->cpu_index, jc->bits, bits);
+
+    /* The new cache starts empty, like a resized TLB */
+    new_jc = tb_jmp_cache_new(bits);
+    new_jc->misses = new_jc->window_misses = jc->misses;
+    new_jc->conflicts = new_jc->window_conflicts = jc->conflicts;
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+
+    return new_jc;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                                           uint64_t cs_base, uint32_t flags,
@@ -257,8 +304,8 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(jc, pc);
 
     tb = qatomic_read(&jc->array[hash].tb);
     if (likely(tb &&
@@ -269,6 +316,15 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
         goto hit;
     }
 
+    qatomic_set(&jc->misses, jc->misses + 1);
+    if (tb) {
+        qatomic_set(&jc->conflicts, jc->conflicts + 1);
+    }
+    if (unlikely(jc->misses - jc->window_misses >= tb_jmp_cache_size(jc))) {
+        jc = tb_jmp_cache_resize(cpu, jc);
+        hash = tb_jmp_cache_hash_func(jc, pc);
+    }
+
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
@@ -390,6 +446,59 @@ static inline bool check_for_breakpoints(CPUState *cpu, vaddr pc,
         check_for_breakpoints_slow(cpu, pc, cflags);
 }
 
+/*
+ * A TB is being profiled for superblock formation until its exec_count
+ * reaches zero.  It must only be entered from the execution loop, which
+ * counts its executions in tb_superblock_check().
+ */
+static inline bool tb_is_profiled(const TranslationBlock *tb)
+{
+    uint32_t count = qatomic_read(&tb->exec_count);
+
+    return count != 0 && count != TB_TRACE;
+}
+
+/*
+ * Count one execution of a profiled TB and, once it is hot, replace it
+ * with a superblock translated from the same pc.  Return the TB to run.
+ */
+static TranslationBlock *tb_superblock_check(CPUState *cpu,
+                                             TranslationBlock *tb,
+                                             vaddr pc, uint64_t cs_base,
+                                             uint32_t flags, uint32_t cflags)
+{
+    uint32_t count = qatomic_read(&tb->exec_count);
+    TranslationBlock *sb;
+    CPUJumpCache *jc;
+    void *host_pc;
+    uint32_t h;
+
+    /* Losing a race with another vCPU only drops one count */
+    if (count == 0 || count == TB_TRACE ||
+        qatomic_cmpxchg(&tb->exec_count, count, count - 1) != count ||
+        count > 1) {
+        return tb;
+    }
+
+    /* The superblock takes the place of the TB in the hash table */
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    sb = tb_gen_code(cpu, pc, cs_base, flags, cflags, true);
+    if (tcg_superblock_profile && tb_page_addr1(tb) == -1 &&
+        get_page_addr_code_hostp(cpu_env(cpu), pc, &host_pc) != -1) {
+        tb_profile_record(pc, tb, host_pc);
+    }
+    mmap_unlock();
+    trace_exec_tb_superblock(tb, pc, sb);
+
+    jc = cpu->tb_jmp_cache;
+    h = tb_jmp_cache_hash_func(jc, pc);
+    jc->array[h].pc = pc;
+    qatomic_set(&jc->array[h].tb, sb);
+
+    return sb;
+}
+
 /**
  * helper_lookup_tb_ptr: quick check for next tb
  * @env: current cpu state
@@ -422,7 +531,7 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     }
 
     tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
-    if (tb == NULL) {
+    if (tb == NULL || tb_is_profiled(tb)) {
         return tcg_code_gen_epilogue;
     }
 
@@ -597,7 +706,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
         tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
         if (tb == NULL) {
             mmap_lock();
-            tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+            tb = tb_gen_code(cpu, pc, cs_base, flags, cflags, false);
             mmap_unlock();
         }
 
@@ -990,19 +1099,32 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                 uint32_t h;
 
                 mmap_lock();
-                tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                /* tb_prefetch() may have translated it meanwhile */
+                tb = tcg_tb_prefetch ?
+                     tb_htable_lookup(cpu, pc, cs_base, flags, cflags) : NULL;
+                if (tb == NULL) {
+                    tb = tb_gen_code(cpu, pc, cs_base, flags, cflags, false);
+                }
                 mmap_unlock();
 
                 /*
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
                 jc = cpu->tb_jmp_cache;
+                h = tb_jmp_cache_hash_func(jc, pc);
                 jc->array[h].pc = pc;
                 qatomic_set(&jc->array[h].tb, tb);
             }
 
+            if (unlikely(tb_is_profiled(tb))) {
+                tb = tb_superblock_check(cpu, tb, pc, cs_base, flags, cflags);
+                /* Do not chain to it, so that its executions are counted */
+                if (tb_is_profiled(tb)) {
+                    last_tb = NULL;
+                }
+            }
+
 #ifndef CONFIG_USER_ONLY
             /*
              * We don't take care of direct jumps when address mapping
@@ -1079,10 +1201,11 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         assert(cpu->cc->tcg_ops->cpu_exec_interrupt);
 #endif /* !CONFIG_USER_ONLY */
         cpu->cc->tcg_ops->initialize();
+        tb_profile_init(object_get_typename(OBJECT(cpu)));
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = tb_jmp_cache_new(tcg_jmp_cache_bits);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -1097,6 +1220,8 @@ void tcg_exec_unrealizefn(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
+#else
+    tb_prefetch_cancel(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
     tlb_destroy(cpu);
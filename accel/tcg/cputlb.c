@@ -163,8 +163,8 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
+    i0 = tb_jmp_cache_hash_page(jc, page_addr);
+    for (i = 0; i < 1 << tb_jmp_cache_page_bits(jc); i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
 }
@@ -289,9 +289,15 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
+    desc->large_index = 0;
+    memset(desc->large_vaddr, -1, sizeof(desc->large_vaddr));
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
+    if (desc->l2_used_entries) {
+        desc->l2_used_entries = 0;
+        memset(desc->l2table, -1, sizeof(CPUTLBEntry) * CPU_L2TLB_SIZE);
+    }
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -339,10 +345,20 @@ void tlb_init(CPUState *cpu)
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&cpu->neg.tlb.d[i], &cpu->neg.tlb.f[i], now);
     }
+
+    /*
+     * Stores that find TLB_NOTDIRTY go through notdirty_write(), which
+     * logs the page to this ring while migration has dirty rings enabled.
+     */
+    if (tcg_dirty_ring_size) {
+        cpu->dirty_ring =
+            cpu_physical_memory_dirty_ring_new(tcg_dirty_ring_size);
+    }
 }
 
 void tlb_destroy(CPUState *cpu)
 {
+    DirtyRing *ring;
     int i;
 
     qemu_spin_destroy(&cpu->neg.tlb.c.lock);
@@ -352,7 +368,14 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->fulltlb);
+        g_free(desc->l2table);
+        g_free(desc->l2fulltlb);
     }
+
+    /* The migration thread may still be harvesting the ring */
+    ring = cpu->dirty_ring;
+    qatomic_rcu_set(&cpu->dirty_ring, NULL);
+    cpu_physical_memory_dirty_ring_free(ring);
 }
 
 /* flush_all_helper: run fn across all cpus
@@ -485,6 +508,38 @@ static inline bool tlb_flush_entry_locked(CPUTLBEntry *tlb_entry, vaddr page)
     return tlb_flush_entry_mask_locked(tlb_entry, page, -1);
 }
 
+/* Return the index of the first entry of the l2 tlb set for @page.  */
+static inline size_t tlb_l2_set(vaddr page)
+{
+    size_t set = (page >> TARGET_PAGE_BITS) &
+                 ((1 << CPU_L2TLB_SET_BITS) - 1);
+
+    return set * CPU_L2TLB_WAYS;
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_l2_page_mask_locked(CPUTLBDesc *d, vaddr page,
+                                          vaddr mask)
+{
+    vaddr set_mask = MAKE_64BIT_MASK(TARGET_PAGE_BITS, CPU_L2TLB_SET_BITS);
+    size_t i = 0, n = CPU_L2TLB_SIZE;
+
+    if (!d->l2_used_entries) {
+        return;
+    }
+
+    /* Unless @mask covers the set index, any set may hold the page.  */
+    if ((mask & set_mask) == set_mask) {
+        i = tlb_l2_set(page);
+        n = i + CPU_L2TLB_WAYS;
+    }
+    for (; i < n; i++) {
+        if (tlb_flush_entry_mask_locked(&d->l2table[i], page, mask)) {
+            d->l2_used_entries--;
+        }
+    }
+}
+
 /* Called with tlb_c.lock held */
 static void tlb_flush_vtlb_page_mask_locked(CPUState *cpu, int mmu_idx,
                                             vaddr page,
@@ -499,6 +554,7 @@ static void tlb_flush_vtlb_page_mask_locked(CPUState *cpu, int mmu_idx,
             tlb_n_used_entries_dec(cpu, mmu_idx);
         }
     }
+    tlb_flush_l2_page_mask_locked(d, page, mask);
 }
 
 static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
@@ -747,7 +803,7 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
      * If the length is larger than the jump cache size, then it will take
      * longer to clear each entry individually than it will to clear it all.
      */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
+    if (d.len / TARGET_PAGE_SIZE >= tb_jmp_cache_size(cpu->tb_jmp_cache)) {
         tcg_flush_jmp_cache(cpu);
         return;
     }
@@ -949,6 +1005,13 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
             tlb_reset_dirty_range_locked(&cpu->neg.tlb.d[mmu_idx].vtable[i],
                                          start1, length);
         }
+
+        if (cpu->neg.tlb.d[mmu_idx].l2_used_entries) {
+            for (i = 0; i < CPU_L2TLB_SIZE; i++) {
+                tlb_reset_dirty_range_locked(
+                    &cpu->neg.tlb.d[mmu_idx].l2table[i], start1, length);
+            }
+        }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
@@ -977,9 +1040,18 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
         int k;
+
         for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_set_dirty1_locked(&cpu->neg.tlb.d[mmu_idx].vtable[k], addr);
+            tlb_set_dirty1_locked(&d->vtable[k], addr);
+        }
+        if (d->l2_used_entries) {
+            size_t set = tlb_l2_set(addr);
+
+            for (k = 0; k < CPU_L2TLB_WAYS; k++) {
+                tlb_set_dirty1_locked(&d->l2table[set + k], addr);
+            }
         }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
@@ -1009,6 +1081,40 @@ static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
     cpu->neg.tlb.d[mmu_idx].large_page_mask = lp_mask;
 }
 
+/*
+ * Remember the large page of @size containing @addr, as described by
+ * @full, so that tlb_large_hit() can fill the other pages it covers.
+ * Any flush of the large page flushes the whole mmu_idx, see above,
+ * which also forgets the entry.
+ */
+static void tlb_add_large_entry(CPUState *cpu, int mmu_idx, vaddr addr,
+                                uint64_t size, const CPUTLBEntryFull *full)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    vaddr base = addr & ~(size - 1);
+    size_t i;
+
+    /* The target wants to see every write through tlb_fill.  */
+    if (full->prot & PAGE_WRITE_INV) {
+        return;
+    }
+
+    for (i = 0; i < CPU_LARGE_TLB_SIZE; i++) {
+        if (desc->large_vaddr[i] == base &&
+            desc->large_full[i].lg_page_size == full->lg_page_size) {
+            break;
+        }
+    }
+    if (i == CPU_LARGE_TLB_SIZE) {
+        i = desc->large_index++ % CPU_LARGE_TLB_SIZE;
+    }
+
+    desc->large_vaddr[i] = base;
+    desc->large_full[i] = *full;
+    desc->large_full[i].phys_addr = (full->phys_addr & TARGET_PAGE_MASK) -
+                                    ((addr & TARGET_PAGE_MASK) - base);
+}
+
 static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
                                    vaddr address, int flags,
                                    MMUAccessType access_type, bool enable)
@@ -1027,6 +1133,68 @@ static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
     full->slow_flags[access_type] = flags;
 }
 
+/* Return the page mapped by @te, which must not be empty.  */
+static vaddr tlb_entry_page(const CPUTLBEntry *te)
+{
+    MMUAccessType access_type;
+
+    for (access_type = MMU_DATA_LOAD; access_type <= MMU_INST_FETCH;
+         access_type++) {
+        uint64_t cmp = tlb_read_idx(te, access_type);
+
+        if (!(cmp & TLB_INVALID_MASK)) {
+            return cmp & TARGET_PAGE_MASK;
+        }
+    }
+    return te->addr_read & TARGET_PAGE_MASK;
+}
+
+/*
+ * Move the entry evicted from the victim tlb into the l2 tlb, replacing
+ * an empty way of its set if there is one, and the ways in turn if not.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_l2_insert_locked(CPUTLBDesc *desc, const CPUTLBEntry *te,
+                                 const CPUTLBEntryFull *full)
+{
+    size_t set, way;
+
+    if (!desc->l2table || tlb_entry_is_empty(te)) {
+        return;
+    }
+
+    set = tlb_l2_set(tlb_entry_page(te));
+    for (way = 0; way < CPU_L2TLB_WAYS; way++) {
+        if (tlb_entry_is_empty(&desc->l2table[set + way])) {
+            desc->l2_used_entries++;
+            break;
+        }
+    }
+    if (way == CPU_L2TLB_WAYS) {
+        way = desc->l2_way++ % CPU_L2TLB_WAYS;
+    }
+
+    copy_tlb_helper_locked(&desc->l2table[set + way], te);
+    desc->l2fulltlb[set + way] = *full;
+}
+
+/*
+ * Evict the entry at @index of the main tlb into the victim tlb, and
+ * the victim tlb entry it replaces into the l2 tlb.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_evict_locked(CPUState *cpu, int mmu_idx, size_t index)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+    CPUTLBEntry *tv = &desc->vtable[vidx];
+
+    tlb_l2_insert_locked(desc, tv, &desc->vfulltlb[vidx]);
+    copy_tlb_helper_locked(tv, &cpu->neg.tlb.f[mmu_idx].table[index]);
+    desc->vfulltlb[vidx] = desc->fulltlb[index];
+    tlb_n_used_entries_dec(cpu, mmu_idx);
+}
+
 /*
  * Add a new TLB entry. At most one entry for a given virtual address
  * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
@@ -1056,6 +1224,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     } else {
         sz = (hwaddr)1 << full->lg_page_size;
         tlb_add_large_page(cpu, mmu_idx, addr, sz);
+        tlb_add_large_entry(cpu, mmu_idx, addr, sz, full);
     }
     addr_page = addr & TARGET_PAGE_MASK;
     paddr_page = full->phys_addr & TARGET_PAGE_MASK;
@@ -1122,6 +1291,18 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     index = tlb_index(cpu, mmu_idx, addr_page);
     te = tlb_entry(cpu, mmu_idx, addr_page);
 
+    /* Once the victim tlb has wrapped, its evictions go to the l2 tlb.  */
+    if (unlikely(!desc->l2table) && desc->vindex >= CPU_VTLB_SIZE) {
+        CPUTLBEntry *l2table = g_new(CPUTLBEntry, CPU_L2TLB_SIZE);
+        CPUTLBEntryFull *l2fulltlb = g_new(CPUTLBEntryFull, CPU_L2TLB_SIZE);
+
+        memset(l2table, -1, sizeof(CPUTLBEntry) * CPU_L2TLB_SIZE);
+        qemu_spin_lock(&tlb->c.lock);
+        desc->l2table = l2table;
+        desc->l2fulltlb = l2fulltlb;
+        qemu_spin_unlock(&tlb->c.lock);
+    }
+
     /*
      * Hold the TLB lock for the rest of the function. We could acquire/release
      * the lock several times in the function, but it is faster to amortize the
@@ -1142,13 +1323,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, addr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
-        CPUTLBEntry *tv = &desc->vtable[vidx];
-
-        /* Evict the old entry into the victim tlb.  */
-        copy_tlb_helper_locked(tv, te);
-        desc->vfulltlb[vidx] = desc->fulltlb[index];
-        tlb_n_used_entries_dec(cpu, mmu_idx);
+        tlb_evict_locked(cpu, mmu_idx, index);
     }
 
     /* refill the tlb */
@@ -1311,6 +1486,86 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
     return false;
 }
 
+/*
+ * Return true if ADDR is present in the l2 tlb, and has been moved to
+ * the main tlb.  The main tlb entry it replaces is evicted as usual.
+ */
+static bool tlb_l2_hit(CPUState *cpu, size_t mmu_idx, size_t index,
+                       MMUAccessType access_type, vaddr page)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    size_t set, way;
+
+    assert_cpu_is_self(cpu);
+    if (!desc->l2_used_entries) {
+        return false;
+    }
+
+    set = tlb_l2_set(page);
+    for (way = 0; way < CPU_L2TLB_WAYS; way++) {
+        CPUTLBEntry *l2 = &desc->l2table[set + way];
+
+        if (tlb_read_idx(l2, access_type) == page) {
+            CPUTLBEntry *tlb = &cpu->neg.tlb.f[mmu_idx].table[index];
+            CPUTLBEntry tmptlb;
+            CPUTLBEntryFull tmpf;
+
+            qemu_spin_lock(&c->lock);
+            copy_tlb_helper_locked(&tmptlb, l2);
+            tmpf = desc->l2fulltlb[set + way];
+            memset(l2, -1, sizeof(*l2));
+            desc->l2_used_entries--;
+
+            if (!tlb_entry_is_empty(tlb)) {
+                tlb_evict_locked(cpu, mmu_idx, index);
+            }
+            copy_tlb_helper_locked(tlb, &tmptlb);
+            desc->fulltlb[index] = tmpf;
+            tlb_n_used_entries_inc(cpu, mmu_idx);
+            qemu_spin_unlock(&c->lock);
+
+            qatomic_set(&c->l2_hit_count, c->l2_hit_count + 1);
+            return true;
+        }
+    }
+    qatomic_set(&c->l2_miss_count, c->l2_miss_count + 1);
+    return false;
+}
+
+/*
+ * Return true if ADDR is within a large page remembered for MMU_IDX
+ * that allows ACCESS_TYPE, and the main tlb has been filled from it.
+ * This skips the page table walk of tlb_fill for all but the first
+ * page of a large page that is touched.
+ */
+static bool tlb_large_hit(CPUState *cpu, size_t mmu_idx, vaddr addr,
+                          MMUAccessType access_type)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    vaddr page = addr & TARGET_PAGE_MASK;
+    size_t i;
+
+    assert_cpu_is_self(cpu);
+    for (i = 0; i < CPU_LARGE_TLB_SIZE; i++) {
+        CPUTLBEntryFull *lf = &desc->large_full[i];
+        vaddr offset = page - desc->large_vaddr[i];
+
+        if (desc->large_vaddr[i] != (vaddr)-1 &&
+            (offset >> lf->lg_page_size) == 0 &&
+            (lf->prot & (1 << access_type))) {
+            CPUTLBEntryFull full = *lf;
+
+            full.phys_addr += offset;
+            tlb_set_page_full(cpu, mmu_idx, page, &full);
+            qatomic_set(&cpu->neg.tlb.c.large_hit_count,
+                        cpu->neg.tlb.c.large_hit_count + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
 static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
                            CPUTLBEntryFull *full, uintptr_t retaddr)
 {
@@ -1324,7 +1579,8 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
 
     /*
      * Set both VGA and migration bits for simplicity and to remove
-     * the notdirty callback faster.
+     * the notdirty callback faster.  With migration dirty rings enabled,
+     * this also logs the page to this vCPU's ring.
      */
     cpu_physical_memory_set_dirty_range(ram_addr, size, DIRTY_CLIENTS_NOCODE);
 
@@ -1350,7 +1606,9 @@ static int probe_access_internal(CPUState *cpu, vaddr addr,
     CPUTLBEntryFull *full;
 
     if (!tlb_hit_page(tlb_addr, page_addr)) {
-        if (!victim_tlb_hit(cpu, mmu_idx, index, access_type, page_addr)) {
+        if (!victim_tlb_hit(cpu, mmu_idx, index, access_type, page_addr) &&
+            !tlb_l2_hit(cpu, mmu_idx, index, access_type, page_addr) &&
+            !tlb_large_hit(cpu, mmu_idx, addr, access_type)) {
             if (!cpu->cc->tcg_ops->tlb_fill(cpu, addr, fault_size, access_type,
                                             mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
@@ -1630,7 +1888,10 @@ static bool mmu_lookup1(CPUState *cpu, MMULookupPageData *data,
     /* If the TLB entry is for a different page, reload and try again.  */
     if (!tlb_hit(tlb_addr, addr)) {
         if (!victim_tlb_hit(cpu, mmu_idx, index, access_type,
-                            addr & TARGET_PAGE_MASK)) {
+                            addr & TARGET_PAGE_MASK) &&
+            !tlb_l2_hit(cpu, mmu_idx, index, access_type,
+                        addr & TARGET_PAGE_MASK) &&
+            !tlb_large_hit(cpu, mmu_idx, addr, access_type)) {
             tlb_fill(cpu, addr, data->size, access_type, mmu_idx, ra);
             maybe_resized = true;
             index = tlb_index(cpu, mmu_idx, addr);
@@ -1832,7 +2093,10 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     tlb_addr = tlb_addr_write(tlbe);
     if (!tlb_hit(tlb_addr, addr)) {
         if (!victim_tlb_hit(cpu, mmu_idx, index, MMU_DATA_STORE,
-                            addr & TARGET_PAGE_MASK)) {
+                            addr & TARGET_PAGE_MASK) &&
+            !tlb_l2_hit(cpu, mmu_idx, index, MMU_DATA_STORE,
+                        addr & TARGET_PAGE_MASK) &&
+            !tlb_large_hit(cpu, mmu_idx, addr, MMU_DATA_STORE)) {
             tlb_fill(cpu, addr, size,
                      MMU_DATA_STORE, mmu_idx, retaddr);
             index = tlb_index(cpu, mmu_idx, addr);
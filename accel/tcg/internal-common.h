@@ -16,6 +16,11 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern uint32_t tcg_dirty_ring_size;
+extern uint32_t tcg_superblock_threshold;
+extern const char *tcg_superblock_profile;
+extern unsigned int tcg_jmp_cache_bits;
+extern bool tcg_tb_prefetch;
 
 /*
  * Return true if CS is not running in parallel with other cpus, either
@@ -45,7 +50,19 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 
 TranslationBlock *tb_gen_code(CPUState *cpu, vaddr pc,
                               uint64_t cs_base, uint32_t flags,
-                              int cflags);
+                              int cflags, bool trace);
+void tb_profile_init(const char *cpu_type);
+bool tb_profile_is_hot(vaddr pc, uint64_t cs_base, uint32_t flags,
+                       uint32_t cflags, const void *code);
+void tb_profile_record(vaddr pc, const TranslationBlock *tb, const void *code);
+TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
+                                   uint64_t cs_base, uint32_t flags,
+                                   uint32_t cflags);
+/* User mode only */
+void tb_prefetch_init(void);
+void tb_prefetch(CPUState *cpu, const vaddr *dest, int n, uint64_t cs_base,
+                 uint32_t flags, uint32_t cflags);
+void tb_prefetch_cancel(CPUState *cpu);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
@@ -15,10 +15,12 @@
 #include "monitor/monitor.h"
 #include "sysemu/cpus.h"
 #include "sysemu/cpu-timers.h"
+#include "sysemu/stats.h"
 #include "sysemu/tcg.h"
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -141,6 +143,42 @@ static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+static void tlb_miss_counts(size_t *phits, size_t *pmisses, size_t *plarge)
+{
+    CPUState *cpu;
+    size_t hits = 0, misses = 0, large = 0;
+
+    CPU_FOREACH(cpu) {
+        hits += qatomic_read(&cpu->neg.tlb.c.l2_hit_count);
+        misses += qatomic_read(&cpu->neg.tlb.c.l2_miss_count);
+        large += qatomic_read(&cpu->neg.tlb.c.large_hit_count);
+    }
+    *phits = hits;
+    *pmisses = misses;
+    *plarge = large;
+}
+
+static void jmp_cache_counts(size_t *pentries, size_t *pmisses,
+                             size_t *pconflicts)
+{
+    CPUState *cpu;
+    size_t entries = 0, misses = 0, conflicts = 0;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (jc) {
+            entries += tb_jmp_cache_size(jc);
+            misses += qatomic_read(&jc->misses);
+            conflicts += qatomic_read(&jc->conflicts);
+        }
+    }
+    *pentries = entries;
+    *pmisses = misses;
+    *pconflicts = conflicts;
+}
+
 static void tcg_dump_info(GString *buf)
 {
     g_string_append_printf(buf, "[TCG profiler not compiled]\n");
@@ -151,6 +189,8 @@ static void dump_exec_info(GString *buf)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t jc_entries, jc_misses, jc_conflicts;
+    size_t l2_hits, l2_misses, large_hits;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -196,6 +236,20 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    tlb_miss_counts(&l2_hits, &l2_misses, &large_hits);
+    g_string_append_printf(buf, "TLB L2 hits         %zu (%zu%%)\n", l2_hits,
+                           l2_hits + l2_misses ?
+                           (l2_hits * 100) / (l2_hits + l2_misses) : 0);
+    g_string_append_printf(buf, "TLB L2 misses       %zu\n", l2_misses);
+    g_string_append_printf(buf, "TLB large page hits %zu\n", large_hits);
+
+    jmp_cache_counts(&jc_entries, &jc_misses, &jc_conflicts);
+    g_string_append_printf(buf, "jump cache entries  %zu\n", jc_entries);
+    g_string_append_printf(buf, "jump cache misses   %zu\n", jc_misses);
+    g_string_append_printf(buf, "jump cache conflicts %zu (%zu%%)\n",
+                           jc_conflicts,
+                           jc_misses ? (jc_conflicts * 100) / jc_misses : 0);
     tcg_dump_info(buf);
 }
 
@@ -235,10 +289,97 @@ HumanReadableText *qmp_x_query_opcount(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+static StatsList *add_tcg_stats_entry(StatsList *list, strList *names,
+                                      const char *name, uint64_t value)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = value;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+static void tcg_stats_cb(StatsResultList **result, StatsTarget target,
+                         strList *names, strList *targets, Error **errp)
+{
+    CPUState *cpu;
+
+    if (!tcg_enabled() || target != STATS_TARGET_VCPU) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+        StatsList *stats_list = NULL;
+
+        if (!jc ||
+            !apply_str_list_filter(cpu->parent_obj.canonical_path, targets)) {
+            continue;
+        }
+
+        stats_list = add_tcg_stats_entry(stats_list, names, "jmp-cache-misses",
+                                         qatomic_read(&jc->misses));
+        stats_list = add_tcg_stats_entry(stats_list, names,
+                                         "jmp-cache-conflicts",
+                                         qatomic_read(&jc->conflicts));
+        stats_list = add_tcg_stats_entry(stats_list, names,
+                                         "jmp-cache-entries",
+                                         tb_jmp_cache_size(jc));
+        if (stats_list) {
+            add_stats_entry(result, STATS_PROVIDER_TCG,
+                            cpu->parent_obj.canonical_path, stats_list);
+        }
+    }
+}
+
+static StatsSchemaValueList *add_tcg_schema_entry(StatsSchemaValueList *list,
+                                                  const char *name,
+                                                  StatsType type)
+{
+    StatsSchemaValueList *schema_entry = g_new0(StatsSchemaValueList, 1);
+
+    schema_entry->value = g_new0(StatsSchemaValue, 1);
+    schema_entry->value->type = type;
+    schema_entry->value->name = g_strdup(name);
+    schema_entry->next = list;
+
+    return schema_entry;
+}
+
+static void tcg_stats_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    stats_list = add_tcg_schema_entry(stats_list, "jmp-cache-misses",
+                                      STATS_TYPE_CUMULATIVE);
+    stats_list = add_tcg_schema_entry(stats_list, "jmp-cache-conflicts",
+                                      STATS_TYPE_CUMULATIVE);
+    stats_list = add_tcg_schema_entry(stats_list, "jmp-cache-entries",
+                                      STATS_TYPE_INSTANT);
+    add_stats_schema(result, STATS_PROVIDER_TCG, STATS_TARGET_VCPU,
+                     stats_list);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    add_stats_callbacks(STATS_PROVIDER_TCG, tcg_stats_cb,
+                        tcg_stats_schemas_cb);
 }
 
 type_init(hmp_tcg_register);
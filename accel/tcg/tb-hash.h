@@ -27,35 +27,44 @@
 
 #ifdef CONFIG_SOFTMMU
 
-/* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
-   addresses on the same page.  The top bits are the same.  This allows
+/* Only the bottom tb_jmp_cache_page_bits of the jump cache hash bits vary
+   for addresses on the same page.  The top bits are the same.  This allows
    TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
-#define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
-#define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
+QEMU_BUILD_BUG_ON(TB_JMP_CACHE_MAX_BITS / 2 > TARGET_PAGE_BITS_MIN);
 
-static inline unsigned int tb_jmp_cache_hash_page(vaddr pc)
+static inline unsigned int tb_jmp_cache_page_bits(const CPUJumpCache *jc)
 {
+    return jc->bits / 2;
+}
+
+static inline unsigned int tb_jmp_cache_hash_page(const CPUJumpCache *jc,
+                                                  vaddr pc)
+{
+    unsigned int page_bits = tb_jmp_cache_page_bits(jc);
+    unsigned int page_mask = tb_jmp_cache_size(jc) - (1u << page_bits);
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - page_bits));
+    return (tmp >> (TARGET_PAGE_BITS - page_bits)) & page_mask;
 }
 
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
+    unsigned int page_bits = tb_jmp_cache_page_bits(jc);
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - page_bits));
+    return tb_jmp_cache_hash_page(jc, pc) | (tmp & ((1u << page_bits) - 1));
 }
 
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> jc->bits)) & (tb_jmp_cache_size(jc) - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
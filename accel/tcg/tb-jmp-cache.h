@@ -12,8 +12,13 @@
 #include "qemu/rcu.h"
 #include "exec/cpu-common.h"
 
+/*
+ * The cache starts with 1 << tcg_jmp_cache_bits entries (TB_JMP_CACHE_BITS
+ * by default) and is resized at run time, see tb_jmp_cache_resize().
+ */
 #define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_MIN_BITS 8
+#define TB_JMP_CACHE_MAX_BITS 16
 
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
@@ -21,13 +26,44 @@
  * no need for qatomic_rcu_read() and pc is always consistent with a
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
+ *
+ * The owning CPU replaces the whole cache when resizing it, so other
+ * threads must use qatomic_rcu_read() on cpu->tb_jmp_cache and hold
+ * the RCU read lock while accessing it.
  */
 typedef struct CPUJumpCache {
     struct rcu_head rcu;
+    /* log2 of the number of entries in @array */
+    unsigned int bits;
+    /*
+     * Lookup statistics, only written by the owning CPU and only on a
+     * miss, so that hits cost no store.  @conflicts counts the misses
+     * that found the entry taken by another TB.  Both carry over when
+     * the cache is resized.
+     */
+    size_t misses;
+    size_t conflicts;
+    /* @misses and @conflicts at the last resize decision */
+    size_t window_misses;
+    size_t window_conflicts;
     struct {
         TranslationBlock *tb;
         vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    } array[];
 } CPUJumpCache;
 
+static inline size_t tb_jmp_cache_size(const CPUJumpCache *jc)
+{
+    return (size_t)1 << jc->bits;
+}
+
+static inline CPUJumpCache *tb_jmp_cache_new(unsigned int bits)
+{
+    CPUJumpCache *jc = g_malloc0(sizeof(CPUJumpCache) +
+                                 (sizeof(jc->array[0]) << bits));
+
+    jc->bits = bits;
+    return jc;
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -0,0 +1,182 @@
+/*
+ * Translation of direct jump targets ahead of execution
+ *
+ * When a block is translated, the targets of its direct jumps within
+ * the same page are queued for a background thread, which translates
+ * them with the same cs_base, flags and cflags and publishes them in
+ * the TB hash table.  The vCPU finds them there the first time it gets
+ * to them, instead of stopping to translate them.  Blocks translated
+ * this way queue their own targets in turn, up to TB_PREFETCH_DEPTH
+ * jumps away from the block the vCPU translated.
+ *
+ * This is only done in user mode emulation: guest code is read without
+ * going through a softmmu TLB, and all translation is serialized by
+ * mmap_lock, so that a single thread is enough.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/lockable.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "exec/exec-all.h"
+#include "exec/page-protection.h"
+#include "exec/translate-all.h"
+#include "tcg/tcg.h"
+#include "internal-common.h"
+
+#define TB_PREFETCH_QUEUE_SIZE  64
+#define TB_PREFETCH_DEPTH       4
+/* Leave room for the largest TB so that tb_gen_code() never flushes */
+#define TB_PREFETCH_MIN_FREE    (256 * KiB)
+
+typedef struct TBPrefetchRequest {
+    CPUState *cpu;
+    vaddr pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    unsigned int depth;
+} TBPrefetchRequest;
+
+static QemuThread tb_prefetch_thread;
+/* Protects everything below */
+static QemuMutex tb_prefetch_lock;
+static QemuCond tb_prefetch_cond;
+/* Signalled when the thread is done with tb_prefetch_busy */
+static QemuCond tb_prefetch_idle_cond;
+/* Ring of pending requests; the oldest are dropped when it is full */
+static TBPrefetchRequest tb_prefetch_queue[TB_PREFETCH_QUEUE_SIZE];
+static unsigned int tb_prefetch_head;
+static unsigned int tb_prefetch_count;
+/* CPU whose request is being translated */
+static CPUState *tb_prefetch_busy;
+
+/* Depth of the request being translated by the current thread */
+static __thread unsigned int tb_prefetch_depth;
+
+static void tb_prefetch_translate(TBPrefetchRequest *req)
+{
+    /* The block may extend into the next page */
+    vaddr len = TARGET_PAGE_SIZE * 2 - (req->pc & ~TARGET_PAGE_MASK);
+
+    RCU_READ_LOCK_GUARD();
+    mmap_lock();
+
+    /*
+     * Holding mmap_lock keeps the pages mapped and the code buffer from
+     * being flushed, so neither reading the guest code nor allocating
+     * the TB can fault or longjmp out of this thread.
+     */
+    if (page_check_range(req->pc, len, PAGE_EXEC) &&
+        tcg_code_capacity() - tcg_code_size() >= TB_PREFETCH_MIN_FREE &&
+        !tb_htable_lookup(req->cpu, req->pc, req->cs_base, req->flags,
+                          req->cflags)) {
+        tb_prefetch_depth = req->depth;
+        tb_gen_code(req->cpu, req->pc, req->cs_base, req->flags,
+                    req->cflags, false);
+    }
+
+    mmap_unlock();
+}
+
+static void *tb_prefetch_thread_fn(void *opaque)
+{
+    TBPrefetchRequest req;
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock(&tb_prefetch_lock);
+    while (true) {
+        while (!tb_prefetch_count) {
+            qemu_cond_wait(&tb_prefetch_cond, &tb_prefetch_lock);
+        }
+        req = tb_prefetch_queue[tb_prefetch_head];
+        tb_prefetch_head = (tb_prefetch_head + 1) % TB_PREFETCH_QUEUE_SIZE;
+        tb_prefetch_count--;
+        tb_prefetch_busy = req.cpu;
+        qemu_mutex_unlock(&tb_prefetch_lock);
+
+        tb_prefetch_translate(&req);
+
+        qemu_mutex_lock(&tb_prefetch_lock);
+        tb_prefetch_busy = NULL;
+        qemu_cond_broadcast(&tb_prefetch_idle_cond);
+    }
+
+    return NULL;
+}
+
+void tb_prefetch_init(void)
+{
+    qemu_mutex_init(&tb_prefetch_lock);
+    qemu_cond_init(&tb_prefetch_cond);
+    qemu_cond_init(&tb_prefetch_idle_cond);
+    qemu_thread_create(&tb_prefetch_thread, "tcg-prefetch",
+                       tb_prefetch_thread_fn, NULL, QEMU_THREAD_DETACHED);
+}
+
+/*
+ * Queue the blocks at @dest for translation on behalf of @cpu.  Called
+ * at the end of the translation of a block that jumps to them.
+ */
+void tb_prefetch(CPUState *cpu, const vaddr *dest, int n, uint64_t cs_base,
+                 uint32_t flags, uint32_t cflags)
+{
+    if (tb_prefetch_depth >= TB_PREFETCH_DEPTH) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tb_prefetch_lock);
+    for (int i = 0; i < n; i++) {
+        unsigned int tail = (tb_prefetch_head + tb_prefetch_count) %
+                            TB_PREFETCH_QUEUE_SIZE;
+
+        tb_prefetch_queue[tail] = (TBPrefetchRequest) {
+            .cpu = cpu,
+            .pc = dest[i],
+            .cs_base = cs_base,
+            .flags = flags,
+            .cflags = cflags,
+            .depth = tb_prefetch_depth + 1,
+        };
+        if (tb_prefetch_count < TB_PREFETCH_QUEUE_SIZE) {
+            tb_prefetch_count++;
+        } else {
+            tb_prefetch_head = (tb_prefetch_head + 1) % TB_PREFETCH_QUEUE_SIZE;
+        }
+    }
+    qemu_cond_signal(&tb_prefetch_cond);
+}
+
+/* Drop the requests made for @cpu, which is going away. */
+void tb_prefetch_cancel(CPUState *cpu)
+{
+    unsigned int i, n = 0;
+
+    if (!tcg_tb_prefetch) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tb_prefetch_lock);
+
+    /* A request being translated may queue more of them */
+    while (tb_prefetch_busy == cpu) {
+        qemu_cond_wait(&tb_prefetch_idle_cond, &tb_prefetch_lock);
+    }
+
+    for (i = 0; i < tb_prefetch_count; i++) {
+        TBPrefetchRequest *req =
+            &tb_prefetch_queue[(tb_prefetch_head + i) % TB_PREFETCH_QUEUE_SIZE];
+
+        if (req->cpu != cpu) {
+            tb_prefetch_queue[(tb_prefetch_head + n++) %
+                              TB_PREFETCH_QUEUE_SIZE] = *req;
+        }
+    }
+    tb_prefetch_count = n;
+}
@@ -0,0 +1,284 @@
+/*
+ * Persistent superblock profile
+ *
+ * Translation blocks that become hot enough to be retranslated as
+ * superblocks (see tcg_superblock_threshold) are recorded in a file.
+ * Later runs of the same guest load it, and blocks found in it are
+ * translated as superblocks right away, without being profiled.  This
+ * works even without a threshold, in which case the file is only read.
+ *
+ * Generated host code is not stored; it is full of absolute host
+ * pointers and cannot be reused by another process.  The profile is
+ * only a hint, so a stale or mismatched entry at worst costs one extra
+ * translation.
+ *
+ * The file starts with a TBProfileHeader, followed by TBProfileEntry
+ * records that are appended as blocks become hot.  Only the process
+ * that creates the file writes the header.  Each record is written
+ * with a single write() to a file opened with O_APPEND, so that
+ * concurrent QEMU processes can share a profile.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "qemu/crc32c.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/thread.h"
+#include "qemu/xxhash.h"
+#include "exec/exec-all.h"
+#include "exec/translation-block.h"
+#include "internal-common.h"
+
+#define TB_PROFILE_MAGIC    "QEMUTBP"
+#define TB_PROFILE_VERSION  1
+
+typedef struct TBProfileHeader {
+    char magic[8];
+    uint32_t version;
+    /* crc32c of the target and CPU type names */
+    uint32_t config;
+} TBProfileHeader;
+
+/* Stored little-endian */
+typedef struct TBProfileEntry {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t size;
+    /* crc32c of the guest code covered by the block */
+    uint32_t crc;
+} TBProfileEntry;
+
+QEMU_BUILD_BUG_ON(sizeof(TBProfileHeader) != 16);
+QEMU_BUILD_BUG_ON(sizeof(TBProfileEntry) != 32);
+
+/*
+ * Entries loaded at startup, keyed by the start of the block and its
+ * flags (see tb_profile_key_hash).  Built before any vCPU runs and
+ * read-only afterwards, so that lookups need no lock.
+ */
+static GHashTable *tb_profile;
+/* Protects tb_profile_fd and tb_profile_recorded */
+static QemuMutex tb_profile_lock;
+static int tb_profile_fd = -1;
+/* Entries appended by this process */
+static GHashTable *tb_profile_recorded;
+
+/*
+ * The loaded table is looked up before translation, when the size of
+ * the block is not known yet, so only hash and compare up to @size.
+ */
+#define TB_PROFILE_KEY_SIZE offsetof(TBProfileEntry, size)
+
+static guint tb_profile_key_hash(gconstpointer key)
+{
+    const TBProfileEntry *e = key;
+
+    return qemu_xxhash6(e->pc, e->cs_base, e->flags, e->cflags);
+}
+
+static gboolean tb_profile_key_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, TB_PROFILE_KEY_SIZE);
+}
+
+static guint tb_profile_hash(gconstpointer key)
+{
+    const TBProfileEntry *e = key;
+
+    return qemu_xxhash6(e->pc, e->cs_base, e->flags, e->crc);
+}
+
+static gboolean tb_profile_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, sizeof(TBProfileEntry));
+}
+
+static void tb_profile_fill_key(TBProfileEntry *e, vaddr pc, uint64_t cs_base,
+                                uint32_t flags, uint32_t cflags)
+{
+    e->pc = cpu_to_le64(pc);
+    e->cs_base = cpu_to_le64(cs_base);
+    e->flags = cpu_to_le32(flags);
+    e->cflags = cpu_to_le32(cflags & ~CF_INVALID);
+}
+
+static void tb_profile_fill(TBProfileEntry *e, vaddr pc,
+                            const TranslationBlock *tb, const void *code)
+{
+    tb_profile_fill_key(e, pc, tb->cs_base, tb->flags, tb->cflags);
+    e->size = cpu_to_le32(tb->size);
+    e->crc = cpu_to_le32(crc32c(0xffffffff, code, tb->size));
+}
+
+static uint32_t tb_profile_config(const char *cpu_type)
+{
+    uint32_t crc = crc32c(0xffffffff, (const uint8_t *)TARGET_NAME,
+                          strlen(TARGET_NAME));
+
+    return crc32c(crc, (const uint8_t *)cpu_type, strlen(cpu_type));
+}
+
+/*
+ * Load the profile named by tcg_superblock_profile.  With a superblock
+ * threshold, also create it if needed and open it to record new
+ * superblocks.  A profile that cannot be used is reported and ignored.
+ * Called before any vCPU runs.
+ */
+void tb_profile_init(const char *cpu_type)
+{
+    g_autofree char *contents = NULL;
+    TBProfileHeader hdr = { .magic = TB_PROFILE_MAGIC };
+    Error *local_err = NULL;
+    GError *gerr = NULL;
+    gsize len = 0;
+    size_t i, n;
+
+    if (!tcg_superblock_profile) {
+        return;
+    }
+
+    hdr.version = cpu_to_le32(TB_PROFILE_VERSION);
+    hdr.config = cpu_to_le32(tb_profile_config(cpu_type));
+
+    /* Without a threshold nothing becomes a superblock to be recorded */
+    if (tcg_superblock_threshold) {
+        /* Whoever creates the file writes the header */
+        tb_profile_fd = qemu_create(tcg_superblock_profile,
+                                    O_WRONLY | O_APPEND | O_EXCL, 0644, NULL);
+        if (tb_profile_fd >= 0) {
+            if (write(tb_profile_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+                warn_report("failed to write superblock profile '%s': %s",
+                            tcg_superblock_profile, strerror(errno));
+                goto fail;
+            }
+            goto done;
+        }
+        if (errno != EEXIST) {
+            error_setg_errno(&local_err, errno, "Could not create '%s'",
+                             tcg_superblock_profile);
+            warn_report_err(local_err);
+            return;
+        }
+
+        tb_profile_fd = qemu_open(tcg_superblock_profile, O_WRONLY | O_APPEND,
+                                  &local_err);
+        if (tb_profile_fd < 0) {
+            warn_report_err(local_err);
+            return;
+        }
+    }
+
+    if (!g_file_get_contents(tcg_superblock_profile, &contents, &len, &gerr)) {
+        warn_report("failed to read superblock profile '%s': %s",
+                    tcg_superblock_profile, gerr->message);
+        g_error_free(gerr);
+        goto fail;
+    }
+
+    if (len < sizeof(hdr)) {
+        /*
+         * Another process has just created the file and not written the
+         * header yet; appending records now could come before it.
+         */
+        warn_report("superblock profile '%s' is incomplete, ignoring it",
+                    tcg_superblock_profile);
+        goto fail;
+    } else if (memcmp(contents, &hdr, sizeof(hdr))) {
+        warn_report("superblock profile '%s' was written by another "
+                    "QEMU version, target or CPU model, ignoring it",
+                    tcg_superblock_profile);
+        goto fail;
+    }
+
+done:
+    qemu_mutex_init(&tb_profile_lock);
+    tb_profile = g_hash_table_new(tb_profile_key_hash, tb_profile_key_equal);
+    tb_profile_recorded = g_hash_table_new_full(tb_profile_hash,
+                                                tb_profile_equal, g_free, NULL);
+    n = len > sizeof(hdr) ? (len - sizeof(hdr)) / sizeof(TBProfileEntry) : 0;
+    if (n) {
+        TBProfileEntry *entries = g_new(TBProfileEntry, n);
+
+        memcpy(entries, contents + sizeof(hdr), n * sizeof(TBProfileEntry));
+        /* Later entries are newer and replace older ones for the same key */
+        for (i = 0; i < n; i++) {
+            g_hash_table_insert(tb_profile, &entries[i], &entries[i]);
+        }
+    }
+    return;
+
+fail:
+    if (tb_profile_fd >= 0) {
+        close(tb_profile_fd);
+        tb_profile_fd = -1;
+    }
+}
+
+/*
+ * Return true if the block to be translated at @pc from guest code
+ * @code became a superblock in an earlier run, so that it can be
+ * translated as a superblock right away.  Lock-free.
+ */
+bool tb_profile_is_hot(vaddr pc, uint64_t cs_base, uint32_t flags,
+                       uint32_t cflags, const void *code)
+{
+    const TBProfileEntry *e;
+    TBProfileEntry key;
+    uint32_t size;
+
+    if (!tb_profile || !code) {
+        return false;
+    }
+
+    tb_profile_fill_key(&key, pc, cs_base, flags, cflags);
+    e = g_hash_table_lookup(tb_profile, &key);
+    if (!e) {
+        return false;
+    }
+
+    /* Recorded blocks do not cross a page; do not trust a corrupt size */
+    size = le32_to_cpu(e->size);
+    if (size == 0 || size > TARGET_PAGE_SIZE - (pc & ~TARGET_PAGE_MASK)) {
+        return false;
+    }
+    return le32_to_cpu(e->crc) == crc32c(0xffffffff, code, size);
+}
+
+/* Record that the block translated at @pc became a superblock. */
+void tb_profile_record(vaddr pc, const TranslationBlock *tb, const void *code)
+{
+    const TBProfileEntry *loaded;
+    TBProfileEntry e;
+
+    if (!tb_profile) {
+        return;
+    }
+
+    tb_profile_fill(&e, pc, tb, code);
+    loaded = g_hash_table_lookup(tb_profile, &e);
+    if (loaded && tb_profile_equal(loaded, &e)) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tb_profile_lock);
+    if (tb_profile_fd < 0 || g_hash_table_contains(tb_profile_recorded, &e)) {
+        return;
+    }
+    if (write(tb_profile_fd, &e, sizeof(e)) != sizeof(e)) {
+        warn_report("failed to update superblock profile '%s': %s",
+                    tcg_superblock_profile, strerror(errno));
+        /* Stop recording, but keep using what was loaded */
+        close(tb_profile_fd);
+        tb_profile_fd = -1;
+        return;
+    }
+    /* A block promoted again after a flush is not written twice */
+    g_hash_table_add(tb_profile_recorded, g_memdup2(&e, sizeof(e)));
+}
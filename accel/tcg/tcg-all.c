@@ -35,10 +35,12 @@
 #include "qemu/atomic.h"
 #include "qapi/qapi-builtin-visit.h"
 #include "qemu/units.h"
+#include "qemu/host-utils.h"
 #if !defined(CONFIG_USER_ONLY)
 #include "hw/boards.h"
 #endif
 #include "internal-common.h"
+#include "tb-jmp-cache.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -47,6 +49,11 @@ struct TCGState {
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint32_t dirty_ring_size;
+    uint32_t superblock_threshold;
+    char *superblock_profile;
+    uint32_t jmp_cache_bits;
+    bool tb_prefetch;
 };
 typedef struct TCGState TCGState;
 
@@ -88,6 +95,7 @@ static void tcg_accel_instance_init(Object *obj)
     TCGState *s = TCG_STATE(obj);
 
     s->mttcg_enabled = default_mttcg_enabled();
+    s->jmp_cache_bits = TB_JMP_CACHE_BITS;
 
     /* If debugging enabled, default "auto on", otherwise off. */
 #if defined(CONFIG_DEBUG_TCG) && !defined(CONFIG_USER_ONLY)
@@ -99,6 +107,11 @@ static void tcg_accel_instance_init(Object *obj)
 
 bool mttcg_enabled;
 bool one_insn_per_tb;
+uint32_t tcg_dirty_ring_size;
+uint32_t tcg_superblock_threshold;
+const char *tcg_superblock_profile;
+unsigned int tcg_jmp_cache_bits;
+bool tcg_tb_prefetch;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -111,11 +124,24 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tcg_dirty_ring_size = s->dirty_ring_size;
+    tcg_superblock_threshold = s->superblock_threshold;
+    tcg_superblock_profile = s->superblock_profile;
+    tcg_jmp_cache_bits = s->jmp_cache_bits;
+#ifdef CONFIG_USER_ONLY
+    tcg_tb_prefetch = s->tb_prefetch;
+#endif
 
     page_init();
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
 
+#ifdef CONFIG_USER_ONLY
+    if (tcg_tb_prefetch) {
+        tb_prefetch_init();
+    }
+#endif
+
 #if defined(CONFIG_SOFTMMU)
     /*
      * There's no guest base to take into account, so go ahead and
@@ -181,6 +207,116 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_superblock_threshold(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->superblock_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_superblock_threshold(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value == TB_TRACE) {
+        error_setg(errp, "superblock-threshold is too large");
+        return;
+    }
+
+    s->superblock_threshold = value;
+}
+
+static char *tcg_get_superblock_profile(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->superblock_profile);
+}
+
+static void tcg_set_superblock_profile(Object *obj, const char *value,
+                                       Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->superblock_profile);
+    s->superblock_profile = g_strdup(value);
+}
+
+static void tcg_get_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->jmp_cache_bits;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_jmp_cache_bits(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < TB_JMP_CACHE_MIN_BITS || value > TB_JMP_CACHE_MAX_BITS) {
+        error_setg(errp, "jmp-cache-bits must be between %d and %d",
+                   TB_JMP_CACHE_MIN_BITS, TB_JMP_CACHE_MAX_BITS);
+        return;
+    }
+
+    s->jmp_cache_bits = value;
+}
+
+#ifndef CONFIG_USER_ONLY
+/* Each entry takes 16 bytes, so a vCPU's ring is at most 1 MiB */
+#define TCG_DIRTY_RING_MIN_SIZE 1024
+#define TCG_DIRTY_RING_MAX_SIZE 65536
+
+static void tcg_get_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->dirty_ring_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value && (!is_power_of_2(value) || value < TCG_DIRTY_RING_MIN_SIZE ||
+                  value > TCG_DIRTY_RING_MAX_SIZE)) {
+        error_setg(errp, "dirty-ring-size must be 0 or a power of two "
+                   "between %d and %d", TCG_DIRTY_RING_MIN_SIZE,
+                   TCG_DIRTY_RING_MAX_SIZE);
+        return;
+    }
+
+    s->dirty_ring_size = value;
+}
+#endif
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -193,6 +329,22 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+#ifdef CONFIG_USER_ONLY
+static bool tcg_get_tb_prefetch(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->tb_prefetch;
+}
+
+static void tcg_set_tb_prefetch(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->tb_prefetch = value;
+}
+#endif
+
 static bool tcg_get_one_insn_per_tb(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -242,6 +394,34 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "superblock-threshold", "uint32",
+        tcg_get_superblock_threshold, tcg_set_superblock_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "superblock-threshold",
+        "Executions after which a translation block is retranslated "
+        "as a superblock (0 to disable)");
+
+    object_class_property_add_str(oc, "superblock-profile",
+                                  tcg_get_superblock_profile,
+                                  tcg_set_superblock_profile);
+    object_class_property_set_description(oc, "superblock-profile",
+        "File remembering superblocks across runs");
+
+    object_class_property_add(oc, "jmp-cache-bits", "uint32",
+        tcg_get_jmp_cache_bits, tcg_set_jmp_cache_bits,
+        NULL, NULL);
+    object_class_property_set_description(oc, "jmp-cache-bits",
+        "log2 of the initial and minimum size of the per-vCPU "
+        "TB jump cache");
+
+#ifndef CONFIG_USER_ONLY
+    object_class_property_add(oc, "dirty-ring-size", "uint32",
+        tcg_get_dirty_ring_size, tcg_set_dirty_ring_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-ring-size",
+        "Size of the per-vCPU ring of pages dirtied during migration");
+#endif
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
@@ -252,6 +432,14 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+#ifdef CONFIG_USER_ONLY
+    object_class_property_add_bool(oc, "tb-prefetch",
+                                   tcg_get_tb_prefetch,
+                                   tcg_set_tb_prefetch);
+    object_class_property_set_description(oc, "tb-prefetch",
+        "Translate the targets of direct jumps in a background thread");
+#endif
 }
 
 static const TypeInfo tcg_accel_type = {
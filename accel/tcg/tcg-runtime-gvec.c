@@ -19,7 +19,9 @@
 
 #include "qemu/osdep.h"
 #include "qemu/host-utils.h"
+#include "qemu/gvec-accel.h"
 #include "cpu.h"
+#include "exec/memop.h"
 #include "exec/helper-proto-common.h"
 #include "tcg/tcg-gvec-desc.h"
 
@@ -586,144 +588,96 @@ void HELPER(gvec_ors)(void *d, void *a, uint64_t b, uint32_t desc)
 void HELPER(gvec_shl8i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        *(uint8_t *)(d + i) = *(uint8_t *)(a + i) << shift;
-    }
+    gvec_accel->shli[MO_8](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_shl16i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        *(uint16_t *)(d + i) = *(uint16_t *)(a + i) << shift;
-    }
+    gvec_accel->shli[MO_16](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_shl32i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) << shift;
-    }
+    gvec_accel->shli[MO_32](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_shl64i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) << shift;
-    }
+    gvec_accel->shli[MO_64](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_shr8i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        *(uint8_t *)(d + i) = *(uint8_t *)(a + i) >> shift;
-    }
+    gvec_accel->shri[MO_8](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_shr16i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        *(uint16_t *)(d + i) = *(uint16_t *)(a + i) >> shift;
-    }
+    gvec_accel->shri[MO_16](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_shr32i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) >> shift;
-    }
+    gvec_accel->shri[MO_32](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_shr64i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) >> shift;
-    }
+    gvec_accel->shri[MO_64](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sar8i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        *(int8_t *)(d + i) = *(int8_t *)(a + i) >> shift;
-    }
+    gvec_accel->sari[MO_8](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sar16i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        *(int16_t *)(d + i) = *(int16_t *)(a + i) >> shift;
-    }
+    gvec_accel->sari[MO_16](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sar32i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(int32_t *)(d + i) = *(int32_t *)(a + i) >> shift;
-    }
+    gvec_accel->sari[MO_32](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sar64i)(void *d, void *a, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    int shift = simd_data(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(int64_t *)(d + i) = *(int64_t *)(a + i) >> shift;
-    }
+    gvec_accel->sari[MO_64](d, a, simd_data(desc), oprsz);
     clear_high(d, oprsz, desc);
 }
 
@@ -1015,24 +969,21 @@ void HELPER(gvec_rotr64v)(void *d, void *a, void *b, uint32_t desc)
     clear_high(d, oprsz, desc);
 }
 
-#define DO_CMP1(NAME, TYPE, OP)                                            \
-void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)                \
+#define DO_CMP1(OP, SZ)                                                    \
+void HELPER(gvec_##OP##SZ)(void *d, void *a, void *b, uint32_t desc)       \
 {                                                                          \
     intptr_t oprsz = simd_oprsz(desc);                                     \
-    intptr_t i;                                                            \
-    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                            \
-        *(TYPE *)(d + i) = -(*(TYPE *)(a + i) OP *(TYPE *)(b + i));        \
-    }                                                                      \
+    gvec_accel->OP[MO_##SZ](d, a, b, oprsz);                               \
     clear_high(d, oprsz, desc);                                            \
 }
 
 #define DO_CMP2(SZ) \
-    DO_CMP1(gvec_eq##SZ, uint##SZ##_t, ==)    \
-    DO_CMP1(gvec_ne##SZ, uint##SZ##_t, !=)    \
-    DO_CMP1(gvec_lt##SZ, int##SZ##_t, <)      \
-    DO_CMP1(gvec_le##SZ, int##SZ##_t, <=)     \
-    DO_CMP1(gvec_ltu##SZ, uint##SZ##_t, <)    \
-    DO_CMP1(gvec_leu##SZ, uint##SZ##_t, <=)
+    DO_CMP1(eq, SZ)     \
+    DO_CMP1(ne, SZ)     \
+    DO_CMP1(lt, SZ)     \
+    DO_CMP1(le, SZ)     \
+    DO_CMP1(ltu, SZ)    \
+    DO_CMP1(leu, SZ)
 
 DO_CMP2(8)
 DO_CMP2(16)
@@ -1071,264 +1022,128 @@ DO_CMP2(64)
 void HELPER(gvec_ssadd8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int8_t)) {
-        int r = *(int8_t *)(a + i) + *(int8_t *)(b + i);
-        if (r > INT8_MAX) {
-            r = INT8_MAX;
-        } else if (r < INT8_MIN) {
-            r = INT8_MIN;
-        }
-        *(int8_t *)(d + i) = r;
-    }
+    gvec_accel->ssadd[MO_8](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_ssadd16)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int16_t)) {
-        int r = *(int16_t *)(a + i) + *(int16_t *)(b + i);
-        if (r > INT16_MAX) {
-            r = INT16_MAX;
-        } else if (r < INT16_MIN) {
-            r = INT16_MIN;
-        }
-        *(int16_t *)(d + i) = r;
-    }
+    gvec_accel->ssadd[MO_16](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_ssadd32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int32_t)) {
-        int32_t ai = *(int32_t *)(a + i);
-        int32_t bi = *(int32_t *)(b + i);
-        int32_t di;
-        if (sadd32_overflow(ai, bi, &di)) {
-            di = (di < 0 ? INT32_MAX : INT32_MIN);
-        }
-        *(int32_t *)(d + i) = di;
-    }
+    gvec_accel->ssadd[MO_32](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_ssadd64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int64_t)) {
-        int64_t ai = *(int64_t *)(a + i);
-        int64_t bi = *(int64_t *)(b + i);
-        int64_t di;
-        if (sadd64_overflow(ai, bi, &di)) {
-            di = (di < 0 ? INT64_MAX : INT64_MIN);
-        }
-        *(int64_t *)(d + i) = di;
-    }
+    gvec_accel->ssadd[MO_64](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sssub8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        int r = *(int8_t *)(a + i) - *(int8_t *)(b + i);
-        if (r > INT8_MAX) {
-            r = INT8_MAX;
-        } else if (r < INT8_MIN) {
-            r = INT8_MIN;
-        }
-        *(uint8_t *)(d + i) = r;
-    }
+    gvec_accel->sssub[MO_8](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sssub16)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int16_t)) {
-        int r = *(int16_t *)(a + i) - *(int16_t *)(b + i);
-        if (r > INT16_MAX) {
-            r = INT16_MAX;
-        } else if (r < INT16_MIN) {
-            r = INT16_MIN;
-        }
-        *(int16_t *)(d + i) = r;
-    }
+    gvec_accel->sssub[MO_16](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sssub32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int32_t)) {
-        int32_t ai = *(int32_t *)(a + i);
-        int32_t bi = *(int32_t *)(b + i);
-        int32_t di;
-        if (ssub32_overflow(ai, bi, &di)) {
-            di = (di < 0 ? INT32_MAX : INT32_MIN);
-        }
-        *(int32_t *)(d + i) = di;
-    }
+    gvec_accel->sssub[MO_32](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sssub64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int64_t)) {
-        int64_t ai = *(int64_t *)(a + i);
-        int64_t bi = *(int64_t *)(b + i);
-        int64_t di;
-        if (ssub64_overflow(ai, bi, &di)) {
-            di = (di < 0 ? INT64_MAX : INT64_MIN);
-        }
-        *(int64_t *)(d + i) = di;
-    }
+    gvec_accel->sssub[MO_64](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_usadd8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        unsigned r = *(uint8_t *)(a + i) + *(uint8_t *)(b + i);
-        if (r > UINT8_MAX) {
-            r = UINT8_MAX;
-        }
-        *(uint8_t *)(d + i) = r;
-    }
+    gvec_accel->usadd[MO_8](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_usadd16)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        unsigned r = *(uint16_t *)(a + i) + *(uint16_t *)(b + i);
-        if (r > UINT16_MAX) {
-            r = UINT16_MAX;
-        }
-        *(uint16_t *)(d + i) = r;
-    }
+    gvec_accel->usadd[MO_16](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_usadd32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        uint32_t ai = *(uint32_t *)(a + i);
-        uint32_t bi = *(uint32_t *)(b + i);
-        uint32_t di;
-        if (uadd32_overflow(ai, bi, &di)) {
-            di = UINT32_MAX;
-        }
-        *(uint32_t *)(d + i) = di;
-    }
+    gvec_accel->usadd[MO_32](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_usadd64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        uint64_t ai = *(uint64_t *)(a + i);
-        uint64_t bi = *(uint64_t *)(b + i);
-        uint64_t di;
-        if (uadd64_overflow(ai, bi, &di)) {
-            di = UINT64_MAX;
-        }
-        *(uint64_t *)(d + i) = di;
-    }
+    gvec_accel->usadd[MO_64](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_ussub8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        int r = *(uint8_t *)(a + i) - *(uint8_t *)(b + i);
-        if (r < 0) {
-            r = 0;
-        }
-        *(uint8_t *)(d + i) = r;
-    }
+    gvec_accel->ussub[MO_8](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_ussub16)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        int r = *(uint16_t *)(a + i) - *(uint16_t *)(b + i);
-        if (r < 0) {
-            r = 0;
-        }
-        *(uint16_t *)(d + i) = r;
-    }
+    gvec_accel->ussub[MO_16](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_ussub32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        uint32_t ai = *(uint32_t *)(a + i);
-        uint32_t bi = *(uint32_t *)(b + i);
-        uint32_t di;
-        if (usub32_overflow(ai, bi, &di)) {
-            di = 0;
-        }
-        *(uint32_t *)(d + i) = di;
-    }
+    gvec_accel->ussub[MO_32](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_ussub64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        uint64_t ai = *(uint64_t *)(a + i);
-        uint64_t bi = *(uint64_t *)(b + i);
-        uint64_t di;
-        if (usub64_overflow(ai, bi, &di)) {
-            di = 0;
-        }
-        *(uint64_t *)(d + i) = di;
-    }
+    gvec_accel->ussub[MO_64](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
@@ -283,10 +283,13 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+/*
+ * Called with mmap_lock held for user mode emulation.
+ * With @trace, translate a superblock, see translator_follow_jump().
+ */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               vaddr pc, uint64_t cs_base,
-                              uint32_t flags, int cflags)
+                              uint32_t flags, int cflags, bool trace)
 {
     CPUArchState *env = cpu_env(cpu);
     TranslationBlock *tb, *existing_tb;
@@ -304,6 +307,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if (phys_pc == -1) {
         /* Generate a one-shot TB with 1 insn in it */
         cflags = (cflags & ~CF_COUNT_MASK) | 1;
+    } else if (!trace) {
+        /* Blocks that were hot in an earlier run need no profiling */
+        trace = tb_profile_is_hot(pc, cs_base, flags, cflags, host_pc);
     }
 
     max_insns = cflags & CF_COUNT_MASK;
@@ -332,6 +338,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->exec_count = trace ? TB_TRACE : 0;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -652,14 +659,17 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
  */
 void tcg_flush_jmp_cache(CPUState *cpu)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc;
+
+    RCU_READ_LOCK_GUARD();
 
     /* During early initialization, the cache may not yet be allocated. */
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
     if (unlikely(jc == NULL)) {
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    for (size_t i = 0; i < tb_jmp_cache_size(jc); i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
 }
@@ -16,6 +16,7 @@
 #include "exec/plugin-gen.h"
 #include "exec/cpu_ldst.h"
 #include "tcg/tcg-op-common.h"
+#include "internal-common.h"
 #include "internal-target.h"
 #include "disas/disas.h"
 
@@ -110,7 +111,52 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     }
 
     /* Check for the dest on the same page as the start of the TB.  */
-    return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
+    if ((db->pc_first ^ dest) & TARGET_PAGE_MASK) {
+        return false;
+    }
+
+    /* Remember it for tb_prefetch() */
+    for (int i = 0; i < db->nb_jmp_dest; i++) {
+        if (db->jmp_dest[i] == dest) {
+            return true;
+        }
+    }
+    if (db->nb_jmp_dest < ARRAY_SIZE(db->jmp_dest)) {
+        db->jmp_dest[db->nb_jmp_dest++] = dest;
+    }
+    return true;
+}
+
+bool translator_follow_jump(DisasContextBase *db, vaddr dest)
+{
+    uint32_t cflags = tb_cflags(db->tb);
+
+    if (dest < db->pc_first || ((db->pc_first ^ dest) & TARGET_PAGE_MASK) ||
+        tb_page_addr0(db->tb) == -1) {
+        return false;
+    }
+    /*
+     * Side exits would skip the instructions accounted for at the
+     * start of the TB, and plugins expect straight-line TBs.
+     */
+    if ((cflags & (CF_NO_GOTO_TB | CF_USE_ICOUNT)) || db->plugin_enabled) {
+        return false;
+    }
+    if (!db->trace) {
+        db->trace_candidate = true;
+        return false;
+    }
+    /*
+     * There must be room for at least one insn at @dest, otherwise the
+     * target would end the TB as if falling through the jump.
+     */
+    if (db->num_insns >= db->max_insns || tcg_op_buf_full()) {
+        return false;
+    }
+
+    db->pc_end = MAX(db->pc_end, db->pc_next);
+    db->pc_next = dest;
+    return true;
 }
 
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
@@ -132,6 +178,10 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     db->singlestep_enabled = cflags & CF_SINGLE_STEP;
     db->insn_start = NULL;
     db->fake_insn = false;
+    db->trace = tb->exec_count == TB_TRACE;
+    db->trace_candidate = false;
+    db->pc_end = pc;
+    db->nb_jmp_dest = 0;
     db->host_addr[0] = host_pc;
     db->host_addr[1] = NULL;
     db->record_start = 0;
@@ -215,9 +265,21 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     tcg_ctx->emit_before_op = NULL;
 
     /* May be used by disas_log or plugin callbacks. */
-    tb->size = db->pc_next - db->pc_first;
+    tb->size = MAX(db->pc_end, db->pc_next) - db->pc_first;
     tb->icount = db->num_insns;
 
+    if (!db->trace) {
+        tb->exec_count = db->trace_candidate ? tcg_superblock_threshold : 0;
+    }
+
+#ifdef CONFIG_USER_ONLY
+    if (tcg_tb_prefetch && db->nb_jmp_dest && !plugin_enabled &&
+        !(cflags & CF_COUNT_MASK)) {
+        tb_prefetch(cpu, db->jmp_dest, db->nb_jmp_dest, tb->cs_base,
+                    tb->flags, cflags);
+    }
+#endif
+
     if (plugin_enabled) {
         plugin_gen_tb_end(cpu, db->num_insns);
     }
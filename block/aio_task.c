@@ -67,16 +67,14 @@ void coroutine_fn aio_task_pool_wait_one(AioTaskPool *pool)
     qemu_coroutine_yield();
 
     assert(!pool->waiting);
-    assert(pool->busy_tasks < pool->max_busy_tasks);
 }
 
 void coroutine_fn aio_task_pool_wait_slot(AioTaskPool *pool)
 {
-    if (pool->busy_tasks < pool->max_busy_tasks) {
-        return;
+    /* May take several tasks if max_busy_tasks was lowered */
+    while (pool->busy_tasks >= pool->max_busy_tasks) {
+        aio_task_pool_wait_one(pool);
     }
-
-    aio_task_pool_wait_one(pool);
 }
 
 void coroutine_fn aio_task_pool_wait_all(AioTaskPool *pool)
@@ -106,6 +104,17 @@ AioTaskPool *coroutine_fn aio_task_pool_new(int max_busy_tasks)
     return pool;
 }
 
+/*
+ * Change the number of tasks that may run in parallel.  When lowered,
+ * already running tasks are not affected, but no new ones are started
+ * until enough of them have finished.
+ */
+void aio_task_pool_set_max_busy_tasks(AioTaskPool *pool, int max_busy_tasks)
+{
+    assert(max_busy_tasks > 0);
+    pool->max_busy_tasks = max_busy_tasks;
+}
+
 void aio_task_pool_free(AioTaskPool *pool)
 {
     g_free(pool);
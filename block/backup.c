@@ -156,7 +156,7 @@ static int coroutine_fn backup_loop(BackupBlockJob *job)
         job->bg_bcs_call = s = block_copy_async(job->bcs, 0,
                 QEMU_ALIGN_UP(job->len, job->cluster_size),
                 job->perf.max_workers, job->perf.max_chunk,
-                backup_block_copy_callback, job);
+                job->perf.adaptive, backup_block_copy_callback, job);
 
         while (!block_copy_call_finished(s) &&
                !job_is_cancelled(&job->common.job))
@@ -370,6 +370,7 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
     int64_t cluster_size;
     BlockDriverState *cbw = NULL;
     BlockCopyState *bcs = NULL;
+    bool ok;
 
     assert(bs);
     assert(target);
@@ -471,6 +472,17 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
         goto error;
     }
 
+    /*
+     * The filter is live already, so copy-before-write operations may be
+     * holding memory from the pools that are replaced
+     */
+    bdrv_drained_begin(cbw);
+    ok = block_copy_set_limits(bcs, perf->max_mem, perf->buffer_size, errp);
+    bdrv_drained_end(cbw);
+    if (!ok) {
+        goto error;
+    }
+
     /* job->len is fixed, so we can't allow resize */
     job = block_job_create(job_id, &backup_job_driver, txn, cbw,
                            0, BLK_PERM_ALL,
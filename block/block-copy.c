@@ -34,6 +34,7 @@
 #define BLOCK_COPY_MAX_MEM (128 * MiB)
 #define BLOCK_COPY_MAX_WORKERS 64
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
+#define BLOCK_COPY_ADAPT_INITIAL_WORKERS 4
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
 typedef enum {
@@ -54,11 +55,29 @@ typedef struct BlockCopyCallState {
     int max_workers;
     int64_t max_chunk;
     bool ignore_ratelimit;
+    /*
+     * Background copy, started by block_copy_async().  It may only use
+     * part of the memory, so that copy-before-write operations, which
+     * guest writes wait for, are not stalled by it.
+     */
+    bool background;
+    bool adaptive;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
     /* Coroutine where async block-copy is running */
     Coroutine *co;
 
+    /*
+     * Adaptive mode: current limits, within max_workers and max_chunk,
+     * and the throughput measurement they are based on.  Only used by
+     * the coroutine running block_copy_dirty_clusters().
+     */
+    int workers;
+    int64_t chunk;
+    int64_t adapt_start_ns;
+    int64_t adapt_bytes;
+    int64_t adapt_last_rate;
+
     /* Fields whose state changes throughout the execution */
     bool finished; /* atomic */
     QemuCoSleep sleep; /* TODO: protect API with a lock */
@@ -130,6 +149,15 @@ typedef struct BlockCopyState {
     uint64_t len;
     BdrvRequestFlags write_flags;
 
+    /*
+     * Set in block_copy_state_new() and block_copy_set_limits(), while
+     * no copying is in progress.  max_mem and bg_max_mem are the sizes
+     * of mem and bg_mem, aligned to the cluster size.
+     */
+    int64_t buffer_size;
+    int64_t max_mem;
+    int64_t bg_max_mem;
+
     /*
      * Fields whose state changes throughout the execution
      * Protected by lock.
@@ -159,7 +187,9 @@ typedef struct BlockCopyState {
     BdrvDirtyBitmap *copy_bitmap;
     ProgressMeter *progress;
     SharedResource *mem;
+    SharedResource *bg_mem;
     RateLimit rate_limit;
+    uint64_t speed; /* atomic */
 } BlockCopyState;
 
 /* Called with lock held */
@@ -170,7 +200,7 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
         return s->cluster_size;
     case COPY_READ_WRITE:
     case COPY_RANGE_SMALL:
-        return MIN(MAX(s->cluster_size, BLOCK_COPY_MAX_BUFFER),
+        return MIN(MAX(s->cluster_size, s->buffer_size),
                    s->max_transfer);
     case COPY_RANGE_FULL:
         return MIN(MAX(s->cluster_size, BLOCK_COPY_MAX_COPY_RANGE),
@@ -194,6 +224,9 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
 
     QEMU_LOCK_GUARD(&s->lock);
     max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    max_chunk = MIN_NON_ZERO(max_chunk, call_state->chunk);
+    max_chunk = MIN(max_chunk, call_state->background ? s->bg_max_mem
+                                                      : s->max_mem);
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -272,6 +305,7 @@ void block_copy_state_free(BlockCopyState *s)
     ratelimit_destroy(&s->rate_limit);
     bdrv_release_dirty_bitmap(s->copy_bitmap);
     shres_destroy(s->mem);
+    shres_destroy(s->bg_mem);
     g_free(s);
 }
 
@@ -309,6 +343,46 @@ void block_copy_set_copy_opts(BlockCopyState *s, bool use_copy_range,
     }
 }
 
+/*
+ * Set the memory used by the buffers of all requests in flight, and the
+ * size of each buffered request.  Zero selects the defaults.  The
+ * background copy may only use three quarters of the memory; the rest is
+ * kept for copy-before-write operations.
+ *
+ * Must not be called while copying is in progress, e.g. once a
+ * copy-before-write filter using @s is live, only with it drained.
+ */
+bool block_copy_set_limits(BlockCopyState *s, int64_t max_mem,
+                           int64_t buffer_size, Error **errp)
+{
+    max_mem = max_mem ?: BLOCK_COPY_MAX_MEM;
+    buffer_size = buffer_size ?: BLOCK_COPY_MAX_BUFFER;
+
+    if (max_mem < s->cluster_size) {
+        error_setg(errp, "max-mem (%" PRIi64 ") is less than the block-copy "
+                   "cluster size (%" PRIi64 ")", max_mem, s->cluster_size);
+        return false;
+    }
+    if (buffer_size < 0) {
+        error_setg(errp, "buffer-size must be zero (which means default) or "
+                   "positive");
+        return false;
+    }
+
+    s->buffer_size = buffer_size;
+    s->max_mem = QEMU_ALIGN_DOWN(max_mem, s->cluster_size);
+    s->bg_max_mem = MAX(QEMU_ALIGN_DOWN(max_mem / 4 * 3, s->cluster_size),
+                        s->cluster_size);
+
+    if (s->mem) {
+        shres_destroy(s->mem);
+        shres_destroy(s->bg_mem);
+    }
+    s->mem = shres_create(s->max_mem);
+    s->bg_mem = shres_create(s->bg_max_mem);
+    return true;
+}
+
 static int64_t block_copy_calculate_cluster_size(BlockDriverState *target,
                                                  Error **errp)
 {
@@ -414,7 +488,6 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
         .cluster_size = cluster_size,
         .len = bdrv_dirty_bitmap_size(copy_bitmap),
         .write_flags = (is_fleecing ? BDRV_REQ_SERIALISING : 0),
-        .mem = shres_create(BLOCK_COPY_MAX_MEM),
         .max_transfer = QEMU_ALIGN_DOWN(
                                     block_copy_max_transfer(source, target),
                                     cluster_size),
@@ -422,6 +495,7 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
 
     s->discard_source = discard_source;
     block_copy_set_copy_opts(s, false, false);
+    block_copy_set_limits(s, 0, 0, &error_abort);
 
     ratelimit_init(&s->rate_limit);
     qemu_co_mutex_init(&s->lock);
@@ -446,6 +520,22 @@ void block_copy_set_progress_meter(BlockCopyState *s, ProgressMeter *pm)
  *          otherwise -ECANCELED if pool status is bad
  *          otherwise 0 (successfully scheduled)
  */
+static void coroutine_fn block_copy_task_get_mem(BlockCopyTask *task)
+{
+    if (task->call_state->background) {
+        co_get_from_shres(task->s->bg_mem, task->req.bytes);
+    }
+    co_get_from_shres(task->s->mem, task->req.bytes);
+}
+
+static void coroutine_fn block_copy_task_put_mem(BlockCopyTask *task)
+{
+    co_put_to_shres(task->s->mem, task->req.bytes);
+    if (task->call_state->background) {
+        co_put_to_shres(task->s->bg_mem, task->req.bytes);
+    }
+}
+
 static coroutine_fn int block_copy_task_run(AioTaskPool *pool,
                                             BlockCopyTask *task)
 {
@@ -458,7 +548,7 @@ static coroutine_fn int block_copy_task_run(AioTaskPool *pool,
 
     aio_task_pool_wait_slot(pool);
     if (aio_task_pool_status(pool) < 0) {
-        co_put_to_shres(task->s->mem, task->req.bytes);
+        block_copy_task_put_mem(task);
         block_copy_task_end(task, -ECANCELED);
         g_free(task);
         return -ECANCELED;
@@ -589,7 +679,7 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
             progress_work_done(s->progress, t->req.bytes);
         }
     }
-    co_put_to_shres(s->mem, t->req.bytes);
+    block_copy_task_put_mem(t);
     block_copy_task_end(t, ret);
 
     if (s->discard_source && ret == 0) {
@@ -720,6 +810,71 @@ int64_t coroutine_fn block_copy_reset_unallocated(BlockCopyState *s,
     return ret;
 }
 
+/*
+ * Adaptive mode of the background copy: once per slice, compare the
+ * throughput with the job speed, or if that is unlimited, with the
+ * throughput of the previous slice.
+ *
+ * Below the target, larger requests are tried first, as they cost no
+ * more memory per byte in flight, then more workers.  When the target
+ * speed is met, a worker is dropped, so that the job competes less with
+ * the guest for the source and the target.  Without a target, the limits
+ * grow as long as that increases the throughput by at least 10%, and
+ * back off when the throughput falls by as much.
+ */
+static void coroutine_fn block_copy_adapt(BlockCopyCallState *call_state,
+                                          int64_t bytes, AioTaskPool *aio)
+{
+    BlockCopyState *s = call_state->s;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = now - call_state->adapt_start_ns;
+    uint64_t speed = qatomic_read(&s->speed);
+    int64_t max_chunk, rate, last;
+    bool grow, shrink;
+
+    call_state->adapt_bytes += bytes;
+    if (elapsed < BLOCK_COPY_SLICE_TIME) {
+        return;
+    }
+
+    rate = call_state->adapt_bytes * NANOSECONDS_PER_SECOND / elapsed;
+    last = call_state->adapt_last_rate;
+    if (speed) {
+        grow = rate < speed - speed / 20;
+        shrink = !grow;
+    } else {
+        grow = rate > last + last / 10;
+        shrink = rate < last - last / 10;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s),
+                                 call_state->max_chunk);
+    }
+    max_chunk = MIN(max_chunk, s->bg_max_mem);
+
+    if (grow) {
+        if (call_state->chunk < max_chunk) {
+            call_state->chunk = MIN(call_state->chunk * 2, max_chunk);
+        } else {
+            call_state->workers = MIN(call_state->workers * 2,
+                                      call_state->max_workers);
+        }
+    } else if (shrink) {
+        call_state->workers = speed ? call_state->workers - 1
+                                    : call_state->workers * 3 / 4;
+        call_state->workers = MAX(call_state->workers, 1);
+    }
+    if (aio) {
+        aio_task_pool_set_max_busy_tasks(aio, call_state->workers);
+    }
+    trace_block_copy_adapt(s, rate, call_state->workers, call_state->chunk);
+
+    call_state->adapt_start_ns = now;
+    call_state->adapt_bytes = 0;
+    call_state->adapt_last_rate = rate;
+}
+
 /*
  * block_copy_dirty_clusters
  *
@@ -800,13 +955,17 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
 
         trace_block_copy_process(s, task->req.offset);
 
-        co_get_from_shres(s->mem, task->req.bytes);
+        block_copy_task_get_mem(task);
 
         offset = task_end(task);
         bytes = end - offset;
 
+        if (call_state->adaptive) {
+            block_copy_adapt(call_state, task->req.bytes, aio);
+        }
         if (!aio && bytes) {
-            aio = aio_task_pool_new(call_state->max_workers);
+            aio = aio_task_pool_new(call_state->adaptive ? call_state->workers
+                                                         : call_state->max_workers);
         }
 
         ret = block_copy_task_run(aio, task);
@@ -956,6 +1115,7 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t start, int64_t bytes,
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque)
 {
@@ -967,6 +1127,11 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .background = true,
+        .adaptive = adaptive,
+        .workers = MIN(BLOCK_COPY_ADAPT_INITIAL_WORKERS, max_workers),
+        .chunk = adaptive ? s->cluster_size : 0,
+        .adapt_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME),
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -1049,6 +1214,7 @@ void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip)
 void block_copy_set_speed(BlockCopyState *s, uint64_t speed)
 {
     ratelimit_set_speed(&s->rate_limit, speed, BLOCK_COPY_SLICE_TIME);
+    qatomic_set(&s->speed, speed);
 
     /*
      * Note: it's good to kick all call states from here, but it should be done
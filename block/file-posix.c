@@ -161,6 +161,7 @@ typedef struct BDRVRawState {
     bool use_linux_aio:1;
     bool has_laio_fdsync:1;
     bool use_linux_io_uring:1;
+    bool use_luring_fixed:1; /* fd and buffers registered as io_uring fixed */
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -561,6 +562,13 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+#ifdef CONFIG_LINUX_IO_URING
+        {
+            .name = "io-uring-fixed",
+            .type = QEMU_OPT_BOOL,
+            .help = "use io_uring fixed files and buffers (default: off)",
+        },
+#endif
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -638,6 +646,12 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     s->use_linux_aio = (aio == BLOCKDEV_AIO_OPTIONS_NATIVE);
 #ifdef CONFIG_LINUX_IO_URING
     s->use_linux_io_uring = (aio == BLOCKDEV_AIO_OPTIONS_IO_URING);
+    s->use_luring_fixed = qemu_opt_get_bool(opts, "io-uring-fixed", false);
+    if (s->use_luring_fixed && !s->use_linux_io_uring) {
+        error_setg(errp, "io-uring-fixed requires aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
@@ -809,6 +823,11 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         /* When extending regular files, we get zeros from the OS */
         bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
     }
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_luring_fixed) {
+        luring_register_fd(s->fd);
+    }
+#endif
     ret = 0;
 fail:
     if (ret < 0 && s->fd != -1) {
@@ -2618,6 +2637,11 @@ static void raw_close(BlockDriverState *bs)
     if (s->fd >= 0) {
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+        if (s->use_luring_fixed) {
+            luring_unregister_fd(s->fd);
+        }
 #endif
         qemu_close(s->fd);
         s->fd = -1;
@@ -3809,6 +3833,12 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+#ifdef CONFIG_LINUX_IO_URING
+        if (s->use_luring_fixed) {
+            luring_unregister_fd(s->fd);
+            luring_register_fd(s->perm_change_fd);
+        }
+#endif
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -3879,6 +3909,33 @@ raw_co_copy_range_to(BlockDriverState *bs,
     return raw_thread_pool_submit(handle_aiocb_copy_range, &acb);
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * Guest RAM registered here (see BlockRAMRegistrar) becomes io_uring fixed
+ * buffers, so that the kernel does not have to pin and unpin the pages for
+ * every request.  This is only an optimization and never fails.
+ */
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->use_luring_fixed) {
+        luring_register_buf(host, size);
+    }
+    return true;
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->use_luring_fixed) {
+        luring_unregister_buf(host, size);
+    }
+}
+#endif
+
 BlockDriver bdrv_file = {
     .format_name = "file",
     .protocol_name = "file",
@@ -3916,6 +3973,10 @@ BlockDriver bdrv_file = {
     .bdrv_check_perm = raw_check_perm,
     .bdrv_set_perm   = raw_set_perm,
     .bdrv_abort_perm_update = raw_abort_perm_update,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
     .create_opts = &raw_create_opts,
     .mutable_opts = mutable_opts,
 };
@@ -4282,6 +4343,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_abort_perm_update = raw_abort_perm_update,
     .bdrv_probe_blocksizes = hdev_probe_blocksizes,
     .bdrv_probe_geometry = hdev_probe_geometry,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
 
     /* generic scsi device */
 #ifdef __linux__
@@ -11,11 +11,16 @@
 #include "qemu/osdep.h"
 #include <liburing.h>
 #include "block/aio.h"
+#include "block/aio-wait.h"
 #include "qemu/queue.h"
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "sysemu/block-backend.h"
 #include "trace.h"
@@ -26,12 +31,18 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* The kernel refuses to register buffers larger than this */
+#define MAX_FIXED_BUF_SIZE (1 * GiB)
+#define MAX_FIXED_BUFS     1024
+#define MAX_FIXED_FILES    64
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
+    int64_t start_ns; /* for latency accounting */
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
     /*
@@ -58,8 +69,334 @@ struct LuringState {
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /* Updated in the home thread, read by query-iothreads */
+    Stat64 stat_requests;
+    Stat64 stat_total_ns;
+    Stat64 stat_max_ns;
+
+    /* On luring_states, protected by luring_fixed_lock */
+    QLIST_ENTRY(LuringState) next;
+
+    /* Runs luring_sync_fixed() in the home thread */
+    QEMUBH *sync_bh;
+
+    /*
+     * Buffers registered with the ring, sorted by address.  They are
+     * copied from the process-wide registry below when the ring is idle
+     * and the registry has changed; until then requests do not use them.
+     */
+    unsigned fixed_buf_gen;
+    struct iovec fixed_bufs[MAX_FIXED_BUFS];
+    unsigned nr_fixed_bufs;
+
+    /*
+     * Sparse table of registered files, a copy of luring_fixed_fds.  Slots
+     * are updated one by one, so this does not have to wait for the ring
+     * to be idle.
+     */
+    bool fixed_files;
+    int fixed_fds[MAX_FIXED_FILES];
 };
 
+/*
+ * Process-wide registry of guest RAM and image file descriptors that
+ * should be used as io_uring fixed buffers and fixed files.  Only nodes
+ * with io-uring-fixed=on add entries, so rings pin nothing otherwise.
+ */
+static QemuMutex luring_fixed_lock;
+static GArray *luring_fixed_bufs; /* struct iovec, may overlap */
+static unsigned luring_fixed_buf_gen = 1; /* bumped on every change */
+static int luring_fixed_fds[MAX_FIXED_FILES]; /* -1 for free slots */
+static QLIST_HEAD(, LuringState) luring_states =
+    QLIST_HEAD_INITIALIZER(luring_states);
+
+static void __attribute__((__constructor__)) luring_fixed_init(void)
+{
+    int i;
+
+    qemu_mutex_init(&luring_fixed_lock);
+    luring_fixed_bufs = g_array_new(false, false, sizeof(struct iovec));
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        luring_fixed_fds[i] = -1;
+    }
+}
+
+/* Called with luring_fixed_lock held */
+static void luring_fixed_changed_locked(void)
+{
+    LuringState *s;
+
+    QLIST_FOREACH(s, &luring_states, next) {
+        if (s->sync_bh) {
+            qemu_bh_schedule(s->sync_bh);
+        }
+    }
+}
+
+void luring_register_buf(void *host, size_t size)
+{
+    struct iovec iov = { .iov_base = host, .iov_len = size };
+
+    QEMU_LOCK_GUARD(&luring_fixed_lock);
+    g_array_append_val(luring_fixed_bufs, iov);
+    qatomic_inc(&luring_fixed_buf_gen);
+    luring_fixed_changed_locked();
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    unsigned i;
+
+    QEMU_LOCK_GUARD(&luring_fixed_lock);
+    for (i = 0; i < luring_fixed_bufs->len; i++) {
+        struct iovec *iov = &g_array_index(luring_fixed_bufs, struct iovec, i);
+
+        if (iov->iov_base == host && iov->iov_len == size) {
+            g_array_remove_index_fast(luring_fixed_bufs, i);
+            /* Rings stop using their copy as soon as they see this */
+            qatomic_inc(&luring_fixed_buf_gen);
+            luring_fixed_changed_locked();
+            return;
+        }
+    }
+}
+
+void luring_register_fd(int fd)
+{
+    int i;
+
+    QEMU_LOCK_GUARD(&luring_fixed_lock);
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (luring_fixed_fds[i] == -1) {
+            luring_fixed_fds[i] = fd;
+            luring_fixed_changed_locked();
+            return;
+        }
+    }
+    /* Table full, this file simply does not use IOSQE_FIXED_FILE */
+}
+
+static void luring_sync_files(LuringState *s);
+
+static void luring_sync_files_bh(void *opaque)
+{
+    luring_sync_files(opaque);
+}
+
+/*
+ * Remove @fd from the registry and from all rings before returning, so
+ * that the caller can close it: a ring that still had it registered would
+ * keep the open file description, and with it the image locks, alive.
+ * Must be called from the main loop thread.
+ */
+void luring_unregister_fd(int fd)
+{
+    g_autoptr(GPtrArray) rings = g_ptr_array_new();
+    LuringState *s;
+    unsigned i;
+
+    WITH_QEMU_LOCK_GUARD(&luring_fixed_lock) {
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            if (luring_fixed_fds[i] == fd) {
+                luring_fixed_fds[i] = -1;
+                break;
+            }
+        }
+        if (i == MAX_FIXED_FILES) {
+            return;
+        }
+        /* Including rings that may be registering their table right now */
+        QLIST_FOREACH(s, &luring_states, next) {
+            if (s->aio_context) {
+                g_ptr_array_add(rings, s);
+            }
+        }
+    }
+
+    /* Rings are only freed in the main loop, so they cannot go away here */
+    for (i = 0; i < rings->len; i++) {
+        aio_wait_bh_oneshot(((LuringState *)rings->pdata[i])->aio_context,
+                            luring_sync_files_bh, rings->pdata[i]);
+    }
+}
+
+static int luring_fixed_buf_cmp(const void *a, const void *b)
+{
+    const struct iovec *x = a, *y = b;
+
+    return x->iov_base < y->iov_base ? -1 : x->iov_base > y->iov_base;
+}
+
+/* Bring the ring's file table in sync with the registry */
+static void luring_sync_files(LuringState *s)
+{
+    int fds[MAX_FIXED_FILES];
+    bool any = false;
+    int i, ret;
+
+    WITH_QEMU_LOCK_GUARD(&luring_fixed_lock) {
+        memcpy(fds, luring_fixed_fds, sizeof(fds));
+    }
+
+    if (!s->fixed_files) {
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            any |= fds[i] != -1;
+        }
+        if (!any) {
+            return;
+        }
+
+        /* Start with an empty table, the slots are filled in below */
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            s->fixed_fds[i] = -1;
+        }
+        ret = io_uring_register_files(&s->ring, s->fixed_fds,
+                                      MAX_FIXED_FILES);
+        trace_luring_register_files(s, MAX_FIXED_FILES, ret);
+        if (ret < 0) {
+            return;
+        }
+        s->fixed_files = true;
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_fds[i] == fds[i]) {
+            continue;
+        }
+        /* Requests already submitted keep their reference to the file */
+        ret = io_uring_register_files_update(&s->ring, i, &fds[i], 1);
+        trace_luring_update_file(s, i, fds[i], ret);
+        s->fixed_fds[i] = ret == 1 ? fds[i] : -1;
+    }
+}
+
+/*
+ * Bring the ring's fixed buffers in sync with the registry.  Requests that
+ * were prepared against the old buffers must have completed before the
+ * kernel table can be replaced, so this does nothing while requests are
+ * queued or in flight; luring_process_completions() tries again once the
+ * ring is idle.
+ */
+static void luring_sync_bufs(LuringState *s)
+{
+    unsigned gen = qatomic_read(&luring_fixed_buf_gen);
+    unsigned i, n;
+    int ret;
+
+    if (gen == s->fixed_buf_gen ||
+        s->io_q.in_queue || s->io_q.in_flight) {
+        return;
+    }
+
+    if (s->nr_fixed_bufs) {
+        io_uring_unregister_buffers(&s->ring);
+        s->nr_fixed_bufs = 0;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&luring_fixed_lock) {
+        gen = qatomic_read(&luring_fixed_buf_gen);
+
+        for (i = 0; i < luring_fixed_bufs->len; i++) {
+            struct iovec *iov = &g_array_index(luring_fixed_bufs,
+                                               struct iovec, i);
+            uint8_t *base = iov->iov_base;
+            size_t len = iov->iov_len;
+
+            /* Split large RAM blocks into chunks that the kernel accepts */
+            while (len && s->nr_fixed_bufs < MAX_FIXED_BUFS) {
+                size_t chunk = MIN(len, MAX_FIXED_BUF_SIZE);
+
+                s->fixed_bufs[s->nr_fixed_bufs++] = (struct iovec) {
+                    .iov_base = base,
+                    .iov_len = chunk,
+                };
+                base += chunk;
+                len -= chunk;
+            }
+        }
+    }
+
+    /* Several nodes may have registered the same RAM, drop duplicates */
+    qsort(s->fixed_bufs, s->nr_fixed_bufs, sizeof(s->fixed_bufs[0]),
+          luring_fixed_buf_cmp);
+    for (i = 1, n = MIN(s->nr_fixed_bufs, 1); i < s->nr_fixed_bufs; i++) {
+        if (s->fixed_bufs[i].iov_base != s->fixed_bufs[n - 1].iov_base ||
+            s->fixed_bufs[i].iov_len != s->fixed_bufs[n - 1].iov_len) {
+            s->fixed_bufs[n++] = s->fixed_bufs[i];
+        }
+    }
+    s->nr_fixed_bufs = n;
+
+    if (s->nr_fixed_bufs) {
+        /* This pins guest RAM and may fail because of RLIMIT_MEMLOCK */
+        ret = io_uring_register_buffers(&s->ring, s->fixed_bufs,
+                                        s->nr_fixed_bufs);
+        trace_luring_register_buffers(s, s->nr_fixed_bufs, ret);
+        if (ret < 0) {
+            s->nr_fixed_bufs = 0;
+        }
+    }
+
+    s->fixed_buf_gen = gen;
+}
+
+static void luring_sync_fixed(void *opaque)
+{
+    LuringState *s = opaque;
+
+    luring_sync_files(s);
+    luring_sync_bufs(s);
+}
+
+/*
+ * Return the index of the fixed buffer that contains all of @qiov, or -1.
+ * Only single-element vectors can be submitted as READ_FIXED/WRITE_FIXED.
+ */
+static int luring_fixed_buf_index(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t addr, base;
+    int lo = 0, hi = s->nr_fixed_bufs - 1;
+
+    /* Never use buffers that may have been unregistered in the meantime */
+    if (!s->nr_fixed_bufs || qiov->niov != 1 ||
+        s->fixed_buf_gen != qatomic_read(&luring_fixed_buf_gen)) {
+        return -1;
+    }
+
+    addr = (uintptr_t)qiov->iov[0].iov_base;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        base = (uintptr_t)s->fixed_bufs[mid].iov_base;
+        if (addr < base) {
+            hi = mid - 1;
+        } else if (addr - base >= s->fixed_bufs[mid].iov_len) {
+            lo = mid + 1;
+        } else {
+            return qiov->iov[0].iov_len <=
+                   s->fixed_bufs[mid].iov_len - (addr - base) ? mid : -1;
+        }
+    }
+    return -1;
+}
+
+static int luring_fixed_file_index(LuringState *s, int fd)
+{
+    unsigned i;
+
+    if (!s->fixed_files) {
+        return -1;
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_fds[i] == fd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /**
  * luring_resubmit:
  *
@@ -102,12 +439,27 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     /* Update sqe */
     luringcb->sqeq.off += nread;
-    luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
-    luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        /* The remainder is still inside the same fixed buffer */
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len -= nread;
+    } else {
+        luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
+        luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
+    }
 
     luring_resubmit(s, luringcb);
 }
 
+static void luring_account_completion(LuringState *s, LuringAIOCB *luringcb)
+{
+    uint64_t latency_ns = get_clock() - luringcb->start_ns;
+
+    stat64_add(&s->stat_requests, 1);
+    stat64_add(&s->stat_total_ns, latency_ns);
+    stat64_max(&s->stat_max_ns, latency_ns);
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -145,6 +497,13 @@ static void luring_process_completions(LuringState *s)
      */
     qemu_bh_schedule(s->completion_bh);
 
+#ifdef IORING_SETUP_DEFER_TASKRUN
+    /* Completions are only posted when we ask the kernel to run them */
+    if (s->ring.flags & IORING_SETUP_DEFER_TASKRUN) {
+        io_uring_get_events(&s->ring);
+    }
+#endif
+
     while (io_uring_peek_cqe(&s->ring, &cqes) == 0) {
         LuringAIOCB *luringcb;
         int ret;
@@ -208,6 +567,7 @@ static void luring_process_completions(LuringState *s)
 end:
         luringcb->ret = ret;
         qemu_iovec_destroy(&luringcb->resubmit_qiov);
+        luring_account_completion(s, luringcb);
 
         /*
          * If the coroutine is already entered it must be in ioq_submit()
@@ -223,6 +583,12 @@ end:
 
     qemu_bh_cancel(s->completion_bh);
 
+    /* Registry changes that had to wait for the ring to drain */
+    if (!s->io_q.in_flight && !s->io_q.in_queue &&
+        s->fixed_buf_gen != qatomic_read(&luring_fixed_buf_gen)) {
+        qemu_bh_schedule(s->sync_bh);
+    }
+
     defer_call_end();
 }
 
@@ -295,7 +661,20 @@ static bool qemu_luring_poll_cb(void *opaque)
 {
     LuringState *s = opaque;
 
-    return io_uring_cq_ready(&s->ring);
+    if (io_uring_cq_ready(&s->ring)) {
+        return true;
+    }
+
+#ifdef IORING_SETUP_DEFER_TASKRUN
+    /*
+     * With IORING_SETUP_DEFER_TASKRUN, completions are not visible in the cq
+     * ring until luring_process_completions() asks for them, but the kernel
+     * flags pending work.
+     */
+    return qatomic_read(s->ring.sq.kflags) & IORING_SQ_TASKRUN;
+#else
+    return false;
+#endif
 }
 
 static void qemu_luring_poll_ready(void *opaque)
@@ -339,19 +718,34 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    int buf_index = -1;
+    int file_index;
+
+    if (luringcb->qiov) {
+        buf_index = luring_fixed_buf_index(s, luringcb->qiov);
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
-        break;
     case QEMU_AIO_ZONE_APPEND:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->iov[0].iov_len, offset,
+                                      buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
+                                 luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->iov[0].iov_len, offset,
+                                     buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
+                                luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -361,6 +755,12 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+
+    file_index = luring_fixed_file_index(s, fd);
+    if (file_index >= 0) {
+        sqes->fd = file_index;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -390,6 +790,7 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
         .ret        = -EINPROGRESS,
         .qiov       = qiov,
         .is_read    = (type == QEMU_AIO_READ),
+        .start_ns   = get_clock(),
     };
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
@@ -410,19 +811,28 @@ void luring_detach_aio_context(LuringState *s, AioContext *old_context)
     aio_set_fd_handler(old_context, s->ring.ring_fd,
                        NULL, NULL, NULL, NULL, s);
     qemu_bh_delete(s->completion_bh);
-    s->aio_context = NULL;
+    WITH_QEMU_LOCK_GUARD(&luring_fixed_lock) {
+        qemu_bh_delete(s->sync_bh);
+        s->sync_bh = NULL;
+        s->aio_context = NULL;
+    }
 }
 
 void luring_attach_aio_context(LuringState *s, AioContext *new_context)
 {
-    s->aio_context = new_context;
     s->completion_bh = aio_bh_new(new_context, qemu_luring_completion_bh, s);
+    WITH_QEMU_LOCK_GUARD(&luring_fixed_lock) {
+        s->aio_context = new_context;
+        s->sync_bh = aio_bh_new(new_context, luring_sync_fixed, s);
+        /* Pick up what was registered before this ring existed */
+        qemu_bh_schedule(s->sync_bh);
+    }
     aio_set_fd_handler(s->aio_context, s->ring.ring_fd,
                        qemu_luring_completion_cb, NULL,
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(unsigned int setup_flags, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
@@ -430,7 +840,7 @@ LuringState *luring_init(Error **errp)
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    rc = io_uring_queue_init(MAX_ENTRIES, ring, setup_flags);
     if (rc < 0) {
         error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
@@ -438,12 +848,29 @@ LuringState *luring_init(Error **errp)
     }
 
     ioq_init(&s->io_q);
+
+    WITH_QEMU_LOCK_GUARD(&luring_fixed_lock) {
+        QLIST_INSERT_HEAD(&luring_states, s, next);
+    }
     return s;
 
 }
 
+void luring_get_stats(LuringState *s, uint64_t *requests,
+                      uint64_t *total_latency_ns, uint64_t *max_latency_ns)
+{
+    *requests = stat64_get(&s->stat_requests);
+    *total_latency_ns = stat64_get(&s->stat_total_ns);
+    *max_latency_ns = stat64_get(&s->stat_max_ns);
+}
+
 void luring_cleanup(LuringState *s)
 {
+    WITH_QEMU_LOCK_GUARD(&luring_fixed_lock) {
+        QLIST_REMOVE(s, next);
+    }
+
+    /* io_uring_queue_exit() drops the fixed buffers and files too */
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
     g_free(s);
@@ -24,6 +24,7 @@
 #include "qemu/ratelimit.h"
 #include "qemu/bitmap.h"
 #include "qemu/memalign.h"
+#include "qemu/stats64.h"
 
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
@@ -38,6 +39,20 @@ typedef struct MirrorBuffer {
 
 typedef struct MirrorOp MirrorOp;
 
+/*
+ * Adjacent guest writes that are copied to the target with a single
+ * request in write-blocking mode.  The first writer issues the request,
+ * the others wait for it in @waiters.
+ */
+typedef struct MirrorActiveBatch {
+    uint64_t offset;
+    uint64_t bytes;
+    int flags;
+    QEMUIOVector qiov;
+    CoQueue waiters;
+    QTAILQ_ENTRY(MirrorActiveBatch) next;
+} MirrorActiveBatch;
+
 typedef struct MirrorBlockJob {
     BlockJob common;
     BlockBackend *target;
@@ -82,8 +97,11 @@ typedef struct MirrorBlockJob {
     uint64_t last_pause_ns;
     unsigned long *in_flight_bitmap;
     unsigned in_flight;
+    unsigned max_in_flight;
     int64_t bytes_in_flight;
     QTAILQ_HEAD(, MirrorOp) ops_in_flight;
+    /* Batches of active writes that are still open for adjacent writes */
+    QTAILQ_HEAD(, MirrorActiveBatch) active_batches;
     int ret;
     bool unmap;
     int target_cluster_size;
@@ -91,6 +109,11 @@ typedef struct MirrorBlockJob {
     bool initial_zeroing_ongoing;
     int in_active_write_counter;
     int64_t active_write_bytes_in_flight;
+    /* Guest writes copied to the target and the latency this added */
+    Stat64 active_writes;
+    Stat64 active_target_writes;
+    Stat64 active_write_ns;
+    Stat64 active_write_max_ns;
     bool prepared;
     bool in_drain;
     bool base_ro;
@@ -480,6 +503,11 @@ static unsigned mirror_perform(MirrorBlockJob *s, int64_t offset,
     return bytes_handled;
 }
 
+static int mirror_max_io_bytes(MirrorBlockJob *s)
+{
+    return MAX(s->buf_size / s->max_in_flight, MAX_IO_BYTES);
+}
+
 static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
 {
     BlockDriverState *source;
@@ -488,7 +516,7 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
     /* At least the first dirty chunk is mirrored in one iteration. */
     int nb_chunks = 1;
     bool write_zeroes_ok = bdrv_can_write_zeroes_with_unmap(blk_bs(s->target));
-    int max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    int max_io_bytes = mirror_max_io_bytes(s);
 
     bdrv_graph_co_rdlock();
     source = s->mirror_top_bs->backing->bs;
@@ -600,7 +628,7 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
             }
         }
 
-        while (s->in_flight >= MAX_IN_FLIGHT) {
+        while (s->in_flight >= s->max_in_flight) {
             trace_mirror_yield_in_flight(s, offset, s->in_flight);
             mirror_wait_for_free_in_flight_slot(s);
         }
@@ -866,7 +894,7 @@ static int coroutine_fn GRAPH_UNLOCKED mirror_dirty_init(MirrorBlockJob *s)
                 return 0;
             }
 
-            if (s->in_flight >= MAX_IN_FLIGHT) {
+            if (s->in_flight >= s->max_in_flight) {
                 trace_mirror_yield(s, UINT64_MAX, s->buf_free_count,
                                    s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1069,7 +1097,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
         }
         if (delta < BLOCK_JOB_SLICE_TIME &&
             iostatus == BLOCK_DEVICE_IO_STATUS_OK) {
-            if (s->in_flight >= MAX_IN_FLIGHT || s->buf_free_count == 0 ||
+            if (s->in_flight >= s->max_in_flight || s->buf_free_count == 0 ||
                 (cnt == 0 && s->in_flight > 0)) {
                 trace_mirror_yield(s, cnt, s->buf_free_count, s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1298,6 +1326,19 @@ static void mirror_query(BlockJob *job, BlockJobInfo *info)
     info->u.mirror = (BlockJobInfoMirror) {
         .actively_synced = qatomic_read(&s->actively_synced),
     };
+
+    if (qatomic_read(&s->copy_mode) == MIRROR_COPY_MODE_WRITE_BLOCKING) {
+        uint64_t writes = stat64_get(&s->active_writes);
+
+        info->u.mirror.active_writes = g_new(MirrorActiveWriteStats, 1);
+        *info->u.mirror.active_writes = (MirrorActiveWriteStats) {
+            .writes = writes,
+            .target_writes = stat64_get(&s->active_target_writes),
+            .latency_avg_ns = writes ? stat64_get(&s->active_write_ns) / writes
+                                     : 0,
+            .latency_max_ns = stat64_get(&s->active_write_max_ns),
+        };
+    }
 }
 
 static const BlockJobDriver mirror_job_driver = {
@@ -1445,6 +1486,68 @@ do_sync_target_write(MirrorBlockJob *job, MirrorMethod method,
     }
 }
 
+/*
+ * Copy a guest write to the target, together with adjacent writes that
+ * are ready to be copied at about the same time.  If the write directly
+ * follows one that is still waiting to be issued, it is appended to it;
+ * otherwise it starts a new batch and lets the other coroutines that are
+ * runnable in this event loop iteration add their writes first.
+ *
+ * All writes in a batch have their areas locked by their own MirrorOp
+ * until they return, so the union of the areas is locked for the target
+ * request.
+ */
+static void coroutine_fn
+mirror_active_write(MirrorBlockJob *job, uint64_t offset, uint64_t bytes,
+                    QEMUIOVector *qiov, int flags)
+{
+    MirrorActiveBatch *batch;
+
+    /* Nothing can join a batch if no other active write is pending */
+    if (job->in_active_write_counter == 1) {
+        stat64_add(&job->active_target_writes, 1);
+        do_sync_target_write(job, MIRROR_METHOD_COPY, offset, bytes, qiov,
+                             flags);
+        return;
+    }
+
+    QTAILQ_FOREACH(batch, &job->active_batches, next) {
+        if (batch->offset + batch->bytes == offset && batch->flags == flags &&
+            batch->bytes + bytes <= mirror_max_io_bytes(job) &&
+            batch->qiov.niov + qiov->niov <= job->max_iov) {
+            qemu_iovec_concat(&batch->qiov, qiov, 0, bytes);
+            batch->bytes += bytes;
+            qemu_co_queue_wait(&batch->waiters, NULL);
+            return;
+        }
+    }
+
+    batch = g_new(MirrorActiveBatch, 1);
+    *batch = (MirrorActiveBatch) {
+        .offset = offset,
+        .bytes  = bytes,
+        .flags  = flags,
+    };
+    qemu_iovec_init(&batch->qiov, qiov->niov);
+    qemu_iovec_concat(&batch->qiov, qiov, 0, bytes);
+    qemu_co_queue_init(&batch->waiters);
+    QTAILQ_INSERT_TAIL(&job->active_batches, batch, next);
+
+    aio_co_schedule(qemu_get_current_aio_context(), qemu_coroutine_self());
+    qemu_coroutine_yield();
+
+    QTAILQ_REMOVE(&job->active_batches, batch, next);
+    trace_mirror_active_write(job, batch->offset, batch->bytes,
+                              batch->qiov.niov);
+    stat64_add(&job->active_target_writes, 1);
+    do_sync_target_write(job, MIRROR_METHOD_COPY, batch->offset, batch->bytes,
+                         &batch->qiov, batch->flags);
+
+    qemu_co_queue_restart_all(&batch->waiters);
+    qemu_iovec_destroy(&batch->qiov);
+    g_free(batch);
+}
+
 static MirrorOp *coroutine_fn active_write_prepare(MirrorBlockJob *s,
                                                    uint64_t offset,
                                                    uint64_t bytes)
@@ -1534,10 +1637,13 @@ bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
 {
     MirrorOp *op = NULL;
     MirrorBDSOpaque *s = bs->opaque;
+    int64_t start_ns = 0, latency_ns = 0;
     int ret = 0;
 
     if (copy_to_target) {
+        start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
         op = active_write_prepare(s->job, offset, bytes);
+        latency_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns;
     }
 
     switch (method) {
@@ -1567,11 +1673,21 @@ bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
     }
 
     if (copy_to_target) {
-        do_sync_target_write(s->job, method, offset, bytes, qiov, flags);
+        start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        if (method == MIRROR_METHOD_COPY) {
+            mirror_active_write(s->job, offset, bytes, qiov, flags);
+        } else {
+            stat64_add(&s->job->active_target_writes, 1);
+            do_sync_target_write(s->job, method, offset, bytes, qiov, flags);
+        }
+        latency_ns += qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns;
     }
 
 out:
     if (copy_to_target) {
+        stat64_add(&s->job->active_writes, 1);
+        stat64_add(&s->job->active_write_ns, latency_ns);
+        stat64_max(&s->job->active_write_max_ns, latency_ns);
         active_write_settle(op);
     }
     return ret;
@@ -1722,7 +1838,7 @@ static BlockJob *mirror_start_job(
                              bool is_none_mode, BlockDriverState *base,
                              bool auto_complete, const char *filter_node_name,
                              bool is_mirror, MirrorCopyMode copy_mode,
-                             bool base_ro,
+                             int64_t max_in_flight, bool base_ro,
                              Error **errp)
 {
     MirrorBlockJob *s;
@@ -1749,6 +1865,11 @@ static BlockJob *mirror_start_job(
         buf_size = DEFAULT_MIRROR_BUF_SIZE;
     }
 
+    assert(max_in_flight >= 0 && max_in_flight <= MIRROR_MAX_IN_FLIGHT);
+    if (max_in_flight == 0) {
+        max_in_flight = MAX_IN_FLIGHT;
+    }
+
     bdrv_graph_rdlock_main_loop();
     if (bdrv_skip_filters(bs) == bdrv_skip_filters(target)) {
         error_setg(errp, "Can't mirror node into itself");
@@ -1886,6 +2007,7 @@ static BlockJob *mirror_start_job(
     s->base_overlay = bdrv_find_overlay(bs, base);
     s->granularity = granularity;
     s->buf_size = ROUND_UP(buf_size, granularity);
+    s->max_in_flight = max_in_flight;
     s->unmap = unmap;
     if (auto_complete) {
         s->should_complete = true;
@@ -1968,6 +2090,7 @@ static BlockJob *mirror_start_job(
     bdrv_graph_wrunlock();
 
     QTAILQ_INIT(&s->ops_in_flight);
+    QTAILQ_INIT(&s->active_batches);
 
     trace_mirror_start(bs, s, opaque);
     job_start(&s->common.job);
@@ -2013,7 +2136,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp)
+                  MirrorCopyMode copy_mode, int64_t max_in_flight,
+                  Error **errp)
 {
     bool is_none_mode;
     BlockDriverState *base;
@@ -2036,7 +2160,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                      speed, granularity, buf_size, backing_mode, zero_target,
                      on_source_error, on_target_error, unmap, NULL, NULL,
                      &mirror_job_driver, is_none_mode, base, false,
-                     filter_node_name, true, copy_mode, false, errp);
+                     filter_node_name, true, copy_mode, max_in_flight, false,
+                     errp);
 }
 
 BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
@@ -2065,7 +2190,7 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
                      on_error, on_error, true, cb, opaque,
                      &commit_active_job_driver, false, base, auto_complete,
                      filter_node_name, false, MIRROR_COPY_MODE_BACKGROUND,
-                     base_read_only, errp);
+                     0, base_read_only, errp);
     if (!job) {
         goto error_restore_flags;
     }
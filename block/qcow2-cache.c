@@ -25,14 +25,24 @@
 #include "qemu/osdep.h"
 #include "block/block-io.h"
 #include "qemu/memalign.h"
+#include "qemu/queue.h"
 #include "qcow2.h"
 #include "trace.h"
 
+/*
+ * Lookups go through a chained hash table indexed by table offset, and
+ * replacement candidates (entries with ref == 0) are kept on an LRU list,
+ * so that both cache hits and evictions are O(1) regardless of the cache
+ * size.  Unused entries (offset == 0) are kept at the head of the LRU list
+ * so that they are always picked before any cached table is evicted.
+ */
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    int      hash_next;     /* next entry in the same bucket, or -1 */
+    QTAILQ_ENTRY(Qcow2CachedTable) lru_entry;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -44,6 +54,10 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    uint64_t                generation; /* see qcow2_cache_generation() */
+    int                    *hash_buckets;
+    unsigned                hash_bits;
+    QTAILQ_HEAD(, Qcow2CachedTable) lru_list;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +73,76 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline unsigned qcow2_cache_hash(Qcow2Cache *c, uint64_t offset)
+{
+    /* Fibonacci hashing of the table index */
+    uint64_t idx = offset / c->table_size;
+    return (idx * 0x9e3779b97f4a7c15ULL) >> (64 - c->hash_bits);
+}
+
+static void qcow2_cache_hash_insert(Qcow2Cache *c, int i)
+{
+    unsigned bucket = qcow2_cache_hash(c, c->entries[i].offset);
+
+    c->entries[i].hash_next = c->hash_buckets[bucket];
+    c->hash_buckets[bucket] = i;
+}
+
+static void qcow2_cache_hash_remove(Qcow2Cache *c, int i)
+{
+    unsigned bucket = qcow2_cache_hash(c, c->entries[i].offset);
+    int *p = &c->hash_buckets[bucket];
+
+    while (*p != i) {
+        assert(*p != -1);
+        p = &c->entries[*p].hash_next;
+    }
+    *p = c->entries[i].hash_next;
+    c->entries[i].hash_next = -1;
+}
+
+static int qcow2_cache_hash_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i = c->hash_buckets[qcow2_cache_hash(c, offset)];
+
+    while (i != -1 && c->entries[i].offset != offset) {
+        i = c->entries[i].hash_next;
+    }
+    return i;
+}
+
+/* Drop the table at index @i from the cache and make it the next victim */
+static void qcow2_cache_entry_invalidate(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    assert(t->ref == 0);
+    if (t->offset) {
+        qcow2_cache_hash_remove(c, i);
+        t->offset = 0;
+    }
+    t->lru_counter = 0;
+    QTAILQ_REMOVE(&c->lru_list, t, lru_entry);
+    QTAILQ_INSERT_HEAD(&c->lru_list, t, lru_entry);
+}
+
+static void qcow2_cache_reset(Qcow2Cache *c)
+{
+    int i;
+
+    c->generation++;
+
+    memset(c->hash_buckets, -1, sizeof(int) << c->hash_bits);
+    QTAILQ_INIT(&c->lru_list);
+    for (i = 0; i < c->size; i++) {
+        assert(c->entries[i].ref == 0);
+        c->entries[i].offset = 0;
+        c->entries[i].lru_counter = 0;
+        c->entries[i].hash_next = -1;
+        QTAILQ_INSERT_TAIL(&c->lru_list, &c->entries[i], lru_entry);
+    }
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -106,8 +190,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
+            qcow2_cache_entry_invalidate(c, i);
             i++;
             to_clean++;
         }
@@ -134,17 +217,23 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
     c->table_size = table_size;
+    /* Keep the load factor of the hash table at or below 1/2 */
+    c->hash_bits = MAX(ctz64(pow2ceil(num_tables)) + 1, 4);
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
+    c->hash_buckets = g_try_new(int, 1U << c->hash_bits);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->hash_buckets || !c->table_array) {
         qemu_vfree(c->table_array);
+        g_free(c->hash_buckets);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
     }
 
+    qcow2_cache_reset(c);
+
     return c;
 }
 
@@ -157,6 +246,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->hash_buckets);
     g_free(c->entries);
     g_free(c);
 
@@ -226,6 +316,7 @@ qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
         BLKDBG_EVENT(bs->file, BLKDBG_L2_UPDATE);
     }
 
+    c->generation++;
     ret = bdrv_pwrite(bs->file, c->entries[i].offset, c->table_size,
                       qcow2_cache_get_table_addr(c, i), 0);
     if (ret < 0) {
@@ -300,18 +391,14 @@ void qcow2_cache_depends_on_flush(Qcow2Cache *c)
 
 int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 {
-    int ret, i;
+    int ret;
 
     ret = qcow2_cache_flush(bs, c);
     if (ret < 0) {
         return ret;
     }
 
-    for (i = 0; i < c->size; i++) {
-        assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
-        c->entries[i].lru_counter = 0;
-    }
+    qcow2_cache_reset(c);
 
     qcow2_cache_table_release(c, 0, c->size);
 
@@ -325,11 +412,9 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *t;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -344,29 +429,25 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
+    i = qcow2_cache_hash_lookup(c, offset);
+    if (i >= 0) {
+        t = &c->entries[i];
+        if (t->ref == 0) {
+            QTAILQ_REMOVE(&c->lru_list, t, lru_entry);
         }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    /* The least recently used unreferenced entry is at the head */
+    t = QTAILQ_FIRST(&c->lru_list);
+    if (!t) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    i = t - c->entries;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -377,7 +458,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_entry_invalidate(c, i);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -390,11 +471,13 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         }
     }
 
-    c->entries[i].offset = offset;
+    t->offset = offset;
+    qcow2_cache_hash_insert(c, i);
+    QTAILQ_REMOVE(&c->lru_list, t, lru_entry);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
+    t->ref++;
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -422,11 +505,12 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
     c->entries[i].ref--;
     *table = NULL;
 
+    assert(c->entries[i].ref >= 0);
+
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        QTAILQ_INSERT_TAIL(&c->lru_list, &c->entries[i], lru_entry);
     }
-
-    assert(c->entries[i].ref >= 0);
 }
 
 void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
@@ -434,18 +518,19 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
     int i = qcow2_cache_get_table_idx(c, table);
     assert(c->entries[i].offset != 0);
     c->entries[i].dirty = true;
+    c->generation++;
 }
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
     int i;
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
+    if (!offset) {
+        return NULL;
     }
-    return NULL;
+
+    i = qcow2_cache_hash_lookup(c, offset);
+    return i >= 0 ? qcow2_cache_get_table_addr(c, i) : NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -454,9 +539,20 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
+    qcow2_cache_entry_invalidate(c, i);
     c->entries[i].dirty = false;
+    c->generation++;
 
     qcow2_cache_table_release(c, i, 1);
 }
+
+/*
+ * Returns a counter that changes whenever a table in @c is modified,
+ * written back or dropped.  A table that was read from the image file
+ * without the cache is only current if the counter did not change in the
+ * meantime.
+ */
+uint64_t qcow2_cache_generation(Qcow2Cache *c)
+{
+    return c->generation;
+}
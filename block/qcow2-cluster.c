@@ -193,6 +193,14 @@ int qcow2_grow_l1_table(BlockDriverState *bs, uint64_t min_size,
     return ret;
 }
 
+/* Returns the offset in the image file of the L2 slice that maps @offset */
+static uint64_t l2_slice_offset(BDRVQcow2State *s, uint64_t offset,
+                                uint64_t l2_offset)
+{
+    return l2_offset + l2_entry_size(s) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+}
+
 /*
  * l2_load
  *
@@ -212,13 +220,94 @@ l2_load(BlockDriverState *bs, uint64_t offset,
         uint64_t l2_offset, uint64_t **l2_slice)
 {
     BDRVQcow2State *s = bs->opaque;
-    int start_of_slice = l2_entry_size(s) *
-        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
 
-    return qcow2_cache_get(bs, s->l2_table_cache, l2_offset + start_of_slice,
+    return qcow2_cache_get(bs, s->l2_table_cache,
+                           l2_slice_offset(s, offset, l2_offset),
                            (void **)l2_slice);
 }
 
+/* Called with s->lock held.  Returns the L2 slice offset, 0 if none. */
+static uint64_t l2_prefetch_slice_offset(BDRVQcow2State *s, uint64_t offset)
+{
+    uint64_t l1_index, l2_offset;
+
+    l1_index = offset_to_l1_index(s, offset);
+    if (l1_index >= s->l1_size) {
+        return 0;
+    }
+
+    l2_offset = s->l1_table[l1_index] & L1E_OFFSET_MASK;
+    if (!l2_offset || offset_into_cluster(s, l2_offset)) {
+        return 0;
+    }
+
+    return l2_slice_offset(s, offset, l2_offset);
+}
+
+/*
+ * qcow2_l2_prefetch
+ *
+ * Loads the L2 slice that maps the guest @offset into the L2 cache without
+ * keeping a reference to it, so that a later lookup is a cache hit.  Nothing
+ * is done if the L2 table is unallocated or the slice is already cached.
+ * Invalid L1 entries are ignored here and reported by the request that
+ * actually needs the mapping.
+ *
+ * The slice is read while s->lock is not held, so guest requests are not
+ * held up by the read.  If the mapping or the L2 cache changed in the
+ * meantime, the data read may be stale and is dropped.
+ *
+ * Must be called without s->lock.  Returns 0 on success, -errno in error
+ * cases.
+ */
+int coroutine_fn GRAPH_RDLOCK
+qcow2_l2_prefetch(BlockDriverState *bs, uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    size_t slice_bytes = s->l2_slice_size * l2_entry_size(s);
+    uint64_t slice_offset, generation, *l2_slice;
+    void *buf;
+    int ret;
+
+    qemu_co_mutex_lock(&s->lock);
+    slice_offset = l2_prefetch_slice_offset(s, offset);
+    if (!slice_offset ||
+        qcow2_cache_is_table_offset(s->l2_table_cache, slice_offset)) {
+        qemu_co_mutex_unlock(&s->lock);
+        return 0;
+    }
+    generation = qcow2_cache_generation(s->l2_table_cache);
+    qemu_co_mutex_unlock(&s->lock);
+
+    buf = qemu_try_blockalign(bs->file->bs, slice_bytes);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    BLKDBG_CO_EVENT(bs->file, BLKDBG_L2_LOAD);
+    ret = bdrv_co_pread(bs->file, slice_offset, slice_bytes, buf, 0);
+    if (ret < 0) {
+        goto out;
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    if (generation == qcow2_cache_generation(s->l2_table_cache) &&
+        l2_prefetch_slice_offset(s, offset) == slice_offset &&
+        !qcow2_cache_is_table_offset(s->l2_table_cache, slice_offset)) {
+        ret = qcow2_cache_get_empty(bs, s->l2_table_cache, slice_offset,
+                                    (void **)&l2_slice);
+        if (ret == 0) {
+            memcpy(l2_slice, buf, slice_bytes);
+            qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+        }
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
 /*
  * Writes an L1 entry to disk (note that depending on the alignment
  * requirements this function may write more that just one entry in
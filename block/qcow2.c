@@ -701,6 +701,7 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_L2_READAHEAD,
     NULL
 };
 
@@ -817,6 +818,12 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_L2_READAHEAD,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum number of L2 table slices to load ahead of "
+                    "sequential reads (0 = disabled)",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -979,6 +986,7 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    int l2_readahead;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -991,6 +999,7 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
     const char *opt_overlap_check, *opt_overlap_check_template;
     int overlap_check_template = 0;
     uint64_t l2_cache_size, l2_cache_entry_size, refcount_cache_size;
+    uint64_t l2_readahead;
     int i;
     const char *encryptfmt;
     QDict *encryptopts = NULL;
@@ -1079,6 +1088,18 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    /*
+     * L2 readahead; slices read ahead must not push each other out of the
+     * cache before they are used, so only use up to half of it
+     */
+    l2_readahead = qemu_opt_get_number(opts, QCOW2_OPT_L2_READAHEAD, 0);
+    if (l2_readahead > INT_MAX) {
+        error_setg(errp, "L2 readahead too big");
+        ret = -EINVAL;
+        goto fail;
+    }
+    r->l2_readahead = MIN(l2_readahead, l2_cache_size / 2);
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1245,6 +1266,8 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
         cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
     }
 
+    s->l2_readahead = r->l2_readahead;
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -1961,6 +1984,7 @@ static int qcow2_open(BlockDriverState *bs, QDict *options, int flags,
 
     /* Initialise locks */
     qemu_co_mutex_init(&s->lock);
+    qemu_co_mutex_init(&s->readahead_lock);
 
     assert(!qemu_in_coroutine());
     assert(qemu_get_current_aio_context() == qemu_get_aio_context());
@@ -2383,6 +2407,112 @@ static int coroutine_fn GRAPH_RDLOCK qcow2_co_preadv_task_entry(AioTask *task)
                                 t->qiov, t->qiov_offset);
 }
 
+/*
+ * L2 readahead
+ *
+ * When a guest streams through a cold image, every read that crosses into an
+ * L2 slice that is not cached yet has to wait for the slice to be loaded
+ * before the data can be read.  Once reads look sequential, a background
+ * coroutine loads the L2 slices ahead of the guest into the L2 cache.  The
+ * readahead window starts with a single slice and doubles with every
+ * sequential request, up to s->l2_readahead slices.
+ */
+
+/* Number of sequential read requests before readahead starts */
+#define QCOW2_READAHEAD_TRIGGER 4
+
+static uint64_t l2_slice_coverage(BDRVQcow2State *s)
+{
+    return (uint64_t)s->l2_slice_size << s->cluster_bits;
+}
+
+static void coroutine_fn qcow2_readahead_co(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcow2State *s = bs->opaque;
+
+    GRAPH_RDLOCK_GUARD();
+
+    qemu_co_mutex_lock(&s->readahead_lock);
+    while (s->readahead_pos < s->readahead_end &&
+           !qatomic_read(&bs->quiesce_counter)) {
+        uint64_t offset = s->readahead_pos;
+        int ret;
+
+        s->readahead_pos += l2_slice_coverage(s);
+        qemu_co_mutex_unlock(&s->readahead_lock);
+
+        /* Takes s->lock only around cache lookups, not for the read */
+        ret = qcow2_l2_prefetch(bs, offset);
+
+        qemu_co_mutex_lock(&s->readahead_lock);
+        if (ret < 0) {
+            /* The guest request that needs this slice reports the error */
+            break;
+        }
+    }
+    s->readahead_running = false;
+    qemu_co_mutex_unlock(&s->readahead_lock);
+
+    /* Taken by qcow2_readahead_update() */
+    bdrv_dec_in_flight(bs);
+}
+
+/* Called with s->readahead_lock held for every read request */
+static void coroutine_fn
+qcow2_readahead_update(BlockDriverState *bs, uint64_t offset, uint64_t bytes)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t coverage = l2_slice_coverage(s);
+    uint64_t disk_size = bs->total_sectors * BDRV_SECTOR_SIZE;
+    uint64_t start, end;
+    unsigned window;
+
+    /*
+     * A guest with several requests in flight may submit a sequential
+     * stream slightly out of order, so accept anything close to the end of
+     * the previous request.
+     */
+    if (offset + coverage < s->readahead_next_offset ||
+        offset > s->readahead_next_offset + coverage) {
+        s->readahead_seq_count = 0;
+        s->readahead_next_offset = offset + bytes;
+        /* Stop a readahead that is still running for the old stream */
+        s->readahead_end = s->readahead_pos;
+        return;
+    }
+
+    s->readahead_next_offset = MAX(s->readahead_next_offset, offset + bytes);
+    if (s->readahead_seq_count < QCOW2_READAHEAD_TRIGGER + 16) {
+        s->readahead_seq_count++;
+    }
+    if (s->readahead_seq_count < QCOW2_READAHEAD_TRIGGER) {
+        return;
+    }
+
+    window = MIN(s->l2_readahead,
+                 1u << (s->readahead_seq_count - QCOW2_READAHEAD_TRIGGER));
+    start = ROUND_UP(s->readahead_next_offset, coverage);
+    end = MIN(start + window * coverage, disk_size);
+    if (start >= end) {
+        return;
+    }
+
+    if (s->readahead_pos < start || s->readahead_pos > end) {
+        s->readahead_pos = start;
+    }
+    s->readahead_end = end;
+
+    if (!s->readahead_running && s->readahead_pos < s->readahead_end) {
+        s->readahead_running = true;
+
+        /* Paired with bdrv_dec_in_flight() in qcow2_readahead_co() */
+        bdrv_inc_in_flight(bs);
+        aio_co_enter(qemu_get_current_aio_context(),
+                     qemu_coroutine_create(qcow2_readahead_co, bs));
+    }
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
                      QEMUIOVector *qiov, size_t qiov_offset,
@@ -2395,6 +2525,12 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
     QCow2SubclusterType type;
     AioTaskPool *aio = NULL;
 
+    if (s->l2_readahead) {
+        qemu_co_mutex_lock(&s->readahead_lock);
+        qcow2_readahead_update(bs, offset, bytes);
+        qemu_co_mutex_unlock(&s->readahead_lock);
+    }
+
     while (bytes != 0 && aio_task_pool_status(aio) == 0) {
         /* prepare next request */
         cur_bytes = MIN(bytes, INT_MAX);
@@ -150,6 +150,7 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_L2_READAHEAD "l2-readahead"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -348,6 +349,19 @@ typedef struct BDRVQcow2State {
     QEMUTimer *cache_clean_timer;
     unsigned cache_clean_interval;
 
+    /*
+     * L2 readahead for sequential reads.  Every read request updates this
+     * state, so it has its own lock rather than s->lock; readahead_lock is
+     * never held across I/O.
+     */
+    CoMutex readahead_lock;
+    int l2_readahead;               /* Maximum number of slices, 0 = off */
+    uint64_t readahead_next_offset; /* End of the last read request */
+    unsigned readahead_seq_count;   /* Number of sequential read requests */
+    uint64_t readahead_pos;         /* Next guest offset to load L2 for */
+    uint64_t readahead_end;         /* End of the readahead window */
+    bool readahead_running;         /* qcow2_readahead_co() is running */
+
     QLIST_HEAD(, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -932,6 +946,9 @@ qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
                       QCow2SubclusterType *subcluster_type);
 
+int coroutine_fn GRAPH_RDLOCK
+qcow2_l2_prefetch(BlockDriverState *bs, uint64_t offset);
+
 int coroutine_fn GRAPH_RDLOCK
 qcow2_alloc_host_offset(BlockDriverState *bs, uint64_t offset,
                         unsigned int *bytes, uint64_t *host_offset,
@@ -1021,6 +1038,7 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
+uint64_t qcow2_cache_generation(Qcow2Cache *c);
 
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
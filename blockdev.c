@@ -2655,6 +2655,15 @@ static BlockJob *do_backup_common(BackupCommon *backup,
         if (backup->x_perf->has_max_chunk) {
             perf.max_chunk = backup->x_perf->max_chunk;
         }
+        if (backup->x_perf->has_max_mem) {
+            perf.max_mem = backup->x_perf->max_mem;
+        }
+        if (backup->x_perf->has_buffer_size) {
+            perf.buffer_size = backup->x_perf->buffer_size;
+        }
+        if (backup->x_perf->has_adaptive) {
+            perf.adaptive = backup->x_perf->adaptive;
+        }
     }
 
     if ((backup->sync == MIRROR_SYNC_MODE_BITMAP) ||
@@ -2790,6 +2799,8 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
                                    bool has_unmap, bool unmap,
                                    const char *filter_node_name,
                                    bool has_copy_mode, MirrorCopyMode copy_mode,
+                                   bool has_max_in_flight,
+                                   int64_t max_in_flight,
                                    bool has_auto_finalize, bool auto_finalize,
                                    bool has_auto_dismiss, bool auto_dismiss,
                                    Error **errp)
@@ -2821,6 +2832,13 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
     if (!has_copy_mode) {
         copy_mode = MIRROR_COPY_MODE_BACKGROUND;
     }
+    if (!has_max_in_flight) {
+        max_in_flight = 0;
+    } else if (max_in_flight < 1 || max_in_flight > MIRROR_MAX_IN_FLIGHT) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "max-in-flight",
+                   "a value in range [1, " stringify(MIRROR_MAX_IN_FLIGHT) "]");
+        return;
+    }
     if (has_auto_finalize && !auto_finalize) {
         job_flags |= JOB_MANUAL_FINALIZE;
     }
@@ -2894,7 +2912,7 @@ static void blockdev_mirror_common(const char *job_id, BlockDriverState *bs,
                  replaces, job_flags,
                  speed, granularity, buf_size, sync, backing_mode, zero_target,
                  on_source_error, on_target_error, unmap, filter_node_name,
-                 copy_mode, errp);
+                 copy_mode, max_in_flight, errp);
 }
 
 void qmp_drive_mirror(DriveMirror *arg, Error **errp)
@@ -3045,6 +3063,7 @@ void qmp_drive_mirror(DriveMirror *arg, Error **errp)
                            arg->has_unmap, arg->unmap,
                            NULL,
                            arg->has_copy_mode, arg->copy_mode,
+                           arg->has_max_in_flight, arg->max_in_flight,
                            arg->has_auto_finalize, arg->auto_finalize,
                            arg->has_auto_dismiss, arg->auto_dismiss,
                            errp);
@@ -3064,6 +3083,7 @@ void qmp_blockdev_mirror(const char *job_id,
                          BlockdevOnError on_target_error,
                          const char *filter_node_name,
                          bool has_copy_mode, MirrorCopyMode copy_mode,
+                         bool has_max_in_flight, int64_t max_in_flight,
                          bool has_auto_finalize, bool auto_finalize,
                          bool has_auto_dismiss, bool auto_dismiss,
                          Error **errp)
@@ -3103,6 +3123,7 @@ void qmp_blockdev_mirror(const char *job_id,
                            has_on_target_error, on_target_error,
                            true, true, filter_node_name,
                            has_copy_mode, copy_mode,
+                           has_max_in_flight, max_in_flight,
                            has_auto_finalize, auto_finalize,
                            has_auto_dismiss, auto_dismiss,
                            errp);
@@ -756,6 +756,20 @@ SRST
     Dump all the ramblocks of the system.
 ERST
 
+    {
+        .name       = "bounce-buffers",
+        .args_type  = "",
+        .params     = "",
+        .help       = "Display DMA bounce buffer statistics",
+        .cmd_info_hrt = qmp_x_query_bounce_buffers,
+    },
+
+SRST
+  ``info bounce-buffers``
+    Show how many DMA mappings went through bounce buffers and how many
+    of those buffers were recycled.
+ERST
+
     {
         .name       = "hotpluggable-cpus",
         .args_type  = "",
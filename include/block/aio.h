@@ -17,6 +17,7 @@
 #ifdef CONFIG_LINUX_IO_URING
 #include <liburing.h>
 #endif
+#include "qapi/qapi-types-common.h"
 #include "qemu/coroutine-core.h"
 #include "qemu/queue.h"
 #include "qemu/event_notifier.h"
@@ -217,6 +218,9 @@ struct AioContext {
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+
+    /* IORING_SETUP_* flags for the block I/O ring (linux_io_uring) */
+    unsigned io_uring_setup_flags;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -712,6 +716,16 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
  */
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch);
 
+/**
+ * aio_context_set_io_uring_params:
+ * @ctx: the aio context
+ * @mode: how the io_uring block I/O ring is set up
+ *
+ * Fails if a block device already uses the io_uring AIO engine in @ctx.
+ */
+void aio_context_set_io_uring_params(AioContext *ctx, IOThreadIoUringMode mode,
+                                     Error **errp);
+
 /**
  * aio_context_set_thread_pool_params:
  * @ctx: the aio context
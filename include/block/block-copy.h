@@ -33,6 +33,8 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
 /* Function should be called prior any actual copy request */
 void block_copy_set_copy_opts(BlockCopyState *s, bool use_copy_range,
                               bool compress);
+bool block_copy_set_limits(BlockCopyState *s, int64_t max_mem,
+                           int64_t buffer_size, Error **errp);
 void block_copy_set_progress_meter(BlockCopyState *s, ProgressMeter *pm);
 
 void block_copy_state_free(BlockCopyState *s);
@@ -58,10 +60,15 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
  * must be > 0.
  *
  * @max_chunk means maximum length for one IO operation. Zero means unlimited.
+ *
+ * With @adaptive, the number of parallel coroutines and the length of IO
+ * operations start low and are adjusted to the throughput, within
+ * @max_workers and @max_chunk.
  */
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque);
 
@@ -124,6 +124,9 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
                               const char *filter_node_name,
                               BlockCompletionFunc *cb, void *opaque,
                               bool auto_complete, Error **errp);
+/* Upper bound of the mirror max-in-flight parameter */
+#define MIRROR_MAX_IN_FLIGHT 1024
+
 /*
  * mirror_start:
  * @job_id: The id of the newly-created job, or %NULL to use the
@@ -147,6 +150,8 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
  * driver that the mirror job inserts into the graph above @bs. NULL means that
  * a node name should be autogenerated.
  * @copy_mode: When to trigger writes to the target.
+ * @max_in_flight: Maximum number of requests in flight to the target,
+ * up to MIRROR_MAX_IN_FLIGHT, or 0 for the default.
  * @errp: Error object.
  *
  * Start a mirroring operation on @bs.  Clusters that are allocated
@@ -163,7 +168,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp);
+                  MirrorCopyMode copy_mode, int64_t max_in_flight,
+                  Error **errp);
 
 /*
  * backup_job_create:
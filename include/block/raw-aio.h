@@ -66,14 +66,27 @@ void laio_attach_aio_context(LinuxAioState *s, AioContext *new_context);
 #endif
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(unsigned int setup_flags, Error **errp);
 void luring_cleanup(LuringState *s);
+void luring_get_stats(LuringState *s, uint64_t *requests,
+                      uint64_t *total_latency_ns, uint64_t *max_latency_ns);
 
 /* luring_co_submit: submit I/O requests in the thread's current AioContext. */
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
+
+/*
+ * Guest RAM and image fds that io_uring should use as fixed buffers and
+ * fixed files.  Registration is only a hint that rings pick up later;
+ * luring_unregister_fd() removes the fd from all rings before returning
+ * and must be called from the main loop thread.
+ */
+void luring_register_buf(void *host, size_t size);
+void luring_unregister_buf(void *host, size_t size);
+void luring_register_fd(int fd);
+void luring_unregister_fd(int fd);
 #endif
 
 #ifdef _WIN32
@@ -2959,6 +2959,14 @@ void address_space_register_map_client(AddressSpace *as, QEMUBH *bh);
  */
 void address_space_unregister_map_client(AddressSpace *as, QEMUBH *bh);
 
+/*
+ * bounce_buffer_format: Describe address_space_map() bounce buffer usage
+ *
+ * Returns a human-readable summary of the bounce buffer statistics,
+ * for x-query-bounce-buffers.
+ */
+GString *bounce_buffer_format(void);
+
 /* Internal functions, part of the implementation of address_space_read.  */
 MemTxResult address_space_read_full(AddressSpace *as, hwaddr addr,
                                     MemTxAttrs attrs, void *buf, hwaddr len);
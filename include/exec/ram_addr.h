@@ -77,6 +77,25 @@ static inline bool clear_bmap_test_and_clear(RAMBlock *rb, uint64_t page)
     return bitmap_test_and_clear(rb->clear_bmap, page >> shift, 1);
 }
 
+/**
+ * ramblock_bmap_summary_set: mark a page range of the migration dirty
+ * bitmap as possibly dirty in its summary.  Must be with bitmap_mutex
+ * held.
+ *
+ * @rb: the ramblock to operate on
+ * @start: the start page number
+ * @npages: number of pages in the range
+ *
+ * Returns: None
+ */
+static inline void ramblock_bmap_summary_set(RAMBlock *rb, uint64_t start,
+                                             uint64_t npages)
+{
+    if (rb->bmap_summary) {
+        bitmap_summary_set(rb->bmap_summary, start, npages);
+    }
+}
+
 static inline bool offset_in_ramblock(RAMBlock *b, ram_addr_t offset)
 {
     return (b && b->host && offset < b->used_length) ? true : false;
@@ -266,6 +285,29 @@ static inline uint8_t cpu_physical_memory_range_includes_clean(ram_addr_t start,
     return ret;
 }
 
+/*
+ * Dirty rings: while migration has them enabled, every range that
+ * becomes dirty in DIRTY_MEMORY_MIGRATION is also logged to a ring, so
+ * that migration can sync its bitmap by looking at the logged pages
+ * only instead of scanning the whole dirty bitmap.  vCPUs that have a
+ * ring (TCG with dirty-ring-size set) log to their own lockless ring,
+ * anything else logs to a shared one.  If a ring fills up, the next
+ * harvest reports that a full bitmap scan is needed.
+ */
+extern bool dirty_ring_enabled;
+
+typedef void DirtyRingHarvestFunc(RAMBlock *rb, ram_addr_t offset,
+                                  void *opaque);
+
+DirtyRing *cpu_physical_memory_dirty_ring_new(uint32_t size);
+void cpu_physical_memory_dirty_ring_free(DirtyRing *ring);
+bool cpu_physical_memory_dirty_ring_start(void);
+void cpu_physical_memory_dirty_ring_stop(void);
+void cpu_physical_memory_dirty_ring_push(ram_addr_t start, ram_addr_t length);
+void cpu_physical_memory_dirty_ring_overflow(void);
+bool cpu_physical_memory_dirty_ring_harvest(DirtyRingHarvestFunc *fn,
+                                            void *opaque);
+
 static inline void cpu_physical_memory_set_dirty_flag(ram_addr_t addr,
                                                       unsigned client)
 {
@@ -282,6 +324,20 @@ static inline void cpu_physical_memory_set_dirty_flag(ram_addr_t addr,
 
     blocks = qatomic_rcu_read(&ram_list.dirty_memory[client]);
 
+    /*
+     * Only the caller that sets the bit logs the page; if it was already
+     * set, the ring entry for it is still pending or the harvester has
+     * yet to clear it.
+     */
+    if (unlikely(qatomic_read(&dirty_ring_enabled)) &&
+        client == DIRTY_MEMORY_MIGRATION) {
+        if (!test_and_set_bit_atomic(offset, blocks->blocks[idx])) {
+            cpu_physical_memory_dirty_ring_push(addr & TARGET_PAGE_MASK,
+                                                TARGET_PAGE_SIZE);
+        }
+        return;
+    }
+
     set_bit_atomic(offset, blocks->blocks[idx]);
 }
 
@@ -292,12 +348,20 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
     DirtyMemoryBlocks *blocks[DIRTY_MEMORY_NUM];
     unsigned long end, page;
     unsigned long idx, offset, base;
+    bool use_ring, log_ring = false;
     int i;
 
     if (!mask && !xen_enabled()) {
         return;
     }
 
+    /*
+     * Only log ranges in which this caller set some bit, the ring entry
+     * for the others is still pending.  The bits must be set before the
+     * range is logged; see cpu_physical_memory_dirty_ring_harvest().
+     */
+    use_ring = unlikely(qatomic_read(&dirty_ring_enabled));
+
     end = TARGET_PAGE_ALIGN(start + length) >> TARGET_PAGE_BITS;
     page = start >> TARGET_PAGE_BITS;
 
@@ -313,8 +377,15 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
             unsigned long next = MIN(end, base + DIRTY_MEMORY_BLOCK_SIZE);
 
             if (likely(mask & (1 << DIRTY_MEMORY_MIGRATION))) {
-                bitmap_set_atomic(blocks[DIRTY_MEMORY_MIGRATION]->blocks[idx],
-                                  offset, next - page);
+                unsigned long *map =
+                    blocks[DIRTY_MEMORY_MIGRATION]->blocks[idx];
+
+                if (unlikely(use_ring)) {
+                    log_ring |= bitmap_test_and_set_atomic(map, offset,
+                                                           next - page);
+                } else {
+                    bitmap_set_atomic(map, offset, next - page);
+                }
             }
             if (unlikely(mask & (1 << DIRTY_MEMORY_VGA))) {
                 bitmap_set_atomic(blocks[DIRTY_MEMORY_VGA]->blocks[idx],
@@ -332,6 +403,10 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
         }
     }
 
+    if (log_ring) {
+        cpu_physical_memory_dirty_ring_push(start, length);
+    }
+
     xen_hvm_modified_memory(start, length);
 }
 
@@ -387,6 +462,9 @@ uint64_t cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
                         qatomic_or(
                                 &blocks[DIRTY_MEMORY_MIGRATION][idx][offset],
                                 temp);
+                        if (unlikely(qatomic_read(&dirty_ring_enabled))) {
+                            cpu_physical_memory_dirty_ring_overflow();
+                        }
                         if (unlikely(
                             global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
                             total_dirty_pages += nbits;
@@ -507,6 +585,9 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                 dest[k] |= bits;
                 new_dirty &= bits;
                 num_dirty += ctpopl(new_dirty);
+                if (rb->bmap_summary) {
+                    set_bit(k, rb->bmap_summary);
+                }
             }
 
             if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
@@ -542,6 +623,7 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                 if (!test_and_set_bit(k, dest)) {
                     num_dirty++;
                 }
+                ramblock_bmap_summary_set(rb, k, 1);
             }
         }
     }
@@ -45,6 +45,16 @@ struct RAMBlock {
     size_t page_size;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
+    /*
+     * Second level of @bmap on the migration source, one bit per word
+     * of @bmap.  A clear bit guarantees that the word has no dirty page
+     * in it, so that searching for dirty pages can skip clean regions
+     * without reading them.  A set bit may be stale: it is cleared
+     * lazily when the search finds the word clean.  Anything setting
+     * bits in @bmap must also set them here.  Like @bmap, it is
+     * protected by the global ram_state.bitmap_mutex.
+     */
+    unsigned long *bmap_summary;
 
     /*
      * Below fields are only used by mapped-ram migration
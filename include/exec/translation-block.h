@@ -89,6 +89,17 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Superblock formation, see tcg_superblock_threshold.  A TB that
+     * ends with a jump the translator could follow starts with
+     * @exec_count set to the threshold, and counts down each time it is
+     * entered from the execution loop.  Until it reaches zero, nothing
+     * is chained to it, so that every execution is counted.  At zero,
+     * the TB is retranslated as a superblock, marked with TB_TRACE.
+     */
+    uint32_t exec_count;
+#define TB_TRACE UINT32_MAX
+
     struct tb_tc tc;
 
     /*
@@ -76,6 +76,13 @@ typedef enum DisasJumpType {
  * @fake_insn: True if translator_fake_ldb used.
  * @insn_start: The last op emitted by the insn_start hook,
  *              which is expected to be INDEX_op_insn_start.
+ * @trace: Translating a superblock, see translator_follow_jump().
+ * @trace_candidate: Set by translator_follow_jump() for a jump that
+ *                   could have been followed in a superblock.
+ * @pc_end: Furthest end of the guest code translated before a followed
+ *          jump.
+ * @jmp_dest: Targets accepted by translator_use_goto_tb().
+ * @nb_jmp_dest: Number of valid entries in @jmp_dest.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -89,8 +96,13 @@ struct DisasContextBase {
     bool singlestep_enabled;
     bool plugin_enabled;
     bool fake_insn;
+    bool trace;
+    bool trace_candidate;
     struct TCGOp *insn_start;
     void *host_addr[2];
+    vaddr pc_end;
+    vaddr jmp_dest[2];
+    int nb_jmp_dest;
 
     /*
      * Record insn data that we cannot read directly from host memory.
@@ -174,6 +186,21 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_follow_jump
+ * @db: Disassembly context
+ * @dest: target pc of a direct jump
+ *
+ * When translating a superblock, return true and continue translation
+ * at @dest instead of ending the TB.  The caller must not emit the
+ * jump, only the exits for the paths that do not go to @dest.
+ *
+ * Only jumps within the first page of the TB and not before its start
+ * are followed, so that the TB still covers a single range of guest
+ * code for invalidation.
+ */
+bool translator_follow_jump(DisasContextBase *db, vaddr dest);
+
 /**
  * translator_io_start
  * @db: Disassembly context
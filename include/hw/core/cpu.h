@@ -200,6 +200,17 @@ struct CPUClass {
 /* Use a fully associative victim tlb of 8 entries. */
 #define CPU_VTLB_SIZE 8
 
+/*
+ * Entries evicted from the victim tlb go to a second-level tlb of
+ * 256 sets of 4 entries, allocated once the victim tlb overflows.
+ */
+#define CPU_L2TLB_SET_BITS 8
+#define CPU_L2TLB_WAYS 4
+#define CPU_L2TLB_SIZE (CPU_L2TLB_WAYS << CPU_L2TLB_SET_BITS)
+
+/* Remember the last 8 large pages filled, per mmu_idx. */
+#define CPU_LARGE_TLB_SIZE 8
+
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
  * so the layout is not as critical as that of CPUTLBEntry. This is
@@ -287,6 +298,20 @@ typedef struct CPUTLBDesc {
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
     CPUTLBEntryFull *fulltlb;
+    /* The second-level tlb, in two parts; NULL until needed.  */
+    CPUTLBEntry *l2table;
+    CPUTLBEntryFull *l2fulltlb;
+    size_t l2_used_entries;
+    /* The next way to replace in a full set of the second-level tlb.  */
+    size_t l2_way;
+    /*
+     * Large pages recently filled, from which main tlb entries for the
+     * other pages they cover are made without calling tlb_fill.  The
+     * base address of unused entries is -1.
+     */
+    size_t large_index;
+    vaddr large_vaddr[CPU_LARGE_TLB_SIZE];
+    CPUTLBEntryFull large_full[CPU_LARGE_TLB_SIZE];
 } CPUTLBDesc;
 
 /*
@@ -309,6 +334,11 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Misses in the victim tlb, by outcome in the second-level tlb. */
+    size_t l2_hit_count;
+    size_t l2_miss_count;
+    /* Misses in both, refilled from a large page instead of tlb_fill. */
+    size_t large_hit_count;
 } CPUTLBCommon;
 
 /*
@@ -443,6 +473,9 @@ struct qemu_work_item;
  * @ignore_memory_transaction_failures: Cached copy of the MachineState
  *    flag of the same name: allows the board to suppress calling of the
  *    CPU do_transaction_failed hook function.
+ * @dirty_ring: Ring of pages dirtied by this CPU during migration, see
+ *    cpu_physical_memory_dirty_ring_push().  Only allocated by TCG when
+ *    the accelerator's dirty-ring-size property is set.
  * @kvm_dirty_gfns: Points to the KVM dirty ring for this CPU when KVM dirty
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
@@ -506,6 +539,7 @@ struct CPUState {
     MemoryRegion *memory;
 
     struct CPUJumpCache *tb_jmp_cache;
+    DirtyRing *dirty_ring;
 
     GArray *gdb_regs;
     int gdb_num_regs;
@@ -24,6 +24,7 @@ struct SCSIRequest {
     SCSIBus           *bus;
     SCSIDevice        *dev;
     const SCSIReqOps  *ops;
+    AioContext        *ctx; /* where the request is processed */
     uint32_t          refcount;
     uint32_t          tag;
     uint32_t          lun;
@@ -77,9 +78,11 @@ struct SCSIDevice
     uint32_t sense_len;
 
     /*
-     * The requests list is only accessed from the AioContext that executes
-     * requests or from the main loop when IOThread processing is stopped.
+     * Requests can be processed in several AioContexts, for example when an
+     * HBA maps its queues to different IOThreads, so the list is protected by
+     * requests_lock.
      */
+    QemuMutex requests_lock;
     QTAILQ_HEAD(, SCSIRequest) requests;
 
     uint32_t channel;
@@ -35,6 +35,7 @@ OBJECT_DECLARE_TYPE(QIOChannel, QIOChannelClass,
 #define QIO_CHANNEL_WRITE_FLAG_ZERO_COPY 0x1
 
 #define QIO_CHANNEL_READ_FLAG_MSG_PEEK 0x1
+#define QIO_CHANNEL_READ_FLAG_WAITALL 0x2
 
 typedef enum QIOChannelFeature QIOChannelFeature;
 
@@ -45,6 +46,7 @@ enum QIOChannelFeature {
     QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY,
     QIO_CHANNEL_FEATURE_READ_MSG_PEEK,
     QIO_CHANNEL_FEATURE_SEEKABLE,
+    QIO_CHANNEL_FEATURE_READ_WAITALL,
 };
 
 
@@ -224,6 +226,13 @@ void qio_channel_set_name(QIOChannel *ioc,
  * guaranteed. If the channel is non-blocking and no
  * data is available, it will return QIO_CHANNEL_ERR_BLOCK
  *
+ * If @flags contains QIO_CHANNEL_READ_FLAG_WAITALL and the
+ * channel is in blocking mode, the read only returns early
+ * on end-of-file, error or signal, so that filling @iov
+ * takes a single call in the common case. It is an error
+ * to pass this flag unless qio_channel_has_feature()
+ * returns a true value for QIO_CHANNEL_FEATURE_READ_WAITALL.
+ *
  * If the channel has passed any file descriptors,
  * the @fds array pointer will be allocated and
  * the elements filled with the received file
@@ -885,6 +894,7 @@ void qio_channel_set_aio_fd_handler(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to read
  * @nfds: number of file handles in @fds
+ * @flags: read flags (QIO_CHANNEL_READ_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  *
@@ -903,6 +913,7 @@ int coroutine_mixed_fn qio_channel_readv_full_all_eof(QIOChannel *ioc,
                                                       const struct iovec *iov,
                                                       size_t niov,
                                                       int **fds, size_t *nfds,
+                                                      int flags,
                                                       Error **errp);
 
 /**
@@ -912,6 +923,7 @@ int coroutine_mixed_fn qio_channel_readv_full_all_eof(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to read
  * @nfds: number of file handles in @fds
+ * @flags: read flags (QIO_CHANNEL_READ_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  *
@@ -929,6 +941,7 @@ int coroutine_mixed_fn qio_channel_readv_full_all(QIOChannel *ioc,
                                                   const struct iovec *iov,
                                                   size_t niov,
                                                   int **fds, size_t *nfds,
+                                                  int flags,
                                                   Error **errp);
 
 /**
@@ -36,6 +36,7 @@
  * bitmap_full(src, nbits)                      Are all bits set in *src?
  * bitmap_set(dst, pos, nbits)                  Set specified bit area
  * bitmap_set_atomic(dst, pos, nbits)           Set specified bit area with atomic ops
+ * bitmap_test_and_set_atomic(dst, pos, nbits)  Set area, were any bits clear?
  * bitmap_clear(dst, pos, nbits)                Clear specified bit area
  * bitmap_test_and_clear_atomic(dst, pos, nbits)    Test and clear area
  * bitmap_find_next_zero_area(buf, len, pos, n, mask)  Find bit free area
@@ -45,6 +46,9 @@
  *                                    *dst = *src (with an offset into src)
  * bitmap_copy_with_dst_offset(dst, src, offset, nbits)
  *                                    *dst = *src (with an offset into dst)
+ * bitmap_summary_set(summary, pos, nbits)  Mark area as dirty in summary
+ * bitmap_summary_find_next(buf, summary, len, pos)
+ *                                    find_next_bit() skipping clean words
  */
 
 /*
@@ -248,6 +252,7 @@ static inline long bitmap_count_one_with_offset(const unsigned long *bitmap,
 
 void bitmap_set(unsigned long *map, long i, long len);
 void bitmap_set_atomic(unsigned long *map, long i, long len);
+bool bitmap_test_and_set_atomic(unsigned long *map, long start, long nr);
 void bitmap_clear(unsigned long *map, long start, long nr);
 bool bitmap_test_and_clear_atomic(unsigned long *map, long start, long nr);
 bool bitmap_test_and_clear(unsigned long *map, long start, long nr);
@@ -278,4 +283,10 @@ void bitmap_copy_with_src_offset(unsigned long *dst, const unsigned long *src,
 void bitmap_copy_with_dst_offset(unsigned long *dst, const unsigned long *src,
                                  unsigned long shift, unsigned long nbits);
 
+void bitmap_summary_set(unsigned long *summary, long start, long nr);
+unsigned long bitmap_summary_find_next(unsigned long *map,
+                                       unsigned long *summary,
+                                       unsigned long size,
+                                       unsigned long offset);
+
 #endif /* BITMAP_H */
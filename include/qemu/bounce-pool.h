@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Per-thread pool of DMA bounce buffers
+ */
+
+#ifndef QEMU_BOUNCE_POOL_H
+#define QEMU_BOUNCE_POOL_H
+
+#include "qemu/queue.h"
+#include "qemu/units.h"
+
+/* Pooled sizes are powers of two from 4 KiB to 1 MiB */
+#define BOUNCE_POOL_MIN_SHIFT   12
+#define BOUNCE_POOL_MAX_SHIFT   20
+#define BOUNCE_POOL_CLASSES \
+    (BOUNCE_POOL_MAX_SHIFT - BOUNCE_POOL_MIN_SHIFT + 1)
+
+/* Most bytes of buffers that each thread keeps */
+#define BOUNCE_POOL_MAX_CACHED  (8 * MiB)
+
+/*
+ * Must be the first member of a pooled buffer, which is allocated with
+ * g_malloc() and freed with g_free().
+ */
+typedef struct BouncePoolEntry {
+    QSLIST_ENTRY(BouncePoolEntry) next;
+    int size_class;     /* -1 if too large for the pool */
+} BouncePoolEntry;
+
+/* See documentation in util/bounce-pool.c */
+int bounce_pool_size_class(size_t len);
+size_t bounce_pool_class_size(int size_class);
+BouncePoolEntry *bounce_pool_get(int size_class);
+bool bounce_pool_put(BouncePoolEntry *entry);
+
+#endif /* QEMU_BOUNCE_POOL_H */
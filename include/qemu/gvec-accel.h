@@ -0,0 +1,52 @@
+/*
+ * Host vector acceleration for the TCG generic vector runtime
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_GVEC_ACCEL_H
+#define QEMU_GVEC_ACCEL_H
+
+/*
+ * Element-wise operations on @oprsz bytes, a multiple of the element
+ * size.  @d may overlap @a or @b exactly; no alignment is required.
+ */
+typedef void GVecAccel3Fn(void *d, const void *a, const void *b,
+                          intptr_t oprsz);
+/* As above, with every element of @a shifted by @shift. */
+typedef void GVecAccelShiftFn(void *d, const void *a, unsigned shift,
+                              intptr_t oprsz);
+
+/*
+ * One implementation of each operation, for the best host vector
+ * extension that provides it.  Every array is indexed by the log2 of
+ * the element size in bytes, i.e. MO_8 to MO_64.  Comparisons produce
+ * all ones for true and zero for false, as the gvec helpers do.
+ */
+typedef struct GVecAccel {
+    const char *name;
+    GVecAccel3Fn *ssadd[4];
+    GVecAccel3Fn *sssub[4];
+    GVecAccel3Fn *usadd[4];
+    GVecAccel3Fn *ussub[4];
+    GVecAccel3Fn *eq[4];
+    GVecAccel3Fn *ne[4];
+    GVecAccel3Fn *lt[4];
+    GVecAccel3Fn *le[4];
+    GVecAccel3Fn *ltu[4];
+    GVecAccel3Fn *leu[4];
+    GVecAccelShiftFn *shli[4];
+    GVecAccelShiftFn *shri[4];
+    GVecAccelShiftFn *sari[4];
+} GVecAccel;
+
+/* Selected at startup from the host cpuinfo. */
+extern const GVecAccel *gvec_accel;
+
+/*
+ * For testing and benchmarking: switch gvec_accel to the next less
+ * capable implementation, returning false when none is left.
+ */
+bool test_gvec_next_accel(void);
+
+#endif /* QEMU_GVEC_ACCEL_H */
@@ -38,6 +38,9 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* io_uring setup, fixed once the AioContext exists */
+    int io_uring_mode; /* IOThreadIoUringMode */
 };
 typedef struct IOThread IOThread;
 
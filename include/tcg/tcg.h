@@ -134,7 +134,8 @@ typedef uint64_t TCGRegSet;
 
 #if !defined(TCG_TARGET_HAS_v64) \
     && !defined(TCG_TARGET_HAS_v128) \
-    && !defined(TCG_TARGET_HAS_v256)
+    && !defined(TCG_TARGET_HAS_v256) \
+    && !defined(TCG_TARGET_HAS_v512)
 #define TCG_TARGET_MAYBE_vec            0
 #define TCG_TARGET_HAS_abs_vec          0
 #define TCG_TARGET_HAS_neg_vec          0
@@ -168,6 +169,9 @@ typedef uint64_t TCGRegSet;
 #ifndef TCG_TARGET_HAS_v256
 #define TCG_TARGET_HAS_v256             0
 #endif
+#ifndef TCG_TARGET_HAS_v512
+#define TCG_TARGET_HAS_v512             0
+#endif
 
 typedef enum TCGOpcode {
 #define DEF(name, oargs, iargs, cargs, flags) INDEX_op_ ## name,
@@ -246,9 +250,10 @@ typedef enum TCGType {
     TCG_TYPE_V64,
     TCG_TYPE_V128,
     TCG_TYPE_V256,
+    TCG_TYPE_V512,
 
     /* Number of different types (integer not enum) */
-#define TCG_TYPE_COUNT  (TCG_TYPE_V256 + 1)
+#define TCG_TYPE_COUNT  (TCG_TYPE_V512 + 1)
 
     /* An alias for the size of the host register.  */
 #if TCG_TARGET_REG_BITS == 32
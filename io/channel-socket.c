@@ -176,6 +176,8 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
 
     qio_channel_set_feature(QIO_CHANNEL(ioc),
                             QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
+    qio_channel_set_feature(QIO_CHANNEL(ioc),
+                            QIO_CHANNEL_FEATURE_READ_WAITALL);
 
     return 0;
 }
@@ -412,6 +414,8 @@ qio_channel_socket_accept(QIOChannelSocket *ioc,
 
     qio_channel_set_feature(QIO_CHANNEL(cioc),
                             QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
+    qio_channel_set_feature(QIO_CHANNEL(cioc),
+                            QIO_CHANNEL_FEATURE_READ_WAITALL);
 
     trace_qio_channel_socket_accept_complete(ioc, cioc, cioc->fd);
     return cioc;
@@ -529,6 +533,10 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
         sflags |= MSG_PEEK;
     }
 
+    if (flags & QIO_CHANNEL_READ_FLAG_WAITALL) {
+        sflags |= MSG_WAITALL;
+    }
+
  retry:
     ret = recvmsg(sioc->fd, &msg, sflags);
     if (ret < 0) {
@@ -648,6 +656,10 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
         sflags |= MSG_PEEK;
     }
 
+    if (flags & QIO_CHANNEL_READ_FLAG_WAITALL) {
+        sflags |= MSG_WAITALL;
+    }
+
     for (i = 0; i < niov; i++) {
         ssize_t ret;
     retry:
@@ -72,6 +72,13 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
         return -1;
     }
 
+    if ((flags & QIO_CHANNEL_READ_FLAG_WAITALL) &&
+        !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_READ_WAITALL)) {
+        error_setg_errno(errp, EINVAL,
+                         "Channel does not support waitall read");
+        return -1;
+    }
+
     return klass->io_readv(ioc, iov, niov, fds, nfds, flags, errp);
 }
 
@@ -115,7 +122,7 @@ int coroutine_mixed_fn qio_channel_readv_all_eof(QIOChannel *ioc,
                                                  size_t niov,
                                                  Error **errp)
 {
-    return qio_channel_readv_full_all_eof(ioc, iov, niov, NULL, NULL, errp);
+    return qio_channel_readv_full_all_eof(ioc, iov, niov, NULL, NULL, 0, errp);
 }
 
 int coroutine_mixed_fn qio_channel_readv_all(QIOChannel *ioc,
@@ -123,13 +130,14 @@ int coroutine_mixed_fn qio_channel_readv_all(QIOChannel *ioc,
                                              size_t niov,
                                              Error **errp)
 {
-    return qio_channel_readv_full_all(ioc, iov, niov, NULL, NULL, errp);
+    return qio_channel_readv_full_all(ioc, iov, niov, NULL, NULL, 0, errp);
 }
 
 int coroutine_mixed_fn qio_channel_readv_full_all_eof(QIOChannel *ioc,
                                                       const struct iovec *iov,
                                                       size_t niov,
                                                       int **fds, size_t *nfds,
+                                                      int flags,
                                                       Error **errp)
 {
     int ret = -1;
@@ -155,7 +163,7 @@ int coroutine_mixed_fn qio_channel_readv_full_all_eof(QIOChannel *ioc,
     while ((nlocal_iov > 0) || local_fds) {
         ssize_t len;
         len = qio_channel_readv_full(ioc, local_iov, nlocal_iov, local_fds,
-                                     local_nfds, 0, errp);
+                                     local_nfds, flags, errp);
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             if (qemu_in_coroutine()) {
                 qio_channel_yield(ioc, G_IO_IN);
@@ -220,9 +228,11 @@ int coroutine_mixed_fn qio_channel_readv_full_all(QIOChannel *ioc,
                                                   const struct iovec *iov,
                                                   size_t niov,
                                                   int **fds, size_t *nfds,
+                                                  int flags,
                                                   Error **errp)
 {
-    int ret = qio_channel_readv_full_all_eof(ioc, iov, niov, fds, nfds, errp);
+    int ret = qio_channel_readv_full_all_eof(ioc, iov, niov, fds, nfds,
+                                             flags, errp);
 
     if (ret == 0) {
         error_setg(errp, "Unexpected end-of-file before all data were read");
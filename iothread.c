@@ -24,6 +24,7 @@
 #include "qemu/error-report.h"
 #include "qemu/rcu.h"
 #include "qemu/main-loop.h"
+#include "block/raw-aio.h"
 
 
 #ifdef CONFIG_POSIX
@@ -190,6 +191,15 @@ static void iothread_init(EventLoopBase *base, Error **errp)
         return;
     }
 
+    aio_context_set_io_uring_params(iothread->ctx, iothread->io_uring_mode,
+                                    &local_error);
+    if (local_error) {
+        error_propagate(errp, local_error);
+        aio_context_unref(iothread->ctx);
+        iothread->ctx = NULL;
+        return;
+    }
+
     thread_name = g_strdup_printf("IO %s",
                         object_get_canonical_path_component(OBJECT(base)));
 
@@ -292,6 +302,26 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
     }
 }
 
+static int iothread_get_io_uring_mode(Object *obj, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    return iothread->io_uring_mode;
+}
+
+static void iothread_set_io_uring_mode(Object *obj, int value, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        error_setg(errp, "io-uring-mode cannot be changed after the iothread "
+                   "has been created");
+        return;
+    }
+
+    iothread->io_uring_mode = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     EventLoopBaseClass *bc = EVENT_LOOP_BASE_CLASS(klass);
@@ -311,6 +341,11 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add_enum(klass, "io-uring-mode",
+                                   "IOThreadIoUringMode",
+                                   &IOThreadIoUringMode_lookup,
+                                   iothread_get_io_uring_mode,
+                                   iothread_set_io_uring_mode);
 }
 
 static const TypeInfo iothread_info = {
@@ -357,6 +392,20 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->parent_obj.aio_max_batch;
+    info->io_uring_mode = iothread->io_uring_mode;
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (iothread->ctx) {
+        LuringState *s = qatomic_read(&iothread->ctx->linux_io_uring);
+
+        if (s) {
+            info->io_uring_stats = g_new0(IOThreadIoUringStats, 1);
+            luring_get_stats(s, &info->io_uring_stats->requests,
+                             &info->io_uring_stats->total_latency_ns,
+                             &info->io_uring_stats->max_latency_ns);
+        }
+    }
+#endif
 
     QAPI_LIST_APPEND(*tail, info);
     return 0;
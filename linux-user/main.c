@@ -71,6 +71,8 @@ char *exec_path;
 char real_exec_path[PATH_MAX];
 
 static bool opt_one_insn_per_tb;
+static bool opt_tb_prefetch;
+static const char *opt_superblock_threshold;
 static const char *argv0;
 static const char *gdbstub;
 static envlist_t *envlist;
@@ -417,6 +419,16 @@ static void handle_arg_one_insn_per_tb(const char *arg)
     opt_one_insn_per_tb = true;
 }
 
+static void handle_arg_tb_prefetch(const char *arg)
+{
+    opt_tb_prefetch = true;
+}
+
+static void handle_arg_superblock_threshold(const char *arg)
+{
+    opt_superblock_threshold = arg;
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -506,6 +518,11 @@ static const struct qemu_argument arg_table[] = {
     {"one-insn-per-tb",
                    "QEMU_ONE_INSN_PER_TB",  false, handle_arg_one_insn_per_tb,
      "",           "run with one guest instruction per emulated TB"},
+    {"tb-prefetch", "QEMU_TB_PREFETCH", false, handle_arg_tb_prefetch,
+     "",           "translate jump targets ahead in a background thread"},
+    {"superblock-threshold", "QEMU_SUPERBLOCK_THRESHOLD", true,
+     handle_arg_superblock_threshold,
+     "count",      "form superblocks from blocks run 'count' times"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
@@ -797,6 +814,12 @@ int main(int argc, char **argv, char **envp)
         accel_init_interfaces(ac);
         object_property_set_bool(OBJECT(accel), "one-insn-per-tb",
                                  opt_one_insn_per_tb, &error_abort);
+        object_property_set_bool(OBJECT(accel), "tb-prefetch",
+                                 opt_tb_prefetch, &error_abort);
+        if (opt_superblock_threshold) {
+            object_property_parse(OBJECT(accel), "superblock-threshold",
+                                  opt_superblock_threshold, &error_fatal);
+        }
         ac->init_machine(NULL);
     }
 
@@ -82,6 +82,11 @@ void migration_channel_connect(MigrationState *s,
         } else {
             QEMUFile *f = qemu_file_new_output(ioc);
 
+            qemu_file_set_buffer_size(f, s->qemu_file_buffer_size,
+                                      s->qemu_file_iov_max);
+            if (s->qemu_file_zero_copy) {
+                qemu_file_set_zero_copy(f, true, &error);
+            }
             migration_ioc_register_yank(ioc);
 
             qemu_mutex_lock(&s->qemu_file_lock);
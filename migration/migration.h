@@ -442,6 +442,16 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Staging buffer size and maximum number of iovecs of the main
+     * outgoing channel; zero means the QEMUFile default.  Larger values
+     * mean fewer flushes of device state and non-multifd RAM.
+     */
+    uint64_t qemu_file_buffer_size;
+    uint32_t qemu_file_iov_max;
+    /* Send large flushes of the main outgoing channel with MSG_ZEROCOPY */
+    bool qemu_file_zero_copy;
+
     /*
      * This save hostname when out-going migration starts
      */
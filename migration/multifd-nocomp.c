@@ -176,7 +176,8 @@ static int multifd_nocomp_recv(MultiFDRecvParams *p, Error **errp)
         p->iov[i].iov_len = multifd_ram_page_size();
         ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
     }
-    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+    return qio_channel_readv_full_all(p->c, p->iov, p->normal_num, NULL, NULL,
+                                      p->read_flags, errp);
 }
 
 static void multifd_pages_reset(MultiFDPages_t *pages)
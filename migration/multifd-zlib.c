@@ -99,6 +99,11 @@ static int multifd_zlib_send_prepare(MultiFDSendParams *p, Error **errp)
     z_stream *zs = &z->zs;
     uint32_t out_size = 0;
     uint32_t page_size = multifd_ram_page_size();
+    /*
+     * Packets prepared by compression workers can be sent on any
+     * channel, so each of them has to be a complete zlib stream.
+     */
+    int last_flush = multifd_send_use_workers() ? Z_FINISH : Z_SYNC_FLUSH;
     int ret;
     uint32_t i;
 
@@ -111,7 +116,7 @@ static int multifd_zlib_send_prepare(MultiFDSendParams *p, Error **errp)
         int flush = Z_NO_FLUSH;
 
         if (i == pages->normal_num - 1) {
-            flush = Z_SYNC_FLUSH;
+            flush = last_flush;
         }
 
         /*
@@ -136,12 +141,16 @@ static int multifd_zlib_send_prepare(MultiFDSendParams *p, Error **errp)
          */
         do {
             ret = deflate(zs, flush);
-        } while (ret == Z_OK && zs->avail_in && zs->avail_out);
-        if (ret == Z_OK && zs->avail_in) {
+        } while (ret == Z_OK && (zs->avail_in || flush == Z_FINISH)
+                             && zs->avail_out);
+        if (ret == Z_OK && (zs->avail_in || flush == Z_FINISH)) {
             error_setg(errp, "multifd %u: deflate failed to compress all input",
                        p->id);
             return -1;
         }
+        if (ret == Z_STREAM_END && flush == Z_FINISH) {
+            ret = deflateReset(zs);
+        }
         if (ret != Z_OK) {
             error_setg(errp, "multifd %u: deflate returned %d instead of Z_OK",
                        p->id, ret);
@@ -207,6 +216,7 @@ static int multifd_zlib_recv(MultiFDRecvParams *p, Error **errp)
     uint32_t page_size = multifd_ram_page_size();
     uint32_t expected_size = p->normal_num * page_size;
     uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    bool stream_end = false;
     int ret;
     int i;
 
@@ -261,6 +271,11 @@ static int multifd_zlib_recv(MultiFDRecvParams *p, Error **errp)
                        p->id);
             return -1;
         }
+        /* Packets from compression workers end their own stream */
+        if (ret == Z_STREAM_END && i == p->normal_num - 1) {
+            stream_end = true;
+            ret = Z_OK;
+        }
         if (ret != Z_OK) {
             error_setg(errp, "multifd %u: inflate returned %d instead of Z_OK",
                        p->id, ret);
@@ -274,6 +289,10 @@ static int multifd_zlib_recv(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    if (stream_end) {
+        inflateReset(zs);
+    }
+
     return 0;
 }
 
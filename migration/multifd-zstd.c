@@ -92,6 +92,12 @@ static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
     struct zstd_data *z = p->compress_data;
+    /*
+     * Packets prepared by compression workers can be sent on any
+     * channel, so each of them has to be a complete frame.
+     */
+    ZSTD_EndDirective last_flush =
+        multifd_send_use_workers() ? ZSTD_e_end : ZSTD_e_flush;
     int ret;
     uint32_t i;
 
@@ -107,7 +113,7 @@ static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
         ZSTD_EndDirective flush = ZSTD_e_continue;
 
         if (i == pages->normal_num - 1) {
-            flush = ZSTD_e_flush;
+            flush = last_flush;
         }
         z->in.src = pages->block->host + pages->offset[i];
         z->in.size = multifd_ram_page_size();
@@ -123,9 +129,9 @@ static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
          */
         do {
             ret = ZSTD_compressStream2(z->zcs, &z->out, &z->in, flush);
-        } while (ret > 0 && (z->in.size > z->in.pos)
+        } while (ret > 0 && (z->in.size > z->in.pos || flush == ZSTD_e_end)
                          && (z->out.size > z->out.pos));
-        if (ret > 0 && (z->in.size > z->in.pos)) {
+        if (ret > 0 && (z->in.size > z->in.pos || flush == ZSTD_e_end)) {
             error_setg(errp, "multifd %u: compressStream buffer too small",
                        p->id);
             return -1;
@@ -69,6 +69,15 @@ struct {
     QemuSemaphore channels_created;
     /* send channels ready */
     QemuSemaphore channels_ready;
+    /*
+     * Compression workers, only present when multifd-compression-threads
+     * is set.  They take over the send_prepare() step from the channels
+     * and write the resulting packets on whichever channel is free.
+     */
+    MultiFDSendParams *workers;
+    int worker_count;
+    /* compression workers ready */
+    QemuSemaphore workers_ready;
     /*
      * Have we already run terminate threads.  There is a race when it
      * happens that we got one error while we are exiting.
@@ -123,6 +132,16 @@ static bool multifd_use_packets(void)
     return !migrate_mapped_ram();
 }
 
+/*
+ * Whether the packets are prepared by compression workers.  This is
+ * fixed when the send side is set up, changing the parameter during the
+ * migration only takes effect for the next one.
+ */
+bool multifd_send_use_workers(void)
+{
+    return multifd_send_state->worker_count > 0;
+}
+
 void multifd_send_channel_created(void)
 {
     qemu_sem_post(&multifd_send_state->channels_created);
@@ -273,21 +292,23 @@ static bool multifd_recv_should_exit(void)
 }
 
 /*
- * The migration thread can wait on either of the two semaphores.  This
- * function can be used to kick the main thread out of waiting on either of
- * them.  Should mostly only be called when something wrong happened with
- * the current multifd send thread.
+ * The migration thread can wait on any of the semaphores below.  This
+ * function can be used to kick the main thread out of waiting on them.
+ * Should mostly only be called when something wrong happened with the
+ * current multifd send thread or compression worker.
  */
 static void multifd_send_kick_main(MultiFDSendParams *p)
 {
     qemu_sem_post(&p->sem_sync);
     qemu_sem_post(&multifd_send_state->channels_ready);
+    qemu_sem_post(&multifd_send_state->workers_ready);
 }
 
 /*
  * multifd_send() works by exchanging the MultiFDSendData object
  * provided by the caller with an unused MultiFDSendData object from
- * the next channel that is found to be idle.
+ * the next channel that is found to be idle.  When compression
+ * workers are in use, the data goes to the next idle worker instead.
  *
  * The channel owns the data until it finishes transmitting and the
  * caller owns the empty object until it fills it with data and calls
@@ -300,35 +321,47 @@ static void multifd_send_kick_main(MultiFDSendParams *p)
  */
 bool multifd_send(MultiFDSendData **send_data)
 {
-    int i;
+    int i, count;
     static int next_channel;
+    MultiFDSendParams *params;
     MultiFDSendParams *p = NULL; /* make happy gcc */
+    QemuSemaphore *ready;
     MultiFDSendData *tmp;
 
     if (multifd_send_should_exit()) {
         return false;
     }
 
+    if (multifd_send_state->worker_count) {
+        params = multifd_send_state->workers;
+        count = multifd_send_state->worker_count;
+        ready = &multifd_send_state->workers_ready;
+    } else {
+        params = multifd_send_state->params;
+        count = migrate_multifd_channels();
+        ready = &multifd_send_state->channels_ready;
+    }
+
     /* We wait here, until at least one channel is ready */
-    qemu_sem_wait(&multifd_send_state->channels_ready);
+    qemu_sem_wait(ready);
 
     /*
      * next_channel can remain from a previous migration that was
      * using more channels, so ensure it doesn't overflow if the
      * limit is lower now.
      */
-    next_channel %= migrate_multifd_channels();
-    for (i = next_channel;; i = (i + 1) % migrate_multifd_channels()) {
+    next_channel %= count;
+    for (i = next_channel;; i = (i + 1) % count) {
         if (multifd_send_should_exit()) {
             return false;
         }
-        p = &multifd_send_state->params[i];
+        p = &params[i];
         /*
          * Lockless read to p->pending_job is safe, because only multifd
          * sender thread can clear it.
          */
         if (qatomic_read(&p->pending_job) == false) {
-            next_channel = (i + 1) % migrate_multifd_channels();
+            next_channel = (i + 1) % count;
             break;
         }
     }
@@ -405,14 +438,28 @@ static void multifd_send_terminate_threads(void)
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
         qemu_sem_post(&p->sem);
+        /* Workers waiting for this channel will pass it on to each other */
+        qemu_sem_post(&p->write_sem);
         if (p->c) {
             qio_channel_shutdown(p->c, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
         }
     }
 
+    for (i = 0; i < multifd_send_state->worker_count; i++) {
+        qemu_sem_post(&multifd_send_state->workers[i].sem);
+    }
+
     /*
      * Finally recycle all the threads.
      */
+    for (i = 0; i < multifd_send_state->worker_count; i++) {
+        MultiFDSendParams *p = &multifd_send_state->workers[i];
+
+        if (p->thread_created) {
+            qemu_thread_join(&p->thread);
+        }
+    }
+
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
@@ -456,6 +503,27 @@ static bool multifd_send_cleanup_channel(MultiFDSendParams *p, Error **errp)
         object_unref(OBJECT(p->c));
         p->c = NULL;
     }
+    qemu_sem_destroy(&p->sem);
+    qemu_sem_destroy(&p->sem_sync);
+    qemu_sem_destroy(&p->write_sem);
+    g_free(p->name);
+    p->name = NULL;
+    g_free(p->data);
+    p->data = NULL;
+    p->packet_len = 0;
+    g_free(p->packet);
+    p->packet = NULL;
+    /* With compression workers, the channels only send headers */
+    if (!multifd_send_state->worker_count) {
+        multifd_send_state->ops->send_cleanup(p, errp);
+        assert(!p->iov);
+    }
+
+    return *errp == NULL;
+}
+
+static bool multifd_send_cleanup_worker(MultiFDSendParams *p, Error **errp)
+{
     qemu_sem_destroy(&p->sem);
     qemu_sem_destroy(&p->sem_sync);
     g_free(p->name);
@@ -465,8 +533,11 @@ static bool multifd_send_cleanup_channel(MultiFDSendParams *p, Error **errp)
     p->packet_len = 0;
     g_free(p->packet);
     p->packet = NULL;
-    multifd_send_state->ops->send_cleanup(p, errp);
-    assert(!p->iov);
+    /* The thread is only created once send_setup() succeeded */
+    if (p->thread_created) {
+        multifd_send_state->ops->send_cleanup(p, errp);
+        assert(!p->iov);
+    }
 
     return *errp == NULL;
 }
@@ -477,6 +548,9 @@ static void multifd_send_cleanup_state(void)
     socket_cleanup_outgoing_migration();
     qemu_sem_destroy(&multifd_send_state->channels_created);
     qemu_sem_destroy(&multifd_send_state->channels_ready);
+    qemu_sem_destroy(&multifd_send_state->workers_ready);
+    g_free(multifd_send_state->workers);
+    multifd_send_state->workers = NULL;
     g_free(multifd_send_state->params);
     multifd_send_state->params = NULL;
     g_free(multifd_send_state);
@@ -503,6 +577,16 @@ void multifd_send_shutdown(void)
         }
     }
 
+    for (i = 0; i < multifd_send_state->worker_count; i++) {
+        MultiFDSendParams *p = &multifd_send_state->workers[i];
+        Error *local_err = NULL;
+
+        if (!multifd_send_cleanup_worker(p, &local_err)) {
+            migrate_set_error(migrate_get_current(), local_err);
+            error_free(local_err);
+        }
+    }
+
     multifd_send_cleanup_state();
 }
 
@@ -523,6 +607,40 @@ static int multifd_zero_copy_flush(QIOChannel *c)
     return ret;
 }
 
+/*
+ * Wait for every compression worker to write out its pending packet,
+ * so that the SYNC packets sent by the channels come after all the
+ * data queued before the sync.
+ */
+static int multifd_send_sync_workers(void)
+{
+    int i;
+
+    for (i = 0; i < multifd_send_state->worker_count; i++) {
+        MultiFDSendParams *p = &multifd_send_state->workers[i];
+
+        if (multifd_send_should_exit()) {
+            return -1;
+        }
+
+        assert(qatomic_read(&p->pending_sync) == false);
+        qatomic_set(&p->pending_sync, true);
+        qemu_sem_post(&p->sem);
+    }
+    for (i = 0; i < multifd_send_state->worker_count; i++) {
+        MultiFDSendParams *p = &multifd_send_state->workers[i];
+
+        if (multifd_send_should_exit()) {
+            return -1;
+        }
+
+        qemu_sem_wait(&multifd_send_state->workers_ready);
+        qemu_sem_wait(&p->sem_sync);
+    }
+
+    return 0;
+}
+
 int multifd_send_sync_main(void)
 {
     int i;
@@ -530,6 +648,10 @@ int multifd_send_sync_main(void)
 
     flush_zero_copy = migrate_zero_copy_send();
 
+    if (multifd_send_sync_workers() < 0) {
+        return -1;
+    }
+
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
@@ -587,6 +709,9 @@ static void *multifd_send_thread(void *opaque)
         }
     }
 
+    /* The channel can now take packets from the compression workers */
+    qemu_sem_post(&p->write_sem);
+
     while (true) {
         qemu_sem_post(&multifd_send_state->channels_ready);
         qemu_sem_wait(&p->sem);
@@ -675,6 +800,118 @@ out:
     return NULL;
 }
 
+/*
+ * Write the packet prepared by a compression worker.  Use the first
+ * channel that is not busy, or wait for the one matching the worker
+ * id if all of them are.
+ */
+static int multifd_compress_write(MultiFDSendParams *p, Error **errp)
+{
+    int channels = migrate_multifd_channels();
+    MultiFDSendParams *c = NULL;
+    int i, ret;
+
+    for (i = 0; i < channels; i++) {
+        c = &multifd_send_state->params[(p->id + i) % channels];
+        if (qemu_sem_timedwait(&c->write_sem, 0) == 0) {
+            break;
+        }
+        c = NULL;
+    }
+    if (!c) {
+        c = &multifd_send_state->params[p->id % channels];
+        qemu_sem_wait(&c->write_sem);
+    }
+
+    if (multifd_send_should_exit()) {
+        qemu_sem_post(&c->write_sem);
+        return 0;
+    }
+
+    trace_multifd_compress_write(p->id, c->id, p->next_packet_size);
+    ret = qio_channel_writev_full_all(c->c, p->iov, p->iovs_num, NULL, 0,
+                                      c->write_flags, errp);
+    qemu_sem_post(&c->write_sem);
+
+    return ret;
+}
+
+static void *multifd_compress_thread(void *opaque)
+{
+    MultiFDSendParams *p = opaque;
+    MigrationThread *thread = NULL;
+    Error *local_err = NULL;
+    int ret = 0;
+
+    thread = migration_threads_add(p->name, qemu_get_thread_id());
+
+    trace_multifd_compress_thread_start(p->id);
+    rcu_register_thread();
+
+    while (true) {
+        qemu_sem_post(&multifd_send_state->workers_ready);
+        qemu_sem_wait(&p->sem);
+
+        if (multifd_send_should_exit()) {
+            break;
+        }
+
+        /*
+         * Read pending_job flag before p->data.  Pairs with the
+         * qatomic_store_release() in multifd_send().
+         */
+        if (qatomic_load_acquire(&p->pending_job)) {
+            p->iovs_num = 0;
+            assert(!multifd_payload_empty(p->data));
+
+            ret = multifd_send_state->ops->send_prepare(p, &local_err);
+            if (ret != 0) {
+                break;
+            }
+
+            ret = multifd_compress_write(p, &local_err);
+            if (ret != 0) {
+                break;
+            }
+
+            stat64_add(&mig_stats.multifd_bytes,
+                       p->next_packet_size + p->packet_len);
+
+            p->next_packet_size = 0;
+            multifd_set_payload_type(p->data, MULTIFD_PAYLOAD_NONE);
+
+            /*
+             * Making sure p->data is published before saying "we're
+             * free".  Pairs with the smp_mb_acquire() in
+             * multifd_send().
+             */
+            qatomic_store_release(&p->pending_job, false);
+        } else {
+            /*
+             * A sync request only needs the previous job to be written
+             * out, the SYNC packets themselves are sent by the channels.
+             */
+            assert(qatomic_read(&p->pending_sync));
+            qatomic_set(&p->pending_sync, false);
+            qemu_sem_post(&p->sem_sync);
+        }
+    }
+
+    if (ret) {
+        assert(local_err);
+        trace_multifd_compress_error(p->id);
+        multifd_send_set_error(local_err);
+        multifd_send_kick_main(p);
+        error_free(local_err);
+    }
+
+    rcu_unregister_thread();
+    migration_threads_remove(thread);
+    trace_multifd_compress_thread_end(p->id, p->packets_sent);
+
+    return NULL;
+}
+
 static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque);
 
 typedef struct {
@@ -810,7 +1047,7 @@ static bool multifd_new_send_channel_create(gpointer opaque, Error **errp)
 bool multifd_send_setup(void)
 {
     MigrationState *s = migrate_get_current();
-    int thread_count, ret = 0;
+    int thread_count, worker_count = 0, ret = 0;
     uint32_t page_count = multifd_ram_page_count();
     bool use_packets = multifd_use_packets();
     uint8_t i;
@@ -824,15 +1061,39 @@ bool multifd_send_setup(void)
     multifd_send_state->params = g_new0(MultiFDSendParams, thread_count);
     qemu_sem_init(&multifd_send_state->channels_created, 0);
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
+    qemu_sem_init(&multifd_send_state->workers_ready, 0);
     qatomic_set(&multifd_send_state->exiting, 0);
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
 
+    if (migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE &&
+        use_packets) {
+        worker_count = migrate_multifd_compression_threads();
+    }
+    if (worker_count) {
+        multifd_send_state->workers = g_new0(MultiFDSendParams, worker_count);
+        multifd_send_state->worker_count = worker_count;
+    }
+
+    for (i = 0; i < worker_count; i++) {
+        MultiFDSendParams *p = &multifd_send_state->workers[i];
+
+        qemu_sem_init(&p->sem, 0);
+        qemu_sem_init(&p->sem_sync, 0);
+        p->id = i;
+        p->data = multifd_send_data_alloc();
+        p->packet_len = sizeof(MultiFDPacket_t)
+                      + sizeof(uint64_t) * page_count;
+        p->packet = g_malloc0(p->packet_len);
+        p->name = g_strdup_printf("mig/src/compress_%d", i);
+    }
+
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
         Error *local_err = NULL;
 
         qemu_sem_init(&p->sem, 0);
         qemu_sem_init(&p->sem_sync, 0);
+        qemu_sem_init(&p->write_sem, 0);
         p->id = i;
         p->data = multifd_send_data_alloc();
 
@@ -863,7 +1124,7 @@ bool multifd_send_setup(void)
         goto err;
     }
 
-    for (i = 0; i < thread_count; i++) {
+    for (i = 0; i < thread_count && !worker_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
         Error *local_err = NULL;
 
@@ -875,6 +1136,22 @@ bool multifd_send_setup(void)
         assert(p->iov);
     }
 
+    for (i = 0; i < worker_count; i++) {
+        MultiFDSendParams *p = &multifd_send_state->workers[i];
+        Error *local_err = NULL;
+
+        ret = multifd_send_state->ops->send_setup(p, &local_err);
+        if (ret) {
+            migrate_set_error(s, local_err);
+            goto err;
+        }
+        assert(p->iov);
+
+        p->thread_created = true;
+        qemu_thread_create(&p->thread, p->name, multifd_compress_thread, p,
+                           QEMU_THREAD_JOINABLE);
+    }
+
     return true;
 
 err:
@@ -1329,6 +1606,15 @@ void multifd_recv_new_channel(QIOChannel *ioc, Error **errp)
     p->c = ioc;
     object_ref(OBJECT(ioc));
 
+    /*
+     * Pages are read straight into guest memory; let the kernel fill the
+     * whole packet with a single call instead of returning each time some
+     * data arrives.
+     */
+    if (qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_READ_WAITALL)) {
+        p->read_flags |= QIO_CHANNEL_READ_FLAG_WAITALL;
+    }
+
     p->thread_created = true;
     qemu_thread_create(&p->thread, p->name, multifd_recv_thread, p,
                        QEMU_THREAD_JOINABLE);
@@ -139,6 +139,12 @@ typedef struct {
     QemuSemaphore sem;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
+    /*
+     * Held by a compression worker while it writes a packet to this
+     * channel.  Posted for the first time once the initial packet has
+     * been sent.
+     */
+    QemuSemaphore write_sem;
 
     /* multifd flags for each packet */
     uint32_t flags;
@@ -186,6 +192,8 @@ typedef struct {
     QIOChannel *c;
     /* packet allocated len */
     uint32_t packet_len;
+    /* multifd flags for receiving ram */
+    int read_flags;
 
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
@@ -259,7 +267,10 @@ typedef struct {
     /*
      * Prepare the send packet. Called as a result of multifd_send()
      * on the client side, with p pointing to the MultiFDSendParams of
-     * a channel that is currently idle.
+     * a channel that is currently idle, or of a compression worker if
+     * multifd_send_use_workers() is true.  In the latter case the
+     * packet may go out on any channel, so it must not depend on the
+     * compression state left by previous packets.
      *
      * Must populate p->iov with the data to be sent, increment
      * p->iovs_num to match the amount of iovecs used and set
@@ -311,6 +322,7 @@ typedef struct {
 void multifd_register_ops(int method, const MultiFDMethods *ops);
 void multifd_send_fill_packet(MultiFDSendParams *p);
 bool multifd_send_prepare_common(MultiFDSendParams *p);
+bool multifd_send_use_workers(void);
 void multifd_send_zero_page_detect(MultiFDSendParams *p);
 void multifd_recv_zero_page_process(MultiFDRecvParams *p);
 
@@ -53,6 +53,8 @@
 #define DEFAULT_MIGRATE_X_CHECKPOINT_DELAY (200 * 100)
 #define DEFAULT_MIGRATE_MULTIFD_CHANNELS 2
 #define DEFAULT_MIGRATE_MULTIFD_COMPRESSION MULTIFD_COMPRESSION_NONE
+/* 0: compress in the multifd channel threads */
+#define DEFAULT_MIGRATE_MULTIFD_COMPRESSION_THREADS 0
 /* 0: means nocompress, 1: best speed, ... 9: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
 /*
@@ -98,6 +100,12 @@ Property migration_properties[] = {
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
     DEFINE_PROP_BOOL("x-preempt-pre-7-2", MigrationState,
                      preempt_pre_7_2, false),
+    DEFINE_PROP_SIZE("x-qemu-file-buffer-size", MigrationState,
+                     qemu_file_buffer_size, 0),
+    DEFINE_PROP_UINT32("x-qemu-file-iov-max", MigrationState,
+                       qemu_file_iov_max, 0),
+    DEFINE_PROP_BOOL("x-qemu-file-zero-copy", MigrationState,
+                     qemu_file_zero_copy, false),
 
     /* Migration parameters */
     DEFINE_PROP_UINT8("x-throttle-trigger-threshold", MigrationState,
@@ -127,6 +135,9 @@ Property migration_properties[] = {
     DEFINE_PROP_MULTIFD_COMPRESSION("multifd-compression", MigrationState,
                       parameters.multifd_compression,
                       DEFAULT_MIGRATE_MULTIFD_COMPRESSION),
+    DEFINE_PROP_UINT8("multifd-compression-threads", MigrationState,
+                      parameters.multifd_compression_threads,
+                      DEFAULT_MIGRATE_MULTIFD_COMPRESSION_THREADS),
     DEFINE_PROP_UINT8("multifd-zlib-level", MigrationState,
                       parameters.multifd_zlib_level,
                       DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL),
@@ -790,6 +801,13 @@ MultiFDCompression migrate_multifd_compression(void)
     return s->parameters.multifd_compression;
 }
 
+int migrate_multifd_compression_threads(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.multifd_compression_threads;
+}
+
 int migrate_multifd_zlib_level(void)
 {
     MigrationState *s = migrate_get_current();
@@ -907,6 +925,9 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->multifd_channels = s->parameters.multifd_channels;
     params->has_multifd_compression = true;
     params->multifd_compression = s->parameters.multifd_compression;
+    params->has_multifd_compression_threads = true;
+    params->multifd_compression_threads =
+        s->parameters.multifd_compression_threads;
     params->has_multifd_zlib_level = true;
     params->multifd_zlib_level = s->parameters.multifd_zlib_level;
     params->has_multifd_qatzip_level = true;
@@ -964,6 +985,7 @@ void migrate_params_init(MigrationParameters *params)
     params->has_x_checkpoint_delay = true;
     params->has_multifd_channels = true;
     params->has_multifd_compression = true;
+    params->has_multifd_compression_threads = true;
     params->has_multifd_zlib_level = true;
     params->has_multifd_qatzip_level = true;
     params->has_multifd_zstd_level = true;
@@ -1223,6 +1245,10 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_multifd_compression) {
         dest->multifd_compression = params->multifd_compression;
     }
+    if (params->has_multifd_compression_threads) {
+        dest->multifd_compression_threads =
+            params->multifd_compression_threads;
+    }
     if (params->has_multifd_qatzip_level) {
         dest->multifd_qatzip_level = params->multifd_qatzip_level;
     }
@@ -1346,6 +1372,10 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_multifd_compression) {
         s->parameters.multifd_compression = params->multifd_compression;
     }
+    if (params->has_multifd_compression_threads) {
+        s->parameters.multifd_compression_threads =
+            params->multifd_compression_threads;
+    }
     if (params->has_multifd_qatzip_level) {
         s->parameters.multifd_qatzip_level = params->multifd_qatzip_level;
     }
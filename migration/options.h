@@ -77,6 +77,7 @@ uint64_t migrate_avail_switchover_bandwidth(void);
 uint64_t migrate_max_postcopy_bandwidth(void);
 int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
+int migrate_multifd_compression_threads(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_qatzip_level(void);
 int migrate_multifd_zstd_level(void);
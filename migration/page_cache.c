@@ -1,6 +1,6 @@
 /*
  * Page cache for QEMU
- * The cache is base on a hash of the page address
+ * The cache is a set associative hash of the page address
  *
  * Copyright 2012 Red Hat, Inc. and/or its affiliates
  *
@@ -23,11 +23,15 @@
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* number of pages that may share a set in the cache */
+#define PAGE_CACHE_WAYS 4
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
     uint64_t it_addr;
     uint64_t it_age;
+    uint64_t it_hits;
     uint8_t *it_data;
 };
 
@@ -36,6 +40,9 @@ struct PageCache {
     size_t page_size;
     size_t max_num_items;
     size_t num_items;
+    size_t num_sets;
+    unsigned int set_bits;
+    unsigned int ways;
 };
 
 PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
@@ -66,6 +73,9 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     cache->page_size = page_size;
     cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->ways = MIN(num_pages, PAGE_CACHE_WAYS);
+    cache->num_sets = num_pages / cache->ways;
+    cache->set_bits = ctz64(cache->num_sets);
 
     trace_migration_pagecache_init(cache->max_num_items);
 
@@ -81,6 +91,7 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     for (i = 0; i < cache->max_num_items; i++) {
         cache->page_cache[i].it_data = NULL;
         cache->page_cache[i].it_age = 0;
+        cache->page_cache[i].it_hits = 0;
         cache->page_cache[i].it_addr = -1;
     }
 
@@ -103,28 +114,45 @@ void cache_fini(PageCache *cache)
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+/* Return the first item of the set that may hold ADDRESS. */
+static CacheItem *cache_get_set(const PageCache *cache, uint64_t address)
 {
+    uint64_t page = address / cache->page_size;
+
     g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+
+    /*
+     * Fold the upper bits of the page number into the index, so that
+     * pages at the same offset of RAM blocks aligned to a large power
+     * of 2 do not all compete for the same set.
+     */
+    page ^= page >> cache->set_bits;
+
+    return &cache->page_cache[(page & (cache->num_sets - 1)) * cache->ways];
 }
 
 static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
 {
-    size_t pos;
+    CacheItem *set;
+    unsigned int i;
 
     g_assert(cache);
     g_assert(cache->page_cache);
 
-    pos = cache_get_cache_pos(cache, addr);
-
-    return &cache->page_cache[pos];
+    set = cache_get_set(cache, addr);
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].it_addr == addr) {
+            return &set[i];
+        }
+    }
+    return NULL;
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? it->it_data : NULL;
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
@@ -134,14 +162,40 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
 
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_addr == addr) {
+    if (it) {
         /* update the it_age when the cache hit */
         it->it_age = current_age;
+        it->it_hits++;
         return true;
     }
     return false;
 }
 
+/*
+ * Pick the item to hold ADDR: the one already holding it, else a free
+ * one, else the least recently used one.  Among items last used in the
+ * same cycle, replace the one with the fewest hits.
+ */
+static CacheItem *cache_get_victim(const PageCache *cache, uint64_t addr)
+{
+    CacheItem *set = cache_get_set(cache, addr);
+    CacheItem *victim = NULL;
+    unsigned int i;
+
+    for (i = 0; i < cache->ways; i++) {
+        CacheItem *it = &set[i];
+
+        if (it->it_addr == addr || !it->it_data) {
+            return it;
+        }
+        if (!victim || it->it_age < victim->it_age ||
+            (it->it_age == victim->it_age && it->it_hits < victim->it_hits)) {
+            victim = it;
+        }
+    }
+    return victim;
+}
+
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
                  uint64_t current_age)
 {
@@ -149,7 +203,7 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
     CacheItem *it;
 
     /* actual update of entry */
-    it = cache_get_by_addr(cache, addr);
+    it = cache_get_victim(cache, addr);
 
     if (it->it_data && it->it_addr != addr &&
         it->it_age + CACHED_PAGE_LIFETIME > current_age) {
@@ -168,6 +222,9 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
 
     memcpy(it->it_data, pdata, cache->page_size);
 
+    if (it->it_addr != addr) {
+        it->it_hits = 0;
+    }
     it->it_age = current_age;
     it->it_addr = addr;
 
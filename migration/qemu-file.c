@@ -23,6 +23,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/madvise.h"
+#include "qemu/units.h"
 #include "qemu/error-report.h"
 #include "qemu/iov.h"
 #include "migration.h"
@@ -34,20 +35,31 @@
 #include "rdma.h"
 #include "io/channel-file.h"
 
+/* Defaults, and the minimum buffer size that readers can rely on */
 #define IO_BUF_SIZE 32768
 #define MAX_IOV_SIZE MIN_CONST(IOV_MAX, 64)
+#define MAX_IO_BUF_SIZE (64 * MiB)
+
+/*
+ * Below this size MSG_ZEROCOPY costs more in page pinning and completion
+ * handling than it saves in copying, so smaller flushes are copied.
+ */
+#define ZERO_COPY_MIN_SIZE (64 * KiB)
 
 struct QEMUFile {
     QIOChannel *ioc;
     bool is_writable;
+    bool zero_copy;
 
     int buf_index;
     int buf_size; /* 0 when writing */
-    uint8_t buf[IO_BUF_SIZE];
+    int buf_len;
+    uint8_t *buf;
 
-    DECLARE_BITMAP(may_free, MAX_IOV_SIZE);
-    struct iovec iov[MAX_IOV_SIZE];
+    unsigned long *may_free;
+    struct iovec *iov;
     unsigned int iovcnt;
+    unsigned int iov_max;
 
     int last_error;
     Error *last_error_obj;
@@ -100,6 +112,11 @@ int qemu_file_shutdown(QEMUFile *f)
     return 0;
 }
 
+static bool qemu_file_is_writable(QEMUFile *f)
+{
+    return f->is_writable;
+}
+
 static QEMUFile *qemu_file_new_impl(QIOChannel *ioc, bool is_writable)
 {
     QEMUFile *f;
@@ -110,9 +127,67 @@ static QEMUFile *qemu_file_new_impl(QIOChannel *ioc, bool is_writable)
     f->ioc = ioc;
     f->is_writable = is_writable;
 
+    f->buf_len = IO_BUF_SIZE;
+    f->buf = g_malloc(f->buf_len);
+    f->iov_max = MAX_IOV_SIZE;
+    f->iov = g_new(struct iovec, f->iov_max);
+    f->may_free = bitmap_new(f->iov_max);
+
     return f;
 }
 
+/*
+ * Resize the staging buffer and the iovec array of @f.  A @buf_size or
+ * @iov_max of zero keeps the default.  The buffer is never made smaller
+ * than the default, since readers may peek that far ahead, and the iovec
+ * array is limited to IOV_MAX.
+ *
+ * Must be called before any data is read from or written to @f.
+ */
+void qemu_file_set_buffer_size(QEMUFile *f, size_t buf_size,
+                               unsigned int iov_max)
+{
+    assert(!f->buf_index && !f->buf_size && !f->iovcnt);
+
+    buf_size = MIN(MAX(buf_size, IO_BUF_SIZE), MAX_IO_BUF_SIZE);
+    iov_max = iov_max ? MIN(iov_max, IOV_MAX) : MAX_IOV_SIZE;
+
+    if (buf_size != f->buf_len) {
+        g_free(f->buf);
+        f->buf_len = buf_size;
+        f->buf = g_malloc(f->buf_len);
+    }
+    if (iov_max != f->iov_max) {
+        g_free(f->iov);
+        g_free(f->may_free);
+        f->iov_max = iov_max;
+        f->iov = g_new(struct iovec, f->iov_max);
+        f->may_free = bitmap_new(f->iov_max);
+    }
+    trace_qemu_file_set_buffer_size(f->buf_len, f->iov_max);
+}
+
+/*
+ * Send large flushes of @f with MSG_ZEROCOPY.  Each such flush waits
+ * for the kernel to release the pages before the staging buffer and
+ * any queued guest memory can be reused.
+ *
+ * Returns false and sets @errp if the channel cannot do zero copy.
+ */
+bool qemu_file_set_zero_copy(QEMUFile *f, bool enable, Error **errp)
+{
+    assert(qemu_file_is_writable(f));
+
+    if (enable &&
+        !qio_channel_has_feature(f->ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        error_setg(errp, "The migration channel does not support zero copy "
+                   "send");
+        return false;
+    }
+    f->zero_copy = enable;
+    return true;
+}
+
 /*
  * Result: QEMUFile* for a 'return path' for comms in the opposite direction
  *         NULL if not available
@@ -218,11 +293,6 @@ void qemu_file_set_error(QEMUFile *f, int ret)
     qemu_file_set_error_obj(f, ret, NULL);
 }
 
-static bool qemu_file_is_writable(QEMUFile *f)
-{
-    return f->is_writable;
-}
-
 static void qemu_iovec_release_ram(QEMUFile *f)
 {
     struct iovec iov;
@@ -255,7 +325,7 @@ static void qemu_iovec_release_ram(QEMUFile *f)
             error_report("migrate: madvise DONTNEED failed %p %zd: %s",
                          iov.iov_base, iov.iov_len, strerror(errno));
     }
-    memset(f->may_free, 0, sizeof(f->may_free));
+    bitmap_zero(f->may_free, f->iov_max);
 }
 
 bool qemu_file_is_seekable(QEMUFile *f)
@@ -263,6 +333,23 @@ bool qemu_file_is_seekable(QEMUFile *f)
     return qio_channel_has_feature(f->ioc, QIO_CHANNEL_FEATURE_SEEKABLE);
 }
 
+/*
+ * Wait until the kernel is done with the pages of a zero copy write,
+ * after which the iovecs may be released or reused.
+ */
+static void qemu_file_zero_copy_flush(QEMUFile *f)
+{
+    Error *local_error = NULL;
+    int ret = qio_channel_flush(f->ioc, &local_error);
+
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_error);
+    } else if (ret == 1) {
+        /* The kernel fell back to copying */
+        stat64_add(&mig_stats.dirty_sync_missed_zero_copy, 1);
+    }
+}
+
 /**
  * Flushes QEMUFile buffer
  *
@@ -280,13 +367,20 @@ int qemu_fflush(QEMUFile *f)
     }
     if (f->iovcnt > 0) {
         Error *local_error = NULL;
-        if (qio_channel_writev_all(f->ioc,
-                                   f->iov, f->iovcnt,
-                                   &local_error) < 0) {
+        uint64_t size = iov_size(f->iov, f->iovcnt);
+        int flags = 0;
+
+        if (f->zero_copy && size >= ZERO_COPY_MIN_SIZE) {
+            flags = QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+        }
+        if (qio_channel_writev_full_all(f->ioc, f->iov, f->iovcnt,
+                                        NULL, 0, flags, &local_error) < 0) {
             qemu_file_set_error_obj(f, -EIO, local_error);
         } else {
-            uint64_t size = iov_size(f->iov, f->iovcnt);
             stat64_add(&mig_stats.qemu_file_transferred, size);
+            if (flags) {
+                qemu_file_zero_copy_flush(f);
+            }
         }
 
         qemu_iovec_release_ram(f);
@@ -327,7 +421,7 @@ static ssize_t coroutine_mixed_fn qemu_fill_buffer(QEMUFile *f)
     do {
         len = qio_channel_read(f->ioc,
                                (char *)f->buf + pending,
-                               IO_BUF_SIZE - pending,
+                               f->buf_len - pending,
                                &local_error);
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             if (qemu_in_coroutine()) {
@@ -368,6 +462,9 @@ int qemu_fclose(QEMUFile *f)
     }
     g_clear_pointer(&f->ioc, object_unref);
     error_free(f->last_error_obj);
+    g_free(f->buf);
+    g_free(f->iov);
+    g_free(f->may_free);
     g_free(f);
     trace_qemu_file_fclose();
     return ret;
@@ -391,7 +488,7 @@ static int add_to_iovec(QEMUFile *f, const uint8_t *buf, size_t size,
     {
         f->iov[f->iovcnt - 1].iov_len += size;
     } else {
-        if (f->iovcnt >= MAX_IOV_SIZE) {
+        if (f->iovcnt >= f->iov_max) {
             /* Should only happen if a previous fflush failed */
             assert(qemu_file_get_error(f) || !qemu_file_is_writable(f));
             return 1;
@@ -403,7 +500,7 @@ static int add_to_iovec(QEMUFile *f, const uint8_t *buf, size_t size,
         f->iov[f->iovcnt++].iov_len = size;
     }
 
-    if (f->iovcnt >= MAX_IOV_SIZE) {
+    if (f->iovcnt >= f->iov_max) {
         qemu_fflush(f);
         return 1;
     }
@@ -415,7 +512,7 @@ static void add_buf_to_iovec(QEMUFile *f, size_t len)
 {
     if (!add_to_iovec(f, f->buf + f->buf_index, len, false)) {
         f->buf_index += len;
-        if (f->buf_index == IO_BUF_SIZE) {
+        if (f->buf_index == f->buf_len) {
             qemu_fflush(f);
         }
     }
@@ -440,7 +537,7 @@ void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, size_t size)
     }
 
     while (size > 0) {
-        l = IO_BUF_SIZE - f->buf_index;
+        l = f->buf_len - f->buf_index;
         if (l > size) {
             l = size;
         }
@@ -586,8 +683,8 @@ size_t coroutine_mixed_fn qemu_peek_buffer(QEMUFile *f, uint8_t **buf, size_t si
     size_t index;
 
     assert(!qemu_file_is_writable(f));
-    assert(offset < IO_BUF_SIZE);
-    assert(size <= IO_BUF_SIZE - offset);
+    assert(offset < f->buf_len);
+    assert(size <= f->buf_len - offset);
 
     /* The 1st byte to read from */
     index = f->buf_index + offset;
@@ -637,7 +734,7 @@ size_t coroutine_mixed_fn qemu_get_buffer(QEMUFile *f, uint8_t *buf, size_t size
         size_t res;
         uint8_t *src;
 
-        res = qemu_peek_buffer(f, &src, MIN(pending, IO_BUF_SIZE), 0);
+        res = qemu_peek_buffer(f, &src, MIN(pending, f->buf_len), 0);
         if (res == 0) {
             return done;
         }
@@ -671,7 +768,7 @@ size_t coroutine_mixed_fn qemu_get_buffer(QEMUFile *f, uint8_t *buf, size_t size
  */
 size_t coroutine_mixed_fn qemu_get_buffer_in_place(QEMUFile *f, uint8_t **buf, size_t size)
 {
-    if (size < IO_BUF_SIZE) {
+    if (size < f->buf_len) {
         size_t res;
         uint8_t *src = NULL;
 
@@ -696,7 +793,7 @@ int coroutine_mixed_fn qemu_peek_byte(QEMUFile *f, int offset)
     int index = f->buf_index + offset;
 
     assert(!qemu_file_is_writable(f));
-    assert(offset < IO_BUF_SIZE);
+    assert(offset < f->buf_len);
 
     if (index >= f->buf_size) {
         qemu_fill_buffer(f);
@@ -32,6 +32,9 @@
 QEMUFile *qemu_file_new_input(QIOChannel *ioc);
 QEMUFile *qemu_file_new_output(QIOChannel *ioc);
 int qemu_fclose(QEMUFile *f);
+void qemu_file_set_buffer_size(QEMUFile *f, size_t buf_size,
+                               unsigned int iov_max);
+bool qemu_file_set_zero_copy(QEMUFile *f, bool enable, Error **errp);
 
 /*
  * qemu_file_transferred:
@@ -698,6 +698,32 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+/**
+ * ramblock_find_next_dirty: find the next dirty page in a ramblock
+ *
+ * Same as find_next_bit() on @bitmap, but uses the bitmap summary to
+ * skip over clean words without reading them, see
+ * bitmap_summary_find_next().  Must be with bitmap_mutex held.
+ *
+ * Returns the page index of the next dirty page, or @size if none.
+ *
+ * @rb: the ramblock to search
+ * @bitmap: the dirty bitmap of @rb
+ * @size: number of pages to search
+ * @start: first page to look at
+ */
+static unsigned long ramblock_find_next_dirty(RAMBlock *rb,
+                                              unsigned long *bitmap,
+                                              unsigned long size,
+                                              unsigned long start)
+{
+    if (!rb->bmap_summary) {
+        return find_next_bit(bitmap, size, start);
+    }
+
+    return bitmap_summary_find_next(bitmap, rb->bmap_summary, size, start);
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -730,7 +756,7 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
         size = MIN(size, pss->host_page_end);
     }
 
-    pss->page = find_next_bit(bitmap, size, pss->page);
+    pss->page = ramblock_find_next_dirty(rb, bitmap, size, pss->page);
 }
 
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
@@ -922,6 +948,22 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+static void ram_sync_dirty_ring_page(RAMBlock *rb, ram_addr_t offset,
+                                     void *opaque)
+{
+    RAMState *rs = opaque;
+
+    if (migrate_ram_is_ignored(rb) || !rb->bmap) {
+        return;
+    }
+
+    if (!test_and_set_bit(offset >> TARGET_PAGE_BITS, rb->bmap)) {
+        rs->migration_dirty_pages++;
+        rs->num_dirty_pages_period++;
+    }
+    ramblock_bmap_summary_set(rb, offset >> TARGET_PAGE_BITS, 1);
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1057,8 +1099,16 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
-            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-                ramblock_sync_dirty_bitmap(rs, block);
+            /*
+             * With dirty rings, only the pages dirtied since the last
+             * sync need to be looked at.  Fall back to scanning the
+             * whole bitmap when the rings missed some pages.
+             */
+            if (!cpu_physical_memory_dirty_ring_harvest(
+                    ram_sync_dirty_ring_page, rs)) {
+                RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                    ramblock_sync_dirty_bitmap(rs, block);
+                }
             }
             stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
         }
@@ -2358,6 +2408,8 @@ static void ram_bitmaps_destroy(void)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->bmap_summary);
+        block->bmap_summary = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
     }
@@ -2378,6 +2430,7 @@ static void ram_save_cleanup(void *opaque)
              * memory_global_dirty_log_stop will assert that
              * memory_global_dirty_log_start/stop used in pairs
              */
+            cpu_physical_memory_dirty_ring_stop();
             memory_global_dirty_log_stop(GLOBAL_DIRTY_MIGRATION);
         }
     }
@@ -2561,6 +2614,7 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
                  */
                 rs->migration_dirty_pages += !test_and_set_bit(page, bitmap);
             }
+            ramblock_bmap_summary_set(block, fixup_start_addr, host_ratio);
         }
 
         /* Find the next dirty page for the next iteration */
@@ -2746,6 +2800,13 @@ static void ram_list_init_bitmaps(void)
              */
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
+            /*
+             * One summary bit per bitmap word, i.e. per 64 pages, which
+             * is also the smallest clear_bmap chunk: each clear chunk
+             * always covers whole summary bits.
+             */
+            block->bmap_summary = bitmap_new(BITS_TO_LONGS(pages));
+            ramblock_bmap_summary_set(block, 0, pages);
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
@@ -2782,6 +2843,9 @@ static bool ram_init_bitmaps(RAMState *rs, Error **errp)
             if (!ret) {
                 goto out_unlock;
             }
+            if (cpu_physical_memory_dirty_ring_start()) {
+                trace_ram_dirty_ring_start();
+            }
             migration_bitmap_sync_precopy(rs, false);
         }
     }
@@ -4424,6 +4488,7 @@ bool ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *block, Error **errp)
      * dirty bitmap for this ramblock.
      */
     bitmap_complement(block->bmap, block->bmap, nbits);
+    ramblock_bmap_summary_set(block, 0, nbits);
 
     /* Clear dirty bits of discarded ranges that we don't want to migrate. */
     ramblock_dirty_bitmap_clear_discarded_pages(block);
@@ -15,152 +15,6 @@
 #include "qemu/host-utils.h"
 #include "xbzrle.h"
 
-#if defined(CONFIG_AVX512BW_OPT)
-#include <immintrin.h>
-#include "host/cpuinfo.h"
-
-static int __attribute__((target("avx512bw")))
-xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                            uint8_t *dst, int dlen)
-{
-    uint32_t zrun_len = 0, nzrun_len = 0;
-    int d = 0, i = 0, num = 0;
-    uint8_t *nzrun_start = NULL;
-    /* add 1 to include residual part in main loop */
-    uint32_t count512s = (slen >> 6) + 1;
-    /* countResidual is tail of data, i.e., countResidual = slen % 64 */
-    uint32_t count_residual = slen & 0b111111;
-    bool never_same = true;
-    uint64_t mask_residual = 1;
-    mask_residual <<= count_residual;
-    mask_residual -= 1;
-    __m512i r = _mm512_set1_epi32(0);
-
-    while (count512s) {
-        int bytes_to_check = 64;
-        uint64_t mask = 0xffffffffffffffff;
-        if (count512s == 1) {
-            bytes_to_check = count_residual;
-            mask = mask_residual;
-        }
-        __m512i old_data = _mm512_mask_loadu_epi8(r,
-                                                  mask, old_buf + i);
-        __m512i new_data = _mm512_mask_loadu_epi8(r,
-                                                  mask, new_buf + i);
-        uint64_t comp = _mm512_cmpeq_epi8_mask(old_data, new_data);
-        count512s--;
-
-        bool is_same = (comp & 0x1);
-        while (bytes_to_check) {
-            if (d + 2 > dlen) {
-                return -1;
-            }
-            if (is_same) {
-                if (nzrun_len) {
-                    d += uleb128_encode_small(dst + d, nzrun_len);
-                    if (d + nzrun_len > dlen) {
-                        return -1;
-                    }
-                    nzrun_start = new_buf + i - nzrun_len;
-                    memcpy(dst + d, nzrun_start, nzrun_len);
-                    d += nzrun_len;
-                    nzrun_len = 0;
-                }
-                /* 64 data at a time for speed */
-                if (count512s && (comp == 0xffffffffffffffff)) {
-                    i += 64;
-                    zrun_len += 64;
-                    break;
-                }
-                never_same = false;
-                num = ctz64(~comp);
-                num = (num < bytes_to_check) ? num : bytes_to_check;
-                zrun_len += num;
-                bytes_to_check -= num;
-                comp >>= num;
-                i += num;
-                if (bytes_to_check) {
-                    /* still has different data after same data */
-                    d += uleb128_encode_small(dst + d, zrun_len);
-                    zrun_len = 0;
-                } else {
-                    break;
-                }
-            }
-            if (never_same || zrun_len) {
-                /*
-                 * never_same only acts if
-                 * data begins with diff in first count512s
-                 */
-                d += uleb128_encode_small(dst + d, zrun_len);
-                zrun_len = 0;
-                never_same = false;
-            }
-            /* has diff, 64 data at a time for speed */
-            if ((bytes_to_check == 64) && (comp == 0x0)) {
-                i += 64;
-                nzrun_len += 64;
-                break;
-            }
-            num = ctz64(comp);
-            num = (num < bytes_to_check) ? num : bytes_to_check;
-            nzrun_len += num;
-            bytes_to_check -= num;
-            comp >>= num;
-            i += num;
-            if (bytes_to_check) {
-                /* mask like 111000 */
-                d += uleb128_encode_small(dst + d, nzrun_len);
-                /* overflow */
-                if (d + nzrun_len > dlen) {
-                    return -1;
-                }
-                nzrun_start = new_buf + i - nzrun_len;
-                memcpy(dst + d, nzrun_start, nzrun_len);
-                d += nzrun_len;
-                nzrun_len = 0;
-                is_same = true;
-            }
-        }
-    }
-
-    if (nzrun_len != 0) {
-        d += uleb128_encode_small(dst + d, nzrun_len);
-        /* overflow */
-        if (d + nzrun_len > dlen) {
-            return -1;
-        }
-        nzrun_start = new_buf + i - nzrun_len;
-        memcpy(dst + d, nzrun_start, nzrun_len);
-        d += nzrun_len;
-    }
-    return d;
-}
-
-static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
-                                    int slen, uint8_t *dst, int dlen);
-
-static int (*accel_func)(uint8_t *, uint8_t *, int, uint8_t *, int);
-
-static void __attribute__((constructor)) init_accel(void)
-{
-    unsigned info = cpuinfo_init();
-    if (info & CPUINFO_AVX512BW) {
-        accel_func = xbzrle_encode_buffer_avx512;
-    } else {
-        accel_func = xbzrle_encode_buffer_int;
-    }
-}
-
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
-{
-    return accel_func(old_buf, new_buf, slen, dst, dlen);
-}
-
-#define xbzrle_encode_buffer xbzrle_encode_buffer_int
-#endif
-
 /*
   page = zrun nzrun
        | zrun nzrun page
@@ -171,8 +25,8 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
@@ -273,6 +127,162 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#if defined(CONFIG_AVX2_OPT) || defined(CONFIG_AVX512BW_OPT)
+#include <immintrin.h>
+#include "host/cpuinfo.h"
+
+#ifdef CONFIG_AVX2_OPT
+static inline uint64_t __attribute__((always_inline, target("avx2")))
+xbzrle_cmp64_avx2(const uint8_t *old_buf, const uint8_t *new_buf, int n)
+{
+    QEMU_ALIGNED(32) uint8_t old_tail[64], new_tail[64];
+    __m256i o0, o1, n0, n1;
+    uint32_t lo, hi;
+
+    if (unlikely(n < 64)) {
+        memset(old_tail, 0, sizeof(old_tail));
+        memset(new_tail, 0, sizeof(new_tail));
+        memcpy(old_tail, old_buf, n);
+        memcpy(new_tail, new_buf, n);
+        old_buf = old_tail;
+        new_buf = new_tail;
+    }
+    o0 = _mm256_loadu_si256((const __m256i *)old_buf);
+    o1 = _mm256_loadu_si256((const __m256i *)(old_buf + 32));
+    n0 = _mm256_loadu_si256((const __m256i *)new_buf);
+    n1 = _mm256_loadu_si256((const __m256i *)(new_buf + 32));
+    lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(o0, n0));
+    hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(o1, n1));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#define XBZRLE_ENCODE   xbzrle_encode_buffer_avx2
+#define XBZRLE_ATTR     __attribute__((target("avx2")))
+#define XBZRLE_CMP64    xbzrle_cmp64_avx2
+#include "xbzrle-encode.c.inc"
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef CONFIG_AVX512BW_OPT
+static inline uint64_t __attribute__((always_inline, target("avx512bw")))
+xbzrle_cmp64_avx512(const uint8_t *old_buf, const uint8_t *new_buf, int n)
+{
+    uint64_t mask = n < 64 ? (1ULL << n) - 1 : -1;
+    __m512i zero = _mm512_setzero_si512();
+    __m512i old_data = _mm512_mask_loadu_epi8(zero, mask, old_buf);
+    __m512i new_data = _mm512_mask_loadu_epi8(zero, mask, new_buf);
+
+    return _mm512_cmpeq_epi8_mask(old_data, new_data);
+}
+
+#define XBZRLE_ENCODE   xbzrle_encode_buffer_avx512
+#define XBZRLE_ATTR     __attribute__((target("avx512bw")))
+#define XBZRLE_CMP64    xbzrle_cmp64_avx512
+#include "xbzrle-encode.c.inc"
+#endif /* CONFIG_AVX512BW_OPT */
+
+static xbzrle_encode_fn const accel_table[] = {
+    xbzrle_encode_buffer_int,
+#ifdef CONFIG_AVX2_OPT
+    xbzrle_encode_buffer_avx2,
+#endif
+#ifdef CONFIG_AVX512BW_OPT
+    xbzrle_encode_buffer_avx512,
+#endif
+};
+
+static unsigned best_accel(void)
+{
+    unsigned info = cpuinfo_init();
+    unsigned i = ARRAY_SIZE(accel_table) - 1;
+
+#ifdef CONFIG_AVX512BW_OPT
+    if (info & CPUINFO_AVX512BW) {
+        return i;
+    }
+    i--;
+#endif
+#ifdef CONFIG_AVX2_OPT
+    if (info & CPUINFO_AVX2) {
+        return i;
+    }
+#endif
+    return 0;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+static inline uint64_t
+xbzrle_cmp64_neon(const uint8_t *old_buf, const uint8_t *new_buf, int n)
+{
+    /* Weight each byte of a compare result by its bit in the mask. */
+    static const uint8_t bits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8_t old_tail[64], new_tail[64];
+    uint8x16_t w = vld1q_u8(bits), m[4], t;
+
+    if (unlikely(n < 64)) {
+        memset(old_tail, 0, sizeof(old_tail));
+        memset(new_tail, 0, sizeof(new_tail));
+        memcpy(old_tail, old_buf, n);
+        memcpy(new_tail, new_buf, n);
+        old_buf = old_tail;
+        new_buf = new_tail;
+    }
+    for (int j = 0; j < 4; j++) {
+        m[j] = vandq_u8(vceqq_u8(vld1q_u8(old_buf + j * 16),
+                                 vld1q_u8(new_buf + j * 16)), w);
+    }
+    /* Three pairwise additions leave the 8 mask bytes in order. */
+    t = vpaddq_u8(vpaddq_u8(m[0], m[1]), vpaddq_u8(m[2], m[3]));
+    t = vpaddq_u8(t, t);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(t), 0);
+}
+
+#define XBZRLE_ENCODE   xbzrle_encode_buffer_neon
+#define XBZRLE_ATTR
+#define XBZRLE_CMP64    xbzrle_cmp64_neon
+#include "xbzrle-encode.c.inc"
+
+static xbzrle_encode_fn const accel_table[] = {
+    xbzrle_encode_buffer_int,
+    xbzrle_encode_buffer_neon,
+};
+
+#define best_accel() 1
+#else
+static xbzrle_encode_fn const accel_table[] = {
+    xbzrle_encode_buffer_int,
+};
+
+#define best_accel() 0
+#endif
+
+xbzrle_encode_fn xbzrle_encode_accel;
+static unsigned accel_index;
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
+bool test_xbzrle_next_accel(void)
+{
+    if (accel_index != 0) {
+        xbzrle_encode_accel = accel_table[--accel_index];
+        return true;
+    }
+    return false;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    xbzrle_encode_accel = accel_table[accel_index];
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
@@ -14,9 +14,20 @@
 #ifndef QEMU_MIGRATION_XBZRLE_H
 #define QEMU_MIGRATION_XBZRLE_H
 
+typedef int (*xbzrle_encode_fn)(uint8_t *, uint8_t *, int, uint8_t *, int);
+
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
                          uint8_t *dst, int dlen);
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
 
+/* Used by xbzrle_encode_buffer(), selected at startup from the host cpuinfo */
+extern xbzrle_encode_fn xbzrle_encode_accel;
+
+/*
+ * Switch xbzrle_encode_accel to the next slower implementation.
+ * Returns false if there is none; only used by tests and benchmarks.
+ */
+bool test_xbzrle_next_accel(void);
+
 #endif
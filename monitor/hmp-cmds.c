@@ -202,6 +202,19 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        monitor_printf(mon, "  io-uring-mode=%s\n",
+                       IOThreadIoUringMode_str(value->io_uring_mode));
+        if (value->io_uring_stats) {
+            IOThreadIoUringStats *stats = value->io_uring_stats;
+
+            monitor_printf(mon, "  io-uring-requests=%" PRIu64 "\n",
+                           stats->requests);
+            monitor_printf(mon, "  io-uring-avg-latency-ns=%" PRIu64 "\n",
+                           stats->requests ?
+                           stats->total_latency_ns / stats->requests : 0);
+            monitor_printf(mon, "  io-uring-max-latency-ns=%" PRIu64 "\n",
+                           stats->max_latency_ns);
+        }
     }
 
     qapi_free_IOThreadInfoList(info_list);
@@ -86,6 +86,7 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_STATS = 278,
 };
 
 typedef enum OutputFormat {
@@ -205,7 +206,10 @@ void help(void)
            "Parameters to convert subcommand:\n"
            "  '--bitmaps' copies all top-level persistent bitmaps to destination\n"
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
-           "       process (defaults to 8)\n"
+           "       process (defaults to 8), or 'auto' to adjust it to the observed\n"
+           "       request latency\n"
+           "  '--stats' prints the time taken and per-phase throughput at the end\n"
+           "       of the convert process\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
@@ -1664,9 +1668,40 @@ enum ImgConvertBlockStatus {
     BLK_BACKING_FILE,
 };
 
-#define MAX_COROUTINES 16
+#define MAX_COROUTINES 256
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
+/*
+ * With -m auto, the number of requests in flight starts at
+ * CONVERT_ADAPT_INITIAL and is re-evaluated every CONVERT_ADAPT_INTERVAL_NS.
+ * It is limited so that the buffers of all coroutines together stay
+ * within CONVERT_ADAPT_MAX_MEMORY.
+ */
+#define CONVERT_ADAPT_INITIAL 8
+#define CONVERT_ADAPT_INTERVAL_NS (100 * SCALE_MS)
+#define CONVERT_ADAPT_MAX_MEMORY (256 * MiB)
+
+enum ImgConvertPhase {
+    CONVERT_PHASE_READ,
+    CONVERT_PHASE_WRITE,
+    CONVERT_PHASE_ZERO,
+    CONVERT_PHASE_COPY_RANGE,
+    CONVERT_PHASE__MAX,
+};
+
+static const char *const convert_phase_names[CONVERT_PHASE__MAX] = {
+    [CONVERT_PHASE_READ]        = "read",
+    [CONVERT_PHASE_WRITE]       = "write",
+    [CONVERT_PHASE_ZERO]        = "zero",
+    [CONVERT_PHASE_COPY_RANGE]  = "copy-range",
+};
+
+typedef struct ImgConvertPhaseStats {
+    uint64_t requests;
+    uint64_t bytes;
+    int64_t busy_ns;    /* summed over all requests */
+} ImgConvertPhaseStats;
+
 typedef struct ImgConvertState {
     BlockBackend **src;
     int64_t *src_sectors;
@@ -1695,10 +1730,25 @@ typedef struct ImgConvertState {
     size_t buf_sectors;
     long num_coroutines;
     int running_coroutines;
-    Coroutine *co[MAX_COROUTINES];
-    int64_t wait_sector_num[MAX_COROUTINES];
+    Coroutine **co;
+    int64_t *wait_sector_num;
     CoMutex lock;
     int ret;
+
+    /* -m auto: number of coroutines that may run, up to num_coroutines */
+    bool adaptive;
+    int inflight_limit;
+    int inflight_limit_min;
+    int inflight_limit_max;
+    int64_t adapt_start_ns;
+    int64_t adapt_sectors;
+    int64_t adapt_latency_ns;
+    int64_t adapt_min_latency;  /* ns per sector */
+    int64_t adapt_last_rate;    /* sectors per second */
+
+    bool stats;
+    int64_t start_ns;
+    ImgConvertPhaseStats phase_stats[CONVERT_PHASE__MAX];
 } ImgConvertState;
 
 static void convert_select_part(ImgConvertState *s, int64_t sector_num,
@@ -1969,6 +2019,60 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
     return 0;
 }
 
+static void convert_account(ImgConvertState *s, enum ImgConvertPhase phase,
+                            int nb_sectors, int64_t start_ns)
+{
+    ImgConvertPhaseStats *ps = &s->phase_stats[phase];
+
+    ps->requests++;
+    ps->bytes += (uint64_t)nb_sectors << BDRV_SECTOR_BITS;
+    ps->busy_ns += get_clock() - start_ns;
+}
+
+/*
+ * Adjust the number of requests in flight once per interval.  The
+ * latency per sector of the requests completed in the interval is
+ * compared with the lowest one seen so far: as long as it has not
+ * doubled, the storage is not saturated and more requests are allowed.
+ * If it has, more requests only help if they still raise the throughput
+ * noticeably; otherwise they just queue up, so back off by a quarter.
+ */
+static void convert_adapt(ImgConvertState *s, int nb_sectors,
+                          int64_t latency_ns)
+{
+    int64_t now = get_clock();
+    int64_t elapsed = now - s->adapt_start_ns;
+    int64_t latency, rate;
+    int step;
+
+    s->adapt_sectors += nb_sectors;
+    s->adapt_latency_ns += latency_ns;
+    if (elapsed < CONVERT_ADAPT_INTERVAL_NS || !s->adapt_sectors) {
+        return;
+    }
+
+    latency = s->adapt_latency_ns / s->adapt_sectors;
+    rate = s->adapt_sectors * NANOSECONDS_PER_SECOND / elapsed;
+    if (!s->adapt_min_latency || latency < s->adapt_min_latency) {
+        s->adapt_min_latency = latency;
+    }
+
+    step = MAX(1, s->inflight_limit / 4);
+    if (latency <= 2 * s->adapt_min_latency ||
+        rate > s->adapt_last_rate + s->adapt_last_rate / 10) {
+        s->inflight_limit = MIN(s->inflight_limit + step, s->num_coroutines);
+    } else {
+        s->inflight_limit = MAX(s->inflight_limit - step, 1);
+    }
+    s->inflight_limit_min = MIN(s->inflight_limit_min, s->inflight_limit);
+    s->inflight_limit_max = MAX(s->inflight_limit_max, s->inflight_limit);
+
+    s->adapt_start_ns = now;
+    s->adapt_sectors = 0;
+    s->adapt_latency_ns = 0;
+    s->adapt_last_rate = rate;
+}
+
 static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
@@ -1990,9 +2094,15 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
     while (1) {
         int n;
         int64_t sector_num;
+        int64_t start_ns, latency_ns = 0;
         enum ImgConvertBlockStatus status;
         bool copy_range;
 
+        /* Leave if convert_adapt() lowered the limit */
+        if (s->running_coroutines > s->inflight_limit) {
+            break;
+        }
+
         qemu_co_mutex_lock(&s->lock);
         if (s->ret != -EINPROGRESS || s->sector_num >= s->total_sectors) {
             qemu_co_mutex_unlock(&s->lock);
@@ -2026,12 +2136,15 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
 retry:
         copy_range = s->copy_range && s->status == BLK_DATA;
         if (status == BLK_DATA && !copy_range) {
+            start_ns = get_clock();
             ret = convert_co_read(s, sector_num, n, buf);
             if (ret < 0) {
                 error_report("error while reading at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
                 s->ret = ret;
             }
+            convert_account(s, CONVERT_PHASE_READ, n, start_ns);
+            latency_ns += get_clock() - start_ns;
         } else if (!s->min_sparse && status == BLK_ZERO) {
             status = BLK_DATA;
             memset(buf, 0x00, n * BDRV_SECTOR_SIZE);
@@ -2047,6 +2160,7 @@ retry:
         }
 
         if (s->ret == -EINPROGRESS) {
+            start_ns = get_clock();
             if (copy_range) {
                 WITH_GRAPH_RDLOCK_GUARD() {
                     ret = convert_co_copy_range(s, sector_num, n);
@@ -2055,14 +2169,26 @@ retry:
                     s->copy_range = false;
                     goto retry;
                 }
+                convert_account(s, CONVERT_PHASE_COPY_RANGE, n, start_ns);
             } else {
                 ret = convert_co_write(s, sector_num, n, buf, status);
+                /* Nothing is written for these */
+                if (status != BLK_BACKING_FILE &&
+                    !(status == BLK_ZERO && s->has_zero_init)) {
+                    convert_account(s, status == BLK_DATA ?
+                                    CONVERT_PHASE_WRITE : CONVERT_PHASE_ZERO,
+                                    n, start_ns);
+                }
             }
             if (ret < 0) {
                 error_report("error while writing at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
                 s->ret = ret;
             }
+            latency_ns += get_clock() - start_ns;
+            if (s->adaptive) {
+                convert_adapt(s, n, latency_ns);
+            }
         }
 
         if (s->wr_in_order) {
@@ -2092,6 +2218,50 @@ retry:
     }
 }
 
+/* Start coroutines until inflight_limit of them run */
+static void convert_spawn_coroutines(ImgConvertState *s)
+{
+    int i;
+
+    for (i = 0; i < s->num_coroutines; i++) {
+        if (s->running_coroutines >= s->inflight_limit ||
+            s->ret != -EINPROGRESS || s->sector_num >= s->total_sectors) {
+            break;
+        }
+        if (!s->co[i]) {
+            s->co[i] = qemu_coroutine_create(convert_co_do_copy, s);
+            s->wait_sector_num[i] = -1;
+            qemu_coroutine_enter(s->co[i]);
+        }
+    }
+}
+
+static void convert_print_stats(ImgConvertState *s)
+{
+    int64_t elapsed = MAX(get_clock() - s->start_ns, 1);
+    int i;
+
+    printf("Elapsed time: %.3f s\n", (double)elapsed / NANOSECONDS_PER_SECOND);
+    for (i = 0; i < CONVERT_PHASE__MAX; i++) {
+        ImgConvertPhaseStats *ps = &s->phase_stats[i];
+
+        if (!ps->requests) {
+            continue;
+        }
+        printf("%-10s %8" PRIu64 " requests, %10.1f MiB, %8.1f MiB/s, "
+               "%8.3f ms average latency\n",
+               convert_phase_names[i], ps->requests,
+               (double)ps->bytes / MiB,
+               (double)ps->bytes / MiB * NANOSECONDS_PER_SECOND / elapsed,
+               (double)ps->busy_ns / ps->requests / SCALE_MS);
+    }
+    if (s->adaptive) {
+        printf("Requests in flight: %d to %d (limit %ld), finally %d\n",
+               s->inflight_limit_min, s->inflight_limit_max,
+               s->num_coroutines, s->inflight_limit);
+    }
+}
+
 static int convert_do_copy(ImgConvertState *s)
 {
     int ret, i, n;
@@ -2129,19 +2299,36 @@ static int convert_do_copy(ImgConvertState *s)
         sector_num += n;
     }
 
+    if (s->adaptive) {
+        /* Keep all buffers within the memory budget */
+        s->num_coroutines = MIN(MAX_COROUTINES,
+                                MAX(1, CONVERT_ADAPT_MAX_MEMORY /
+                                       (s->buf_sectors * BDRV_SECTOR_SIZE)));
+        s->inflight_limit = MIN(CONVERT_ADAPT_INITIAL, s->num_coroutines);
+    } else {
+        s->inflight_limit = s->num_coroutines;
+    }
+    s->inflight_limit_min = s->inflight_limit_max = s->inflight_limit;
+    s->co = g_new0(Coroutine *, s->num_coroutines);
+    s->wait_sector_num = g_new(int64_t, s->num_coroutines);
+
     /* Do the copy */
     s->sector_next_status = 0;
     s->ret = -EINPROGRESS;
+    s->start_ns = s->adapt_start_ns = get_clock();
 
     qemu_co_mutex_init(&s->lock);
-    for (i = 0; i < s->num_coroutines; i++) {
-        s->co[i] = qemu_coroutine_create(convert_co_do_copy, s);
-        s->wait_sector_num[i] = -1;
-        qemu_coroutine_enter(s->co[i]);
-    }
+    convert_spawn_coroutines(s);
 
     while (s->running_coroutines) {
         main_loop_wait(false);
+        convert_spawn_coroutines(s);
+    }
+
+    g_free(s->co);
+    g_free(s->wait_sector_num);
+    if (s->stats) {
+        convert_print_stats(s);
     }
 
     if (s->compressed && !s->ret) {
@@ -2275,6 +2462,7 @@ static int img_convert(int argc, char **argv)
             {"target-is-zero", no_argument, 0, OPTION_TARGET_IS_ZERO},
             {"bitmaps", no_argument, 0, OPTION_BITMAPS},
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
+            {"stats", no_argument, 0, OPTION_STATS},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
@@ -2364,12 +2552,18 @@ static int img_convert(int argc, char **argv)
             skip_create = true;
             break;
         case 'm':
+            if (!strcmp(optarg, "auto")) {
+                s.adaptive = true;
+                break;
+            }
             if (qemu_strtol(optarg, NULL, 0, &s.num_coroutines) ||
                 s.num_coroutines < 1 || s.num_coroutines > MAX_COROUTINES) {
                 error_report("Invalid number of coroutines. Allowed number of"
-                             " coroutines is between 1 and %d", MAX_COROUTINES);
+                             " coroutines is between 1 and %d, or 'auto'",
+                             MAX_COROUTINES);
                 goto fail_getopt;
             }
+            s.adaptive = false;
             break;
         case 'W':
             s.wr_in_order = false;
@@ -2409,6 +2603,9 @@ static int img_convert(int argc, char **argv)
         case OPTION_SKIP_BROKEN:
             skip_broken = true;
             break;
+        case OPTION_STATS:
+            s.stats = true;
+            break;
         }
     }
 
@@ -187,7 +187,10 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
-    "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                superblock-threshold=n (TCG superblock hotness threshold, default 0)\n"
+    "                superblock-profile=file (remember TCG superblocks across runs)\n"
+    "                jmp-cache-bits=n (log2 of the minimum TCG jump cache size, default 12)\n"
+    "                dirty-ring-size=n (KVM dirty ring GFN count, TCG dirty page ring size, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n"
@@ -230,6 +233,36 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``superblock-threshold=n``
+        Makes the TCG accelerator retranslate a translation block as a
+        superblock once it has been executed n times.  A superblock
+        follows direct jumps within its page instead of ending at them,
+        so that the code on both sides of the jump is optimized
+        together, and hot loops are unrolled.  Until it reaches the
+        threshold, a translation block is not chained to, which makes it
+        slower to run.  Only some guest architectures (currently
+        AArch64) form superblocks.  0 (the default) disables it.
+
+    ``superblock-profile=file``
+        With ``superblock-threshold``, records in file which translation
+        blocks became superblocks.  Later runs of the same guest with the
+        same file translate these blocks as superblocks the first time
+        they run, without profiling them, which helps short-lived runs of
+        the same code.  The file is created if needed, and is ignored if
+        it was written for another target or CPU model.  Several QEMU
+        processes can share it.  Without ``superblock-threshold`` the
+        file is only read: the blocks listed in it still become
+        superblocks, but no other block does.
+
+    ``jmp-cache-bits=n``
+        Sets the initial size of the per-vCPU cache that TCG uses to find
+        the translation block for a guest address, to 2^n entries (8 to
+        16, 12 by default).  The cache grows when guest code does not fit
+        in it, and shrinks back to this size when it is mostly unused.
+        Its size, and the number of misses and of misses that evicted
+        another translation block, are reported by ``info jit`` and by
+        ``query-stats``.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -248,6 +281,15 @@ SRST
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
         record dirty pages in a bitmap.
 
+        When the TCG accelerator is used, it sets the number of entries of
+        a per-vCPU ring where the pages written by the vCPU are logged
+        during live migration.  Migration then only has to look at the
+        logged pages instead of scanning the whole dirty bitmap at every
+        sync, which helps guests with a lot of memory.  If a ring fills up
+        between two syncs, the next sync scans the whole bitmap.  It must
+        be a power of two between 1024 and 65536; 0 (the default)
+        disables it.
+
     ``eager-split-size=n``
         KVM implements dirty page logging at the PAGE_SIZE granularity and
         enabling dirty-logging on a huge-page requires breaking it into
@@ -6032,7 +6074,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch,io-uring-mode=default|sqpoll|defer-taskrun``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -6072,7 +6114,18 @@ SRST
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
 
-        The IOThread parameters can be modified at run-time using the
+        The ``io-uring-mode`` parameter selects how the IOThread sets up
+        the io_uring used by ``aio=io_uring`` block devices. ``sqpoll``
+        lets a kernel thread poll for submitted requests so that a busy
+        IOThread does not need system calls to submit I/O.
+        ``defer-taskrun`` restricts
+        submission to the IOThread and batches completion processing
+        until the IOThread waits for events. It cannot be changed after
+        the IOThread has been created. The ``query-iothreads`` QMP
+        command reports request and latency counters for the io_uring
+        block I/O engine so the modes can be compared.
+
+        The other IOThread parameters can be modified at run-time using the
         ``qom-set`` command (where ``iothread1`` is the IOThread's
         ``id``):
 
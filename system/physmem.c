@@ -22,10 +22,14 @@
 #include "qapi/error.h"
 
 #include "qemu/cutils.h"
+#include "qemu/bounce-pool.h"
 #include "qemu/cacheflush.h"
 #include "qemu/hbitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/lockable.h"
+#include "qemu/host-utils.h"
+#include "qemu/stats64.h"
+#include "qemu/units.h"
 
 #ifdef CONFIG_TCG
 #include "hw/core/tcg-cpu-ops.h"
@@ -131,6 +135,8 @@ typedef struct PhysPageMap {
 
 struct AddressSpaceDispatch {
     MemoryRegionSection *mru_section;
+    /* Unique for each dispatch, tags entries in phys_section_cache */
+    uint64_t gen;
     /* This is a multi-level map on the physical address space.
      * The bottom level has pointers to MemoryRegionSections.
      */
@@ -334,18 +340,71 @@ static MemoryRegionSection *phys_page_find(AddressSpaceDispatch *d, hwaddr addr)
     }
 }
 
+/*
+ * mru_section is shared by all threads that access an address space, so
+ * vCPUs and IOThreads touching different regions keep replacing each
+ * other's entry.  Each thread therefore also remembers the last few
+ * sections it found.  Entries are tagged with the generation of the
+ * dispatch they come from; generations are never reused, so an entry
+ * can only match while its dispatch, and thus the section, is alive.
+ */
+#define PHYS_SECTION_CACHE_SIZE 4
+
+typedef struct PhysSectionCache {
+    struct {
+        uint64_t gen;
+        MemoryRegionSection *section;
+    } entries[PHYS_SECTION_CACHE_SIZE];
+    unsigned next;
+} PhysSectionCache;
+
+static __thread PhysSectionCache phys_section_cache;
+
+/* Called from RCU critical section */
+static MemoryRegionSection *phys_section_cache_find(AddressSpaceDispatch *d,
+                                                    hwaddr addr)
+{
+    PhysSectionCache *cache = &phys_section_cache;
+    int i;
+
+    for (i = 0; i < PHYS_SECTION_CACHE_SIZE; i++) {
+        if (cache->entries[i].gen == d->gen &&
+            section_covers_addr(cache->entries[i].section, addr)) {
+            return cache->entries[i].section;
+        }
+    }
+    return NULL;
+}
+
+static void phys_section_cache_insert(AddressSpaceDispatch *d,
+                                      MemoryRegionSection *section)
+{
+    PhysSectionCache *cache = &phys_section_cache;
+    unsigned i = cache->next++ % PHYS_SECTION_CACHE_SIZE;
+
+    cache->entries[i].gen = d->gen;
+    cache->entries[i].section = section;
+}
+
 /* Called from RCU critical section */
 static MemoryRegionSection *address_space_lookup_region(AddressSpaceDispatch *d,
                                                         hwaddr addr,
                                                         bool resolve_subpage)
 {
-    MemoryRegionSection *section = qatomic_read(&d->mru_section);
+    MemoryRegionSection *section = phys_section_cache_find(d, addr);
     subpage_t *subpage;
 
-    if (!section || section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
-        !section_covers_addr(section, addr)) {
-        section = phys_page_find(d, addr);
-        qatomic_set(&d->mru_section, section);
+    if (!section) {
+        section = qatomic_read(&d->mru_section);
+        if (!section || section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
+            !section_covers_addr(section, addr)) {
+            section = phys_page_find(d, addr);
+            qatomic_set(&d->mru_section, section);
+        }
+        /* The unassigned section covers everything, never cache it */
+        if (section != &d->map.sections[PHYS_SECTION_UNASSIGNED]) {
+            phys_section_cache_insert(d, section);
+        }
     }
     if (resolve_subpage && section->mr->subpage) {
         subpage = container_of(section->mr, subpage_t, iomem);
@@ -919,6 +978,312 @@ bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
     return dirty;
 }
 
+typedef struct DirtyRingEntry {
+    ram_addr_t start;
+    ram_addr_t length;
+} DirtyRingEntry;
+
+/*
+ * Single producer, single consumer ring.  @head is only written by the
+ * producer and @tail only by the consumer (the migration thread), both
+ * are free running and wrap at @size, which is a power of two.
+ */
+struct DirtyRing {
+    struct rcu_head rcu;
+    uint32_t size;
+    uint32_t head;
+    uint32_t tail;
+    DirtyRingEntry entries[];
+};
+
+/* Ring for writers that are not a vCPU with its own ring */
+#define DIRTY_RING_SHARED_SIZE 4096
+
+bool dirty_ring_enabled;
+/* Some dirty pages were not logged, the next harvest must fail */
+static bool dirty_ring_overflowed;
+static QemuMutex dirty_ring_shared_lock;
+static DirtyRing *dirty_ring_shared;
+
+DirtyRing *cpu_physical_memory_dirty_ring_new(uint32_t size)
+{
+    DirtyRing *ring;
+
+    assert(is_power_of_2(size));
+    ring = g_malloc0(sizeof(*ring) + size * sizeof(DirtyRingEntry));
+    ring->size = size;
+
+    return ring;
+}
+
+/*
+ * Pages still logged in @ring keep their dirty bits set, so no writer
+ * will log them again; make the next harvest fail so that the bitmap
+ * scan finds them.
+ */
+void cpu_physical_memory_dirty_ring_free(DirtyRing *ring)
+{
+    if (ring) {
+        if (qatomic_read(&ring->head) != qatomic_load_acquire(&ring->tail)) {
+            cpu_physical_memory_dirty_ring_overflow();
+        }
+        g_free_rcu(ring, rcu);
+    }
+}
+
+static bool dirty_ring_push(DirtyRing *ring, ram_addr_t start,
+                            ram_addr_t length)
+{
+    uint32_t head = ring->head;
+
+    if (head - qatomic_load_acquire(&ring->tail) >= ring->size) {
+        return false;
+    }
+
+    ring->entries[head & (ring->size - 1)] = (DirtyRingEntry) {
+        .start = start,
+        .length = length,
+    };
+    /* Publish the entry before the new head */
+    qatomic_store_release(&ring->head, head + 1);
+
+    return true;
+}
+
+void cpu_physical_memory_dirty_ring_overflow(void)
+{
+    qatomic_set(&dirty_ring_overflowed, true);
+}
+
+void cpu_physical_memory_dirty_ring_push(ram_addr_t start, ram_addr_t length)
+{
+    DirtyRing *ring = current_cpu ? qatomic_rcu_read(&current_cpu->dirty_ring)
+                                  : NULL;
+    bool pushed;
+
+    if (ring) {
+        pushed = dirty_ring_push(ring, start, length);
+    } else {
+        WITH_QEMU_LOCK_GUARD(&dirty_ring_shared_lock) {
+            pushed = dirty_ring_push(dirty_ring_shared, start, length);
+        }
+    }
+
+    if (!pushed) {
+        trace_dirty_ring_overflow(start, length);
+        cpu_physical_memory_dirty_ring_overflow();
+    }
+}
+
+/*
+ * Enable the dirty rings if at least one vCPU has one.  The first
+ * harvest afterwards always fails, since pages dirtied before the
+ * rings were enabled have not been logged.
+ */
+bool cpu_physical_memory_dirty_ring_start(void)
+{
+    CPUState *cpu;
+    bool found = false;
+
+    RCU_READ_LOCK_GUARD();
+
+    CPU_FOREACH(cpu) {
+        DirtyRing *ring = qatomic_rcu_read(&cpu->dirty_ring);
+
+        if (ring) {
+            /* Drop entries left over from a previous migration */
+            qatomic_store_release(&ring->tail, qatomic_read(&ring->head));
+            found = true;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    if (!dirty_ring_shared) {
+        qemu_mutex_init(&dirty_ring_shared_lock);
+        dirty_ring_shared =
+            cpu_physical_memory_dirty_ring_new(DIRTY_RING_SHARED_SIZE);
+    }
+    WITH_QEMU_LOCK_GUARD(&dirty_ring_shared_lock) {
+        dirty_ring_shared->tail = dirty_ring_shared->head;
+    }
+
+    qatomic_set(&dirty_ring_overflowed, true);
+    qatomic_store_release(&dirty_ring_enabled, true);
+
+    return true;
+}
+
+void cpu_physical_memory_dirty_ring_stop(void)
+{
+    qatomic_set(&dirty_ring_enabled, false);
+}
+
+/* Called from RCU critical section */
+static RAMBlock *dirty_ring_find_block(ram_addr_t addr)
+{
+    RAMBlock *block;
+
+    block = qatomic_rcu_read(&ram_list.mru_block);
+    if (block && addr - block->offset < block->used_length) {
+        return block;
+    }
+    RAMBLOCK_FOREACH(block) {
+        if (addr - block->offset < block->used_length) {
+            return block;
+        }
+    }
+
+    /* The block may have been removed since the range was logged */
+    return NULL;
+}
+
+/* Range of each RAMBlock whose TLB entries must be made notdirty again */
+#define DIRTY_RING_RESET_SLOTS 8
+
+typedef struct DirtyRingReset {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t end;
+} DirtyRingReset;
+
+static void dirty_ring_reset_flush(DirtyRingReset *reset)
+{
+    int i;
+
+    for (i = 0; i < DIRTY_RING_RESET_SLOTS && reset[i].block; i++) {
+        cpu_physical_memory_dirty_bits_cleared(reset[i].start,
+                                               reset[i].end - reset[i].start);
+        reset[i].block = NULL;
+    }
+}
+
+static void dirty_ring_reset_add(DirtyRingReset *reset, RAMBlock *block,
+                                 ram_addr_t start, ram_addr_t end)
+{
+    int i;
+
+    for (i = 0; i < DIRTY_RING_RESET_SLOTS && reset[i].block; i++) {
+        if (reset[i].block == block) {
+            reset[i].start = MIN(reset[i].start, start);
+            reset[i].end = MAX(reset[i].end, end);
+            return;
+        }
+    }
+
+    if (i == DIRTY_RING_RESET_SLOTS) {
+        dirty_ring_reset_flush(reset);
+        i = 0;
+    }
+    reset[i] = (DirtyRingReset) {
+        .block = block,
+        .start = start,
+        .end = end,
+    };
+}
+
+/* Called from RCU critical section */
+static void dirty_ring_harvest_entry(DirtyRingEntry *entry,
+                                     DirtyMemoryBlocks *blocks,
+                                     DirtyRingReset *reset,
+                                     DirtyRingHarvestFunc *fn, void *opaque)
+{
+    RAMBlock *block = dirty_ring_find_block(entry->start);
+    ram_addr_t block_end, start, end, addr;
+    bool dirty = false;
+
+    if (!block) {
+        return;
+    }
+
+    block_end = block->offset + block->used_length;
+    start = entry->start & TARGET_PAGE_MASK;
+    end = MIN(TARGET_PAGE_ALIGN(entry->start + entry->length), block_end);
+
+    for (addr = start; addr < end; addr += TARGET_PAGE_SIZE) {
+        unsigned long page = addr >> TARGET_PAGE_BITS;
+        unsigned long idx = page / DIRTY_MEMORY_BLOCK_SIZE;
+        unsigned long offset = page % DIRTY_MEMORY_BLOCK_SIZE;
+
+        if (bitmap_test_and_clear_atomic(blocks->blocks[idx], offset, 1)) {
+            fn(block, addr - block->offset, opaque);
+            dirty = true;
+        }
+    }
+
+    if (dirty) {
+        dirty_ring_reset_add(reset, block, start, end);
+    }
+}
+
+/* Called from RCU critical section */
+static void dirty_ring_drain(DirtyRing *ring, DirtyMemoryBlocks *blocks,
+                             DirtyRingReset *reset,
+                             DirtyRingHarvestFunc *fn, void *opaque)
+{
+    uint32_t head = qatomic_load_acquire(&ring->head);
+    uint32_t tail = ring->tail;
+
+    for (; tail != head; tail++) {
+        if (fn) {
+            dirty_ring_harvest_entry(&ring->entries[tail & (ring->size - 1)],
+                                     blocks, reset, fn, opaque);
+        }
+    }
+
+    /* Release the entries only once we are done reading them */
+    qatomic_store_release(&ring->tail, tail);
+}
+
+/*
+ * Collect the pages logged in the dirty rings: clear them from the
+ * DIRTY_MEMORY_MIGRATION bitmap and call @fn for each page that was
+ * still dirty.
+ *
+ * Returns false if some dirty pages might not have been logged, in
+ * which case the rings are emptied without calling @fn, and the caller
+ * must scan the whole bitmap instead.  Because writers set the bitmap
+ * before logging the range, a page whose entry is dropped here is
+ * always seen by that scan.
+ *
+ * Called from RCU critical section.
+ */
+bool cpu_physical_memory_dirty_ring_harvest(DirtyRingHarvestFunc *fn,
+                                            void *opaque)
+{
+    DirtyRingReset reset[DIRTY_RING_RESET_SLOTS] = {};
+    DirtyMemoryBlocks *blocks;
+    CPUState *cpu;
+
+    if (!qatomic_read(&dirty_ring_enabled)) {
+        return false;
+    }
+
+    if (qatomic_xchg(&dirty_ring_overflowed, false)) {
+        fn = NULL;
+    }
+
+    blocks = qatomic_rcu_read(&ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION]);
+
+    CPU_FOREACH(cpu) {
+        DirtyRing *ring = qatomic_rcu_read(&cpu->dirty_ring);
+
+        if (ring) {
+            dirty_ring_drain(ring, blocks, reset, fn, opaque);
+        }
+    }
+
+    WITH_QEMU_LOCK_GUARD(&dirty_ring_shared_lock) {
+        dirty_ring_drain(dirty_ring_shared, blocks, reset, fn, opaque);
+    }
+
+    dirty_ring_reset_flush(reset);
+
+    return fn != NULL;
+}
+
 DirtyBitmapSnapshot *cpu_physical_memory_snapshot_and_clear_dirty
     (MemoryRegion *mr, hwaddr offset, hwaddr length, unsigned client)
 {
@@ -2528,9 +2893,13 @@ static void io_mem_init(void)
 
 AddressSpaceDispatch *address_space_dispatch_new(FlatView *fv)
 {
+    /* Protected by the BQL, as is any memory topology update. */
+    static uint64_t next_gen = 1;
     AddressSpaceDispatch *d = g_new0(AddressSpaceDispatch, 1);
     uint16_t n;
 
+    d->gen = next_gen++;
+
     n = dummy_section(&d->map, fv, &io_mem_unassigned);
     assert(n == PHYS_SECTION_UNASSIGNED);
 
@@ -3079,12 +3448,13 @@ void cpu_flush_icache_range(hwaddr start, hwaddr len)
 }
 
 /*
- * A magic value stored in the first 8 bytes of the bounce buffer struct. Used
- * to detect illegal pointers passed to address_space_unmap.
+ * A magic value stored in the bounce buffer struct. Used to detect illegal
+ * pointers passed to address_space_unmap.
  */
 #define BOUNCE_BUFFER_MAGIC 0xb4017ceb4ffe12ed
 
-typedef struct {
+typedef struct BounceBuffer {
+    BouncePoolEntry pool;
     uint64_t magic;
     MemoryRegion *mr;
     hwaddr addr;
@@ -3092,6 +3462,57 @@ typedef struct {
     uint8_t buffer[];
 } BounceBuffer;
 
+static struct {
+    Stat64 maps;
+    Stat64 pool_hits;
+    Stat64 failed;
+    Stat64 bytes;
+} bounce_stats;
+
+static BounceBuffer *bounce_buffer_get(size_t len)
+{
+    int size_class = bounce_pool_size_class(len);
+    BounceBuffer *bounce;
+
+    if (size_class < 0) {
+        bounce = g_malloc(sizeof(BounceBuffer) + len);
+    } else {
+        bounce = (BounceBuffer *)bounce_pool_get(size_class);
+        if (bounce) {
+            stat64_add(&bounce_stats.pool_hits, 1);
+        } else {
+            bounce = g_malloc(sizeof(BounceBuffer) +
+                              bounce_pool_class_size(size_class));
+        }
+    }
+    bounce->pool.size_class = size_class;
+    return bounce;
+}
+
+static void bounce_buffer_put(BounceBuffer *bounce)
+{
+    if (!bounce_pool_put(&bounce->pool)) {
+        g_free(bounce);
+    }
+}
+
+GString *bounce_buffer_format(void)
+{
+    GString *buf = g_string_new("");
+    uint64_t maps = stat64_get(&bounce_stats.maps);
+    uint64_t hits = stat64_get(&bounce_stats.pool_hits);
+
+    g_string_append_printf(buf, "Bounce buffer mappings: %" PRIu64 "\n", maps);
+    g_string_append_printf(buf, "  reused from pool:     %" PRIu64 "\n", hits);
+    g_string_append_printf(buf, "  newly allocated:      %" PRIu64 "\n",
+                           maps - hits);
+    g_string_append_printf(buf, "  failed (limit):       %" PRIu64 "\n",
+                           stat64_get(&bounce_stats.failed));
+    g_string_append_printf(buf, "Bytes mapped:           %" PRIu64 "\n",
+                           stat64_get(&bounce_stats.bytes));
+    return buf;
+}
+
 static void
 address_space_unregister_map_client_do(AddressSpaceMapClient *client)
 {
@@ -3262,17 +3683,25 @@ void *address_space_map(AddressSpace *as,
         }
 
         if (l == 0) {
+            stat64_add(&bounce_stats.failed, 1);
             *plen = 0;
             return NULL;
         }
 
-        BounceBuffer *bounce = g_malloc0(l + sizeof(BounceBuffer));
+        BounceBuffer *bounce = bounce_buffer_get(l);
+        stat64_add(&bounce_stats.maps, 1);
+        stat64_add(&bounce_stats.bytes, l);
         bounce->magic = BOUNCE_BUFFER_MAGIC;
         memory_region_ref(mr);
         bounce->mr = mr;
         bounce->addr = addr;
         bounce->len = l;
 
+        /*
+         * Recycled buffers hold stale data.  Clear them in both directions:
+         * flatview_read() leaves the buffer untouched where it fails.
+         */
+        memset(bounce->buffer, 0, l);
         if (!is_write) {
             flatview_read(fv, addr, attrs,
                           bounce->buffer, l);
@@ -3323,10 +3752,16 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
     qatomic_sub(&as->bounce_buffer_size, bounce->len);
     bounce->magic = ~BOUNCE_BUFFER_MAGIC;
     memory_region_unref(bounce->mr);
-    g_free(bounce);
+    bounce_buffer_put(bounce);
     /* Write bounce_buffer_size before reading map_client_list. */
     smp_mb();
-    address_space_notify_map_clients(as);
+    /*
+     * Only take the lock if someone waits; see the matching barrier in
+     * address_space_register_map_client().
+     */
+    if (!QLIST_EMPTY_RCU(&as->map_client_list)) {
+        address_space_notify_map_clients(as);
+    }
 }
 
 void *cpu_physical_memory_map(hwaddr addr,
@@ -491,7 +491,8 @@ static inline bool use_goto_tb(DisasContext *s, uint64_t dest)
 
 static void gen_goto_tb(DisasContext *s, int n, int64_t diff)
 {
-    if (use_goto_tb(s, s->pc_curr + diff)) {
+    if (use_goto_tb(s, s->pc_curr + diff) && !(s->goto_tb_used & (1 << n))) {
+        s->goto_tb_used |= 1 << n;
         /*
          * For pcrel, the pc must always be up-to-date on entry to
          * the linked TB, so that it can use simple additions for all
@@ -1446,10 +1447,58 @@ static inline AArch64DecodeFn *lookup_disas_fn(const AArch64DecodeTable *table,
  * match up with those in the manual.
  */
 
+/*
+ * In a superblock, continue translating at pc_curr + diff instead of
+ * ending the TB with a branch there.
+ */
+static bool follow_branch(DisasContext *s, int64_t diff)
+{
+    return !s->ss_active &&
+           translator_follow_jump(&s->base, s->pc_curr + diff);
+}
+
+/*
+ * Pick the path of a conditional branch to pc_curr + diff that a
+ * superblock goes on with: the taken path of a backward branch, which
+ * likely closes a loop, and the fall-through path otherwise.  Return
+ * true for the fall-through path, in which case the caller branches to
+ * the label given to gen_cond_goto_tb() when the condition is false.
+ */
+static bool follow_cond_fallthrough(DisasContext *s, int64_t diff)
+{
+    return diff > 0 && follow_branch(s, 4);
+}
+
+/*
+ * Emit the exits of a conditional branch to pc_curr + diff, after the
+ * code that branches to @match when the branch is taken, or not taken
+ * when @fallthrough.
+ */
+static void gen_cond_goto_tb(DisasContext *s, DisasLabel match,
+                             int64_t diff, bool fallthrough)
+{
+    if (fallthrough) {
+        gen_goto_tb(s, 1, diff);
+        set_disas_label(s, match);
+        s->base.is_jmp = DISAS_NEXT;
+        return;
+    }
+
+    gen_goto_tb(s, 0, 4);
+    set_disas_label(s, match);
+    if (diff <= 0 && follow_branch(s, diff)) {
+        s->base.is_jmp = DISAS_NEXT;
+    } else {
+        gen_goto_tb(s, 1, diff);
+    }
+}
+
 static bool trans_B(DisasContext *s, arg_i *a)
 {
     reset_btype(s);
-    gen_goto_tb(s, 0, a->imm);
+    if (!follow_branch(s, a->imm)) {
+        gen_goto_tb(s, 0, a->imm);
+    }
     return true;
 }
 
@@ -1457,7 +1506,9 @@ static bool trans_BL(DisasContext *s, arg_i *a)
 {
     gen_pc_plus_diff(s, cpu_reg(s, 30), curr_insn_len(s));
     reset_btype(s);
-    gen_goto_tb(s, 0, a->imm);
+    if (!follow_branch(s, a->imm)) {
+        gen_goto_tb(s, 0, a->imm);
+    }
     return true;
 }
 
@@ -1466,16 +1517,16 @@ static bool trans_CBZ(DisasContext *s, arg_cbz *a)
 {
     DisasLabel match;
     TCGv_i64 tcg_cmp;
+    bool next;
 
     tcg_cmp = read_cpu_reg(s, a->rt, a->sf);
     reset_btype(s);
 
+    next = follow_cond_fallthrough(s, a->imm);
     match = gen_disas_label(s);
-    tcg_gen_brcondi_i64(a->nz ? TCG_COND_NE : TCG_COND_EQ,
+    tcg_gen_brcondi_i64(a->nz ^ next ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, match.label);
-    gen_goto_tb(s, 0, 4);
-    set_disas_label(s, match);
-    gen_goto_tb(s, 1, a->imm);
+    gen_cond_goto_tb(s, match, a->imm, next);
     return true;
 }
 
@@ -1483,18 +1534,18 @@ static bool trans_TBZ(DisasContext *s, arg_tbz *a)
 {
     DisasLabel match;
     TCGv_i64 tcg_cmp;
+    bool next;
 
     tcg_cmp = tcg_temp_new_i64();
     tcg_gen_andi_i64(tcg_cmp, cpu_reg(s, a->rt), 1ULL << a->bitpos);
 
     reset_btype(s);
 
+    next = follow_cond_fallthrough(s, a->imm);
     match = gen_disas_label(s);
-    tcg_gen_brcondi_i64(a->nz ? TCG_COND_NE : TCG_COND_EQ,
+    tcg_gen_brcondi_i64(a->nz ^ next ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, match.label);
-    gen_goto_tb(s, 0, 4);
-    set_disas_label(s, match);
-    gen_goto_tb(s, 1, a->imm);
+    gen_cond_goto_tb(s, match, a->imm, next);
     return true;
 }
 
@@ -1507,12 +1558,11 @@ static bool trans_B_cond(DisasContext *s, arg_B_cond *a)
     reset_btype(s);
     if (a->cond < 0x0e) {
         /* genuinely conditional branches */
+        bool next = follow_cond_fallthrough(s, a->imm);
         DisasLabel match = gen_disas_label(s);
-        arm_gen_test_cc(a->cond, match.label);
-        gen_goto_tb(s, 0, 4);
-        set_disas_label(s, match);
-        gen_goto_tb(s, 1, a->imm);
-    } else {
+        arm_gen_test_cc(a->cond ^ next, match.label);
+        gen_cond_goto_tb(s, match, a->imm, next);
+    } else if (!follow_branch(s, a->imm)) {
         /* 0xe and 0xf are both "always" conditions */
         gen_goto_tb(s, 0, a->imm);
     }
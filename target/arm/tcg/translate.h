@@ -105,6 +105,11 @@ typedef struct DisasContext {
      */
     bool ss_active;
     bool pstate_ss;
+    /*
+     * goto_tb slots already used in this TB.  A superblock can have
+     * more exits than slots; the extra ones use lookup_and_goto_ptr.
+     */
+    uint8_t goto_tb_used;
     /* True if the insn just emitted was a load-exclusive instruction
      * (necessary for syndrome information for single step exceptions),
      * ie A64 LDX*, LDAX*, A32/T32 LDREX*, LDAEX*.
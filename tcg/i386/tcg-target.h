@@ -204,6 +204,15 @@ typedef enum {
 #define TCG_TARGET_HAS_v64              have_avx1
 #define TCG_TARGET_HAS_v128             have_avx1
 #define TCG_TARGET_HAS_v256             have_avx2
+/*
+ * Only offer 512-bit vectors when every element size can be handled
+ * with EVEX encodings, and only on 64-bit hosts.  AVX512VL is needed
+ * too: without it, cmpsel and 64-bit arithmetic shifts are expanded
+ * with VPBLENDVB and VPBLENDD, which have no 512-bit form.
+ */
+#define TCG_TARGET_HAS_v512 \
+    (TCG_TARGET_REG_BITS == 64 && have_avx512bw && have_avx512dq && \
+     have_avx512vl)
 
 #define TCG_TARGET_HAS_andc_vec         1
 #define TCG_TARGET_HAS_orc_vec          have_avx512vl
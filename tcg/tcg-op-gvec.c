@@ -442,7 +442,22 @@ static TCGType choose_vector_type(const TCGOpcode *list, unsigned vece,
      * It is hard to imagine a case in which v256 is supported
      * but v128 is not, but check anyway.
      * In addition, expand_clr needs to handle a multiple of 8.
+     * Likewise, v512 needs each of the smaller types for the tail.
      */
+    if (TCG_TARGET_HAS_v512 &&
+        check_size_impl(size, 64) &&
+        tcg_can_emit_vecop_list(list, TCG_TYPE_V512, vece) &&
+        (!(size & 32) ||
+         (TCG_TARGET_HAS_v256 &&
+          tcg_can_emit_vecop_list(list, TCG_TYPE_V256, vece))) &&
+        (!(size & 16) ||
+         (TCG_TARGET_HAS_v128 &&
+          tcg_can_emit_vecop_list(list, TCG_TYPE_V128, vece))) &&
+        (!(size & 8) ||
+         (TCG_TARGET_HAS_v64 &&
+          tcg_can_emit_vecop_list(list, TCG_TYPE_V64, vece)))) {
+        return TCG_TYPE_V512;
+    }
     if (TCG_TARGET_HAS_v256 &&
         check_size_impl(size, 32) &&
         tcg_can_emit_vecop_list(list, TCG_TYPE_V256, vece) &&
@@ -487,6 +502,11 @@ static void do_dup_store(TCGType type, uint32_t dofs, uint32_t oprsz,
     }
 
     switch (type) {
+    case TCG_TYPE_V512:
+        for (; i + 64 <= oprsz; i += 64) {
+            tcg_gen_stl_vec(t_vec, tcg_env, dofs + i, TCG_TYPE_V512);
+        }
+        /* fallthru */
     case TCG_TYPE_V256:
         /*
          * Recall that ARM SVE allows vector sizes that are not a
@@ -1198,6 +1218,18 @@ void tcg_gen_gvec_2(uint32_t dofs, uint32_t aofs,
         type = choose_vector_type(g->opt_opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_2_vec(g->vece, dofs, aofs, some, 64, TCG_TYPE_V512,
+                     g->load_dest, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -1262,6 +1294,18 @@ void tcg_gen_gvec_2i(uint32_t dofs, uint32_t aofs, uint32_t oprsz,
         type = choose_vector_type(g->opt_opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_2i_vec(g->vece, dofs, aofs, some, 64, TCG_TYPE_V512,
+                      c, g->load_dest, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -1336,6 +1380,18 @@ void tcg_gen_gvec_2s(uint32_t dofs, uint32_t aofs, uint32_t oprsz,
         tcg_gen_dup_i64_vec(g->vece, t_vec, c);
 
         switch (type) {
+        case TCG_TYPE_V512:
+            some = QEMU_ALIGN_DOWN(oprsz, 64);
+            expand_2s_vec(g->vece, dofs, aofs, some, 64, TCG_TYPE_V512,
+                          t_vec, g->scalar_first, g->fniv);
+            if (some == oprsz) {
+                break;
+            }
+            dofs += some;
+            aofs += some;
+            oprsz -= some;
+            maxsz -= some;
+            /* fallthru */
         case TCG_TYPE_V256:
             /* Recall that ARM SVE allows vector sizes that are not a
              * power of 2, but always a multiple of 16.  The intent is
@@ -1408,6 +1464,19 @@ void tcg_gen_gvec_3(uint32_t dofs, uint32_t aofs, uint32_t bofs,
         type = choose_vector_type(g->opt_opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_3_vec(g->vece, dofs, aofs, bofs, some, 64, TCG_TYPE_V512,
+                     g->load_dest, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -1475,6 +1544,19 @@ void tcg_gen_gvec_3i(uint32_t dofs, uint32_t aofs, uint32_t bofs,
         type = choose_vector_type(g->opt_opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_3i_vec(g->vece, dofs, aofs, bofs, some, 64, TCG_TYPE_V512,
+                      c, g->load_dest, g->write_aofs, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /*
          * Recall that ARM SVE allows vector sizes that are not a
@@ -1543,6 +1625,20 @@ void tcg_gen_gvec_4(uint32_t dofs, uint32_t aofs, uint32_t bofs, uint32_t cofs,
         type = choose_vector_type(g->opt_opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_4_vec(g->vece, dofs, aofs, bofs, cofs, some,
+                     64, TCG_TYPE_V512, g->write_aofs, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        cofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -1613,6 +1709,20 @@ void tcg_gen_gvec_4i(uint32_t dofs, uint32_t aofs, uint32_t bofs, uint32_t cofs,
         type = choose_vector_type(g->opt_opc, g->vece, oprsz, g->prefer_i64);
     }
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_4i_vec(g->vece, dofs, aofs, bofs, cofs, some,
+                      64, TCG_TYPE_V512, c, g->fniv);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        cofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /*
          * Recall that ARM SVE allows vector sizes that are not a
@@ -3142,6 +3252,18 @@ do_gvec_shifts(unsigned vece, uint32_t dofs, uint32_t aofs, TCGv_i32 shift,
     if (type) {
         const TCGOpcode *hold_list = tcg_swap_vecop_list(NULL);
         switch (type) {
+        case TCG_TYPE_V512:
+            some = QEMU_ALIGN_DOWN(oprsz, 64);
+            expand_2sh_vec(vece, dofs, aofs, some, 64,
+                           TCG_TYPE_V512, shift, g->fniv_s);
+            if (some == oprsz) {
+                break;
+            }
+            dofs += some;
+            aofs += some;
+            oprsz -= some;
+            maxsz -= some;
+            /* fallthru */
         case TCG_TYPE_V256:
             some = QEMU_ALIGN_DOWN(oprsz, 32);
             expand_2sh_vec(vece, dofs, aofs, some, 32,
@@ -3185,6 +3307,18 @@ do_gvec_shifts(unsigned vece, uint32_t dofs, uint32_t aofs, TCGv_i32 shift,
         }
 
         switch (type) {
+        case TCG_TYPE_V512:
+            some = QEMU_ALIGN_DOWN(oprsz, 64);
+            expand_2s_vec(vece, dofs, aofs, some, 64, TCG_TYPE_V512,
+                          v_shift, false, g->fniv_v);
+            if (some == oprsz) {
+                break;
+            }
+            dofs += some;
+            aofs += some;
+            oprsz -= some;
+            maxsz -= some;
+            /* fallthru */
         case TCG_TYPE_V256:
             some = QEMU_ALIGN_DOWN(oprsz, 32);
             expand_2s_vec(vece, dofs, aofs, some, 32, TCG_TYPE_V256,
@@ -3771,6 +3905,18 @@ void tcg_gen_gvec_cmp(TCGCond cond, unsigned vece, uint32_t dofs,
     type = choose_vector_type(cmp_list, vece, oprsz,
                               TCG_TARGET_REG_BITS == 64 && vece == MO_64);
     switch (type) {
+    case TCG_TYPE_V512:
+        some = QEMU_ALIGN_DOWN(oprsz, 64);
+        expand_cmp_vec(vece, dofs, aofs, bofs, some, 64, TCG_TYPE_V512, cond);
+        if (some == oprsz) {
+            break;
+        }
+        dofs += some;
+        aofs += some;
+        bofs += some;
+        oprsz -= some;
+        maxsz -= some;
+        /* fallthru */
     case TCG_TYPE_V256:
         /* Recall that ARM SVE allows vector sizes that are not a
          * power of 2, but always a multiple of 16.  The intent is
@@ -3896,6 +4042,15 @@ void tcg_gen_gvec_cmps(TCGCond cond, unsigned vece, uint32_t dofs,
 
         tcg_gen_dup_i64_vec(vece, t_vec, c);
         switch (type) {
+        case TCG_TYPE_V512:
+            some = QEMU_ALIGN_DOWN(oprsz, 64);
+            expand_cmps_vec(vece, dofs, aofs, some, 64,
+                            TCG_TYPE_V512, cond, t_vec);
+            aofs += some;
+            dofs += some;
+            oprsz -= some;
+            maxsz -= some;
+            /* fallthru */
         case TCG_TYPE_V256:
             some = QEMU_ALIGN_DOWN(oprsz, 32);
             expand_cmps_vec(vece, dofs, aofs, some, 32,
@@ -1673,6 +1673,7 @@ TCGTemp *tcg_temp_new_internal(TCGType type, TCGTempKind kind)
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         n = 1;
         break;
     case TCG_TYPE_I64:
@@ -1764,6 +1765,9 @@ TCGv_vec tcg_temp_new_vec(TCGType type)
     case TCG_TYPE_V256:
         assert(TCG_TARGET_HAS_v256);
         break;
+    case TCG_TYPE_V512:
+        assert(TCG_TARGET_HAS_v512);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -1937,7 +1941,8 @@ TCGTemp *tcgv_i32_temp(TCGv_i32 v)
 bool tcg_op_supported(TCGOpcode op)
 {
     const bool have_vec
-        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256;
+        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256
+        | TCG_TARGET_HAS_v512;
 
     switch (op) {
     case INDEX_op_discard:
@@ -2447,6 +2452,7 @@ static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
         case TCG_TYPE_V64:
         case TCG_TYPE_V128:
         case TCG_TYPE_V256:
+        case TCG_TYPE_V512:
             snprintf(buf, buf_size, "v%d$0x%" PRIx64,
                      64 << (ts->type - TCG_TYPE_V64), ts->val);
             break;
@@ -4141,8 +4147,9 @@ static void temp_allocate_frame(TCGContext *s, TCGTemp *ts)
     case TCG_TYPE_I128:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         /*
-         * Note that we do not require aligned storage for V256,
+         * Note that we do not require aligned storage for V256 or V512,
          * and that we provide alignment for I128 to match V128,
          * even if that's above what the host ABI requires.
          */
@@ -0,0 +1,106 @@
+/*
+ * QEMU gvec helper speed benchmark
+ *
+ * Compares the host vector versions of the saturating, comparison and
+ * shift helpers used by the TCG gvec runtime, for each element size
+ * and for the operation sizes of 128, 512 and 2048-bit guest vectors.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/gvec-accel.h"
+
+#define MAX_OPRSZ   256
+
+typedef struct BenchOp {
+    const char *name;
+    size_t offset;
+    bool shift;
+} BenchOp;
+
+#define OP3(NAME)   { #NAME, offsetof(GVecAccel, NAME), false }
+#define OPSH(NAME)  { #NAME, offsetof(GVecAccel, NAME), true }
+
+static const BenchOp ops[] = {
+    OP3(ssadd), OP3(sssub), OP3(usadd), OP3(ussub),
+    OP3(eq), OP3(ne), OP3(lt), OP3(le), OP3(ltu), OP3(leu),
+    OPSH(shli), OPSH(shri), OPSH(sari),
+};
+
+static const GVecAccel *accels[8];
+static int nb_accels;
+
+static QEMU_ALIGNED(64) uint8_t d[MAX_OPRSZ], a[MAX_OPRSZ], b[MAX_OPRSZ];
+
+static double bench_one(const BenchOp *op, const GVecAccel *acc, int vece,
+                        intptr_t oprsz)
+{
+    const void *fns = (const void *)acc + op->offset;
+    double calls = 0;
+
+    g_test_timer_start();
+    if (op->shift) {
+        GVecAccelShiftFn *fn = ((GVecAccelShiftFn * const *)fns)[vece];
+
+        do {
+            for (int i = 0; i < 1024; i++) {
+                fn(d, a, 3, oprsz);
+            }
+            calls += 1024;
+        } while (g_test_timer_elapsed() < 0.1);
+    } else {
+        GVecAccel3Fn *fn = ((GVecAccel3Fn * const *)fns)[vece];
+
+        do {
+            for (int i = 0; i < 1024; i++) {
+                fn(d, a, b, oprsz);
+            }
+            calls += 1024;
+        } while (g_test_timer_elapsed() < 0.1);
+    }
+    return g_test_timer_last() * 1e9 / calls;
+}
+
+static void test_op(const void *opaque)
+{
+    const BenchOp *op = opaque;
+
+    for (int vece = 0; vece < 4; vece++) {
+        for (intptr_t oprsz = 16; oprsz <= MAX_OPRSZ; oprsz *= 4) {
+            g_autoptr(GString) line = g_string_new(NULL);
+
+            g_string_printf(line, "%-5s %2d-bit x %3" PRIdPTR ":",
+                            op->name, 8 << vece, oprsz >> vece);
+            for (int i = 0; i < nb_accels; i++) {
+                g_string_append_printf(line, "  %s %7.1f ns", accels[i]->name,
+                                       bench_one(op, accels[i], vece, oprsz));
+            }
+            g_test_message("%s", line->str);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    for (int i = 0; i < MAX_OPRSZ; i++) {
+        a[i] = g_test_rand_int();
+        b[i] = g_test_rand_int();
+    }
+
+    do {
+        g_assert(nb_accels < ARRAY_SIZE(accels));
+        accels[nb_accels++] = gvec_accel;
+    } while (test_gvec_next_accel());
+
+    for (int i = 0; i < ARRAY_SIZE(ops); i++) {
+        g_autofree char *path = g_strdup_printf("/gvec-accel/speed/%s",
+                                                ops[i].name);
+        g_test_add_data_func(path, &ops[i], test_op);
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,122 @@
+/*
+ * QEMU qcow2 metadata cache lookup benchmark
+ *
+ * Measures the cost of an L2 table cache hit as the number of cache
+ * entries grows.  Every read targets an unallocated cluster inside an
+ * allocated (and cached) L2 table, so no data I/O is involved and the
+ * per-read time is dominated by the metadata lookup.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/main-loop.h"
+#include "qemu/units.h"
+#include "block/block.h"
+#include "sysemu/block-backend.h"
+
+#define CLUSTER_SIZE        512
+/* Each 512 byte L2 table maps 64 clusters */
+#define L2_COVERAGE         (CLUSTER_SIZE / sizeof(uint64_t) * CLUSTER_SIZE)
+#define MAX_TABLES          65536
+
+static char *img_path;
+
+static BlockBackend *open_image(int num_tables)
+{
+    QDict *options = qdict_new();
+    g_autofree char *l2_cache_size =
+        g_strdup_printf("%d", num_tables * CLUSTER_SIZE);
+
+    qdict_put_str(options, "driver", "qcow2");
+    qdict_put_str(options, "file.driver", "file");
+    qdict_put_str(options, "file.filename", img_path);
+    qdict_put_str(options, "l2-cache-size", l2_cache_size);
+    qdict_put_str(options, "cache.no-flush", "on");
+
+    return blk_new_open(NULL, NULL, options, BDRV_O_RDWR, &error_abort);
+}
+
+static void prepare_image(void)
+{
+    uint8_t buf[CLUSTER_SIZE];
+    BlockBackend *blk;
+    int fd, i;
+
+    img_path = g_strdup_printf("%s/qcow2-cache-bench.XXXXXX",
+                               g_get_tmp_dir());
+    fd = mkstemp(img_path);
+    g_assert(fd >= 0);
+    close(fd);
+
+    bdrv_img_create(img_path, "qcow2", NULL, NULL,
+                    (char *)"cluster_size=512",
+                    (uint64_t)MAX_TABLES * L2_COVERAGE,
+                    BDRV_O_RDWR, true, &error_abort);
+
+    /* Allocate the first cluster covered by each L2 table */
+    memset(buf, 0xa5, sizeof(buf));
+    blk = open_image(1024);
+    for (i = 0; i < MAX_TABLES; i++) {
+        g_assert(blk_pwrite(blk, (int64_t)i * L2_COVERAGE, sizeof(buf),
+                            buf, 0) == 0);
+    }
+    blk_unref(blk);
+}
+
+static void test_lookup(const void *opaque)
+{
+    int num_tables = GPOINTER_TO_INT(opaque);
+    uint8_t buf[CLUSTER_SIZE];
+    BlockBackend *blk = open_image(num_tables);
+    uint64_t seed = 1;
+    double lookups = 0;
+    int i;
+
+    /* Warm the cache with every table we are going to hit */
+    for (i = 0; i < num_tables; i++) {
+        g_assert(blk_pread(blk, (int64_t)i * L2_COVERAGE, sizeof(buf),
+                           buf, 0) == 0);
+    }
+
+    g_test_timer_start();
+    do {
+        for (i = 0; i < 1024; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            blk_pread(blk, (int64_t)((seed >> 33) % num_tables) * L2_COVERAGE
+                      + CLUSTER_SIZE, sizeof(buf), buf, 0);
+        }
+        lookups += 1024;
+    } while (g_test_timer_elapsed() < 0.5);
+
+    g_test_message("%6d entries: %8.1f ns/lookup", num_tables,
+                   g_test_timer_last() * 1e9 / lookups);
+
+    blk_unref(blk);
+}
+
+int main(int argc, char **argv)
+{
+    int ret, n;
+
+    qemu_init_main_loop(&error_fatal);
+    bdrv_init();
+    g_test_init(&argc, &argv, NULL);
+
+    prepare_image();
+
+    for (n = 256; n <= MAX_TABLES; n *= 4) {
+        g_autofree char *path = g_strdup_printf("/qcow2/cache/lookup/%d", n);
+        g_test_add_data_func(path, GINT_TO_POINTER(n), test_lookup);
+    }
+
+    ret = g_test_run();
+
+    unlink(img_path);
+    g_free(img_path);
+
+    return ret;
+}
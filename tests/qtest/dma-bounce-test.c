@@ -0,0 +1,87 @@
+/*
+ * QTest testcase for DMA bounce buffers
+ *
+ * pc-testdev maps the page written to its flush port with
+ * cpu_physical_memory_map().  Pointing it at its own MMIO region makes
+ * every mapping go through a bounce buffer, which shows up in
+ * "info bounce-buffers".
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "libqtest.h"
+
+#define TESTDEV_FLUSH_PORT  0xe4
+#define TESTDEV_IOMEM_ADDR  0xff000000
+#define TESTDEV_PAGE_SIZE   4096
+#define NUM_MAPS            4
+
+typedef struct BounceStats {
+    uint64_t maps;
+    uint64_t pool_hits;
+    uint64_t allocated;
+    uint64_t failed;
+    uint64_t bytes;
+} BounceStats;
+
+static uint64_t parse_stat(const char *info, const char *name)
+{
+    const char *p = strstr(info, name);
+    const char *end;
+    uint64_t value;
+
+    g_assert_nonnull(p);
+    p += strlen(name);
+    g_assert_cmpint(qemu_strtou64(p, &end, 10, &value), ==, 0);
+    return value;
+}
+
+static void query_bounce_stats(QTestState *qts, BounceStats *bs)
+{
+    g_autofree char *info = qtest_hmp(qts, "info bounce-buffers");
+
+    bs->maps = parse_stat(info, "Bounce buffer mappings:");
+    bs->pool_hits = parse_stat(info, "reused from pool:");
+    bs->allocated = parse_stat(info, "newly allocated:");
+    bs->failed = parse_stat(info, "failed (limit):");
+    bs->bytes = parse_stat(info, "Bytes mapped:");
+    g_assert_cmpuint(bs->pool_hits + bs->allocated, ==, bs->maps);
+}
+
+static void test_bounce_mmio(void)
+{
+    BounceStats before, after;
+    QTestState *qts;
+    int i;
+
+    qts = qtest_init("-machine pc -device pc-testdev");
+
+    query_bounce_stats(qts, &before);
+    for (i = 0; i < NUM_MAPS; i++) {
+        qtest_outl(qts, TESTDEV_FLUSH_PORT, TESTDEV_IOMEM_ADDR);
+    }
+    query_bounce_stats(qts, &after);
+
+    g_assert_cmpuint(after.maps - before.maps, ==, NUM_MAPS);
+    g_assert_cmpuint(after.bytes - before.bytes, ==,
+                     NUM_MAPS * TESTDEV_PAGE_SIZE);
+    g_assert_cmpuint(after.failed, ==, before.failed);
+
+    /* Unmapped buffers are recycled by the next mapping of the thread */
+    g_assert_cmpuint(after.pool_hits - before.pool_hits, >=, NUM_MAPS - 1);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (qtest_has_machine("pc")) {
+        qtest_add_func("/dma-bounce/mmio", test_bounce_mmio);
+    }
+
+    return g_test_run();
+}
@@ -278,6 +278,89 @@ static void test_i440fx_pam(gconstpointer opaque)
     qtest_end();
 }
 
+/*
+ * Mix accesses to fixed RAM with accesses to the BIOS area while PAM
+ * flips the latter between RAM and ROM, so that stale translations of
+ * either address would show up as wrong data.
+ */
+static void test_i440fx_pam_interleaved(gconstpointer opaque)
+{
+    const TestData *s = opaque;
+    QPCIBus *bus;
+    QPCIDevice *dev;
+    uint64_t rom;
+    int i;
+
+    bus = test_start_get_bus(s);
+    dev = qpci_device_find(bus, QPCI_DEVFN(0, 0));
+    g_assert(dev != NULL);
+
+    rom = readq(0xF0000);
+    for (i = 0; i < 64; i++) {
+        uint64_t pattern = 0x0101010101010101ULL * (i + 1);
+
+        writeq(0x200000, ~pattern);
+
+        pam_set(dev, 1, PAM_RE | PAM_WE);
+        writeq(0xF0000, pattern);
+        g_assert_cmphex(readq(0x200000), ==, ~pattern);
+        g_assert_cmphex(readq(0xF0000), ==, pattern);
+
+        pam_set(dev, 1, 0);
+        g_assert_cmphex(readq(0xF0000), ==, rom);
+        g_assert_cmphex(readq(0x200000), ==, ~pattern);
+    }
+
+    g_free(dev);
+    qpci_free_pc(bus);
+    qtest_end();
+}
+
+/*
+ * Throughput of accesses that keep moving between memory regions.  Most
+ * of the time goes to the qtest protocol; compare runs of the same
+ * build rather than absolute numbers.
+ */
+static void test_i440fx_perf_interleaved(gconstpointer opaque)
+{
+    const TestData *s = opaque;
+    static const uint64_t addrs[] = {
+        0x200000,       /* RAM */
+        0xF0000,        /* ISA BIOS */
+        0x1000000,      /* RAM */
+        0xFFFFFFF0,     /* BIOS */
+    };
+    g_autofree uint8_t *buf = g_malloc(0x40000);
+    QPCIBus *bus;
+    double accesses = 0;
+    int i;
+
+    bus = test_start_get_bus(s);
+
+    g_test_timer_start();
+    do {
+        for (i = 0; i < 1024; i++) {
+            readl(addrs[i % ARRAY_SIZE(addrs)]);
+        }
+        accesses += 1024;
+    } while (g_test_timer_elapsed() < 1.0);
+    g_test_message("interleaved readl: %.0f accesses/s",
+                   accesses / g_test_timer_last());
+
+    /* 0xC0000..0xFFFFF is split into one section per PAM area */
+    accesses = 0;
+    g_test_timer_start();
+    do {
+        memread(0xC0000, buf, 0x40000);
+        accesses++;
+    } while (g_test_timer_elapsed() < 1.0);
+    g_test_message("legacy window memread: %.1f MiB/s",
+                   accesses * 0x40000 / g_test_timer_last() / (1 << 20));
+
+    qpci_free_pc(bus);
+    qtest_end();
+}
+
 #define BLOB_SIZE ((size_t)65536)
 #define ISA_BIOS_MAXSZ ((size_t)(128 * 1024))
 
@@ -386,6 +469,12 @@ int main(int argc, char **argv)
 
     qtest_add_data_func("i440fx/defaults", &data, test_i440fx_defaults);
     qtest_add_data_func("i440fx/pam", &data, test_i440fx_pam);
+    qtest_add_data_func("i440fx/pam-interleaved", &data,
+                        test_i440fx_pam_interleaved);
+    if (g_test_perf()) {
+        qtest_add_data_func("i440fx/perf/interleaved", &data,
+                            test_i440fx_perf_interleaved);
+    }
     add_firmware_test("i440fx/firmware/bios", request_bios);
     add_firmware_test("i440fx/firmware/pflash", request_pflash);
 
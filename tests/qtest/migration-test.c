@@ -605,6 +605,8 @@ typedef struct {
     bool only_target;
     /* Use dirty ring if true; dirty logging otherwise */
     bool use_dirty_ring;
+    /* Force TCG and log dirty pages to its per-vCPU dirty rings */
+    bool use_tcg_dirty_ring;
     const char *opts_source;
     const char *opts_target;
     /* suspend the src before migrating to dest. */
@@ -723,6 +725,7 @@ static int test_migrate_start(QTestState **from, QTestState **to,
     g_autofree char *shmem_opts = NULL;
     g_autofree char *shmem_path = NULL;
     const char *kvm_opts = NULL;
+    g_autofree char *accel_opts = NULL;
     const char *arch = qtest_get_arch();
     const char *memory_size;
     const char *machine_alias, *machine_opts = "";
@@ -806,6 +809,13 @@ static int test_migrate_start(QTestState **from, QTestState **to,
         kvm_opts = ",dirty-ring-size=4096";
     }
 
+    if (args->use_tcg_dirty_ring) {
+        accel_opts = g_strdup("-accel tcg,dirty-ring-size=1024");
+    } else {
+        accel_opts = g_strdup_printf("-accel kvm%s -accel tcg",
+                                     kvm_opts ? kvm_opts : "");
+    }
+
     if (!qtest_has_machine(machine_alias)) {
         g_autofree char *msg = g_strdup_printf("machine %s not supported", machine_alias);
         g_test_skip(msg);
@@ -817,13 +827,13 @@ static int test_migrate_start(QTestState **from, QTestState **to,
 
     g_test_message("Using machine type: %s", machine);
 
-    cmd_source = g_strdup_printf("-accel kvm%s -accel tcg "
+    cmd_source = g_strdup_printf("%s "
                                  "-machine %s,%s "
                                  "-name source,debug-threads=on "
                                  "-m %s "
                                  "-serial file:%s/src_serial "
                                  "%s %s %s %s %s",
-                                 kvm_opts ? kvm_opts : "",
+                                 accel_opts,
                                  machine, machine_opts,
                                  memory_size, tmpfs,
                                  arch_opts ? arch_opts : "",
@@ -838,14 +848,14 @@ static int test_migrate_start(QTestState **from, QTestState **to,
                                      &src_state);
     }
 
-    cmd_target = g_strdup_printf("-accel kvm%s -accel tcg "
+    cmd_target = g_strdup_printf("%s "
                                  "-machine %s,%s "
                                  "-name target,debug-threads=on "
                                  "-m %s "
                                  "-serial file:%s/dest_serial "
                                  "-incoming %s "
                                  "%s %s %s %s %s",
-                                 kvm_opts ? kvm_opts : "",
+                                 accel_opts,
                                  machine, machine_opts,
                                  memory_size, tmpfs, uri,
                                  arch_opts ? arch_opts : "",
@@ -1920,6 +1930,41 @@ static void test_precopy_unix_plain(void)
     test_precopy_common(&args);
 }
 
+static void test_precopy_unix_qemu_file_buffer(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .listen_uri = uri,
+        .connect_uri = uri,
+        /*
+         * Flush the main channel less often; the stream must not change
+         * for the destination.
+         */
+        .start.opts_source = "-global migration.x-qemu-file-buffer-size=1M "
+                             "-global migration.x-qemu-file-iov-max=512",
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
+static void test_precopy_unix_qemu_file_buffer_clamped(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .listen_uri = uri,
+        .connect_uri = uri,
+        /*
+         * Below the default buffer size and above IOV_MAX; both are
+         * clamped instead of failing or breaking the stream.
+         */
+        .start.opts_source = "-global migration.x-qemu-file-buffer-size=4k "
+                             "-global migration.x-qemu-file-iov-max=1000000",
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_unix_suspend_live(void)
 {
     g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
@@ -1968,6 +2013,95 @@ static void test_precopy_unix_dirty_ring(void)
     test_precopy_common(&args);
 }
 
+static void test_precopy_unix_tcg_dirty_ring(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            .use_tcg_dirty_ring = true,
+        },
+        .listen_uri = uri,
+        .connect_uri = uri,
+        /*
+         * Cover harvesting the TCG per-vCPU dirty rings rather than
+         * scanning the whole migration bitmap on each sync.
+         */
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
+/* Modern ACPI CPU hotplug registers of the q35 machine */
+#define ICH9_CPU_HOTPLUG_IO_BASE 0x0cd8
+#define ACPI_CPU_SELECTOR_OFFSET_WR 0
+#define ACPI_CPU_FLAGS_OFFSET_RW 4
+#define ACPI_CPU_FLAGS_EJECT 8
+
+/*
+ * Unplug a vCPU while migration harvests the TCG dirty rings, which frees
+ * the ring of that vCPU.  The guest cannot handle ACPI events, so eject
+ * the vCPU through the hotplug registers like its firmware would.
+ */
+static void test_precopy_unix_tcg_dirty_ring_unplug(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart args = {
+        .use_tcg_dirty_ring = true,
+        .opts_source = "-smp 1,maxcpus=2",
+        .opts_target = "-smp 1,maxcpus=2",
+    };
+    QTestState *from, *to;
+    QDict *rsp;
+    QList *cpus;
+    QObject *e;
+    int hotplugged = 0;
+
+    if (test_migrate_start(&from, &to, uri, &args)) {
+        return;
+    }
+
+    rsp = qtest_qmp(from, "{ 'execute': 'query-hotpluggable-cpus' }");
+    cpus = qdict_get_qlist(rsp, "return");
+    while ((e = qlist_pop(cpus))) {
+        QDict *cpu = qobject_to(QDict, e);
+
+        if (!qdict_haskey(cpu, "qom-path")) {
+            qtest_qmp_device_add_qdict(from, qdict_get_str(cpu, "type"),
+                                       qdict_get_qdict(cpu, "props"));
+            hotplugged++;
+        }
+        qobject_unref(e);
+    }
+    qobject_unref(rsp);
+    g_assert_cmpint(hotplugged, ==, 1);
+
+    wait_for_serial("src_serial");
+
+    migrate_ensure_non_converge(from);
+    migrate_prepare_for_dirty_mem(from);
+    migrate_qmp(from, to, uri, NULL, "{}");
+
+    /* The first sync scans the bitmap, later ones harvest the rings */
+    wait_for_migration_pass(from);
+
+    /* Switch to the modern interface, then eject CPU 1 */
+    qtest_outb(from, ICH9_CPU_HOTPLUG_IO_BASE, 0);
+    qtest_outl(from, ICH9_CPU_HOTPLUG_IO_BASE + ACPI_CPU_SELECTOR_OFFSET_WR, 1);
+    qtest_outb(from, ICH9_CPU_HOTPLUG_IO_BASE + ACPI_CPU_FLAGS_OFFSET_RW,
+               ACPI_CPU_FLAGS_EJECT);
+    qtest_qmp_eventwait(from, "DEVICE_DELETED");
+
+    migrate_wait_for_dirty_mem(from, to);
+    migrate_ensure_converge(from);
+    wait_for_migration_complete(from);
+    wait_for_stop(from, &src_state);
+    wait_for_resume(to, &dst_state);
+    wait_for_serial("dest_serial");
+
+    test_migrate_end(from, to, true);
+}
+
 #ifdef CONFIG_GNUTLS
 static void test_precopy_unix_tls_psk(void)
 {
@@ -2908,6 +3042,15 @@ test_migrate_precopy_tcp_multifd_zlib_start(QTestState *from,
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "zlib");
 }
 
+static void *
+test_migrate_precopy_tcp_multifd_zlib_workers_start(QTestState *from,
+                                                    QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-compression-threads", 3);
+
+    return test_migrate_precopy_tcp_multifd_zlib_start(from, to);
+}
+
 #ifdef CONFIG_ZSTD
 static void *
 test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
@@ -2918,6 +3061,15 @@ test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
 
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "zstd");
 }
+
+static void *
+test_migrate_precopy_tcp_multifd_zstd_workers_start(QTestState *from,
+                                                    QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-compression-threads", 3);
+
+    return test_migrate_precopy_tcp_multifd_zstd_start(from, to);
+}
 #endif /* CONFIG_ZSTD */
 
 #ifdef CONFIG_QATZIP
@@ -3018,6 +3170,15 @@ static void test_multifd_tcp_zlib(void)
     test_precopy_common(&args);
 }
 
+static void test_multifd_tcp_zlib_workers(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_zlib_workers_start,
+    };
+    test_precopy_common(&args);
+}
+
 #ifdef CONFIG_ZSTD
 static void test_multifd_tcp_zstd(void)
 {
@@ -3027,6 +3188,15 @@ static void test_multifd_tcp_zstd(void)
     };
     test_precopy_common(&args);
 }
+
+static void test_multifd_tcp_zstd_workers(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_zstd_workers_start,
+    };
+    test_precopy_common(&args);
+}
 #endif
 
 #ifdef CONFIG_QATZIP
@@ -3803,6 +3973,10 @@ int main(int argc, char **argv)
 
     migration_test_add("/migration/precopy/unix/plain",
                        test_precopy_unix_plain);
+    migration_test_add("/migration/precopy/unix/qemu-file-buffer",
+                       test_precopy_unix_qemu_file_buffer);
+    migration_test_add("/migration/precopy/unix/qemu-file-buffer/clamped",
+                       test_precopy_unix_qemu_file_buffer_clamped);
     if (g_test_slow()) {
         migration_test_add("/migration/precopy/unix/xbzrle",
                            test_precopy_unix_xbzrle);
@@ -3943,9 +4117,13 @@ int main(int argc, char **argv)
                        test_multifd_tcp_cancel);
     migration_test_add("/migration/multifd/tcp/plain/zlib",
                        test_multifd_tcp_zlib);
+    migration_test_add("/migration/multifd/tcp/plain/zlib/workers",
+                       test_multifd_tcp_zlib_workers);
 #ifdef CONFIG_ZSTD
     migration_test_add("/migration/multifd/tcp/plain/zstd",
                        test_multifd_tcp_zstd);
+    migration_test_add("/migration/multifd/tcp/plain/zstd/workers",
+                       test_multifd_tcp_zstd_workers);
 #endif
 #ifdef CONFIG_QATZIP
     migration_test_add("/migration/multifd/tcp/plain/qatzip",
@@ -3978,6 +4156,15 @@ int main(int argc, char **argv)
 #endif /* CONFIG_TASN1 */
 #endif /* CONFIG_GNUTLS */
 
+    if (has_tcg) {
+        migration_test_add("/migration/tcg_dirty_ring",
+                           test_precopy_unix_tcg_dirty_ring);
+        if (g_str_equal(arch, "x86_64")) {
+            migration_test_add("/migration/tcg_dirty_ring/cpu-unplug",
+                               test_precopy_unix_tcg_dirty_ring_unplug);
+        }
+    }
+
     if (g_str_equal(arch, "x86_64") && has_kvm && kvm_dirty_ring_supported()) {
         migration_test_add("/migration/dirty_ring",
                            test_precopy_unix_dirty_ring);
@@ -0,0 +1,227 @@
+/*
+ * QTest testcase for the resizable TCG jump cache
+ *
+ * Boot a guest whose indirect branches go to more translation blocks
+ * than the jump cache initially holds, and check through query-stats
+ * that the cache grows while the guest keeps running.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "qapi/qmp/qnum.h"
+
+#define JMP_CACHE_BITS 8
+#define JMP_CACHE_MAX_ENTRIES (1 << 16)
+
+/* Incremented by the guest once per pass over its call targets */
+#define COUNTER_ADDR 0x7e00
+
+#define TIMEOUT_US (60 * G_USEC_PER_SEC)
+#define POLL_US (10 * 1000)
+
+/*
+ * Fill 0x1000-0x4fff with RET instructions, then keep calling them 16
+ * bytes apart through an indirect call.  Each call and each return is
+ * looked up in the jump cache, and the 1024 call targets do not fit in
+ * the 256 entries the cache starts with.
+ */
+static const uint8_t boot_sector[512] = {
+    /* 7c00: cli */
+    [0x00] = 0xfa,
+    /* 7c01: xor %ax,%ax */
+    [0x01] = 0x31, 0xc0,
+    /* 7c03: mov %ax,%ds */
+    [0x03] = 0x8e, 0xd8,
+    /* 7c05: mov %ax,%es */
+    [0x05] = 0x8e, 0xc0,
+    /* 7c07: mov %ax,%ss */
+    [0x07] = 0x8e, 0xd0,
+    /* 7c09: mov $0x7c00,%sp */
+    [0x09] = 0xbc, 0x00, 0x7c,
+    /* 7c0c: mov $0x1000,%di */
+    [0x0c] = 0xbf, 0x00, 0x10,
+    /* 7c0f: mov $0x4000,%cx */
+    [0x0f] = 0xb9, 0x00, 0x40,
+    /* 7c12: mov $0xc3,%al */
+    [0x12] = 0xb0, 0xc3,
+    /* 7c14: cld */
+    [0x14] = 0xfc,
+    /* 7c15: rep stosb */
+    [0x15] = 0xf3, 0xaa,
+    /* 7c17: mov $0x1000,%bx */
+    [0x17] = 0xbb, 0x00, 0x10,
+    /* 7c1a: call *%bx */
+    [0x1a] = 0xff, 0xd3,
+    /* 7c1c: add $0x10,%bx */
+    [0x1c] = 0x83, 0xc3, 0x10,
+    /* 7c1f: cmp $0x5000,%bx */
+    [0x1f] = 0x81, 0xfb, 0x00, 0x50,
+    /* 7c23: jne 7c1a */
+    [0x23] = 0x75, 0xf5,
+    /* 7c25: incw COUNTER_ADDR */
+    [0x25] = 0xff, 0x06, COUNTER_ADDR & 0xff, COUNTER_ADDR >> 8,
+    /* 7c29: jmp 7c17 */
+    [0x29] = 0xeb, 0xec,
+    /* End of boot sector marker */
+    [0x1fe] = 0x55, 0xaa,
+};
+
+typedef struct JmpCacheStats {
+    uint64_t entries;
+    uint64_t misses;
+    uint64_t conflicts;
+} JmpCacheStats;
+
+static void query_jmp_cache_stats(QTestState *qts, JmpCacheStats *js)
+{
+    QDict *rsp, *result;
+    QList *results, *stats;
+    QListEntry *e;
+
+    memset(js, 0xff, sizeof(*js));
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'query-stats',"
+                         "  'arguments': { 'target': 'vcpu',"
+                         "                 'providers': ["
+                         "                   { 'provider': 'tcg' } ] } }");
+    results = qdict_get_qlist(rsp, "return");
+    g_assert_cmpint(qlist_size(results), ==, 1);
+
+    result = qobject_to(QDict, qlist_peek(results));
+    g_assert_cmpstr(qdict_get_str(result, "provider"), ==, "tcg");
+    stats = qdict_get_qlist(result, "stats");
+    QLIST_FOREACH_ENTRY(stats, e) {
+        QDict *stat = qobject_to(QDict, qlist_entry_obj(e));
+        const char *name = qdict_get_str(stat, "name");
+        uint64_t value = qnum_get_uint(qobject_to(QNum,
+                                                  qdict_get(stat, "value")));
+
+        if (!strcmp(name, "jmp-cache-entries")) {
+            js->entries = value;
+        } else if (!strcmp(name, "jmp-cache-misses")) {
+            js->misses = value;
+        } else if (!strcmp(name, "jmp-cache-conflicts")) {
+            js->conflicts = value;
+        } else {
+            g_assert_not_reached();
+        }
+    }
+    qobject_unref(rsp);
+
+    g_assert_cmpuint(js->entries, !=, UINT64_MAX);
+    g_assert_cmpuint(js->misses, !=, UINT64_MAX);
+    g_assert_cmpuint(js->conflicts, !=, UINT64_MAX);
+}
+
+static void test_jmp_cache_schema(void)
+{
+    QTestState *qts;
+    QDict *rsp, *schema;
+    QList *schemas, *values;
+    QListEntry *e;
+    int n = 0;
+
+    qts = qtest_init("-machine none -accel tcg");
+    rsp = qtest_qmp(qts, "{ 'execute': 'query-stats-schemas',"
+                         "  'arguments': { 'provider': 'tcg' } }");
+    schemas = qdict_get_qlist(rsp, "return");
+    g_assert_cmpint(qlist_size(schemas), ==, 1);
+
+    schema = qobject_to(QDict, qlist_peek(schemas));
+    g_assert_cmpstr(qdict_get_str(schema, "target"), ==, "vcpu");
+    values = qdict_get_qlist(schema, "stats");
+    QLIST_FOREACH_ENTRY(values, e) {
+        QDict *value = qobject_to(QDict, qlist_entry_obj(e));
+        const char *name = qdict_get_str(value, "name");
+
+        if (!strcmp(name, "jmp-cache-entries")) {
+            g_assert_cmpstr(qdict_get_str(value, "type"), ==, "instant");
+        } else {
+            g_assert_true(!strcmp(name, "jmp-cache-misses") ||
+                          !strcmp(name, "jmp-cache-conflicts"));
+            g_assert_cmpstr(qdict_get_str(value, "type"), ==, "cumulative");
+        }
+        n++;
+    }
+    g_assert_cmpint(n, ==, 3);
+
+    qobject_unref(rsp);
+    qtest_quit(qts);
+}
+
+static void test_jmp_cache_grow(void)
+{
+    g_autofree char *disk = NULL;
+    JmpCacheStats before, after;
+    QTestState *qts;
+    uint16_t counter;
+    gint64 end;
+    int fd;
+
+    fd = g_file_open_tmp("qtest-jmp-cache.XXXXXX", &disk, NULL);
+    g_assert(fd >= 0);
+    g_assert_cmpint(write(fd, boot_sector, sizeof(boot_sector)), ==,
+                    sizeof(boot_sector));
+    close(fd);
+
+    qts = qtest_initf("-machine pc -accel tcg,jmp-cache-bits=%d "
+                      "-drive file=%s,if=ide,format=raw",
+                      JMP_CACHE_BITS, disk);
+
+    /* The guest outgrows the cache while it runs */
+    end = g_get_monotonic_time() + TIMEOUT_US;
+    do {
+        query_jmp_cache_stats(qts, &before);
+        if (before.entries > (1 << JMP_CACHE_BITS)) {
+            break;
+        }
+        g_usleep(POLL_US);
+    } while (g_get_monotonic_time() < end);
+
+    g_assert_cmpuint(before.entries, >, 1 << JMP_CACHE_BITS);
+    g_assert_cmpuint(before.entries, <=, JMP_CACHE_MAX_ENTRIES);
+    g_assert_cmpuint(before.entries & (before.entries - 1), ==, 0);
+    g_assert_cmpuint(before.misses, >=, 1 << JMP_CACHE_BITS);
+    g_assert_cmpuint(before.conflicts, >, 0);
+    g_assert_cmpuint(before.conflicts, <=, before.misses);
+
+    /* It keeps running correctly from the resized cache */
+    counter = qtest_readw(qts, COUNTER_ADDR);
+    end = g_get_monotonic_time() + TIMEOUT_US;
+    while (qtest_readw(qts, COUNTER_ADDR) == counter &&
+           g_get_monotonic_time() < end) {
+        g_usleep(POLL_US);
+    }
+    g_assert_cmpuint(qtest_readw(qts, COUNTER_ADDR), !=, counter);
+
+    /* The counters carry over across resizes */
+    query_jmp_cache_stats(qts, &after);
+    g_assert_cmpuint(after.entries, >, 1 << JMP_CACHE_BITS);
+    g_assert_cmpuint(after.misses, >=, before.misses);
+    g_assert_cmpuint(after.conflicts, >=, before.conflicts);
+
+    qtest_quit(qts);
+    unlink(disk);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_accel("tcg")) {
+        g_test_skip("TCG is not available");
+        return g_test_run();
+    }
+
+    qtest_add_func("/tcg/jmp-cache/schema", test_jmp_cache_schema);
+    if (qtest_has_machine("pc")) {
+        qtest_add_func("/tcg/jmp-cache/grow", test_jmp_cache_grow);
+    }
+
+    return g_test_run();
+}
@@ -11,6 +11,9 @@
 #include "qemu/osdep.h"
 #include "libqtest-single.h"
 #include "qemu/module.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qjson.h"
 #include "scsi/constants.h"
 #include "libqos/libqos-pc.h"
 #include "libqos/libqos-spapr.h"
@@ -24,6 +27,8 @@
 
 #define PCI_SLOT                0x02
 #define PCI_FN                  0x00
+#define PCI_SLOT_HP             0x06
+#define PCI_SLOT_VQ_MAPPING     0x07
 #define QVIRTIO_SCSI_TIMEOUT_US (1 * 1000 * 1000)
 
 #define MAX_NUM_QUEUES 64
@@ -36,6 +41,9 @@ typedef struct {
 
 static QGuestAllocator *alloc;
 
+/* Image of the disk behind the iothread-vq-mapping device */
+static char *vq_mapping_img;
+
 static void qvirtio_scsi_pci_free(QVirtioSCSIQueues *vs)
 {
     int i;
@@ -59,14 +67,15 @@ static uint64_t qvirtio_scsi_alloc(QVirtioSCSIQueues *vs, size_t alloc_size,
     return addr;
 }
 
-static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
-                                      const uint8_t *cdb,
-                                      const uint8_t *data_in,
-                                      size_t data_in_len,
-                                      uint8_t *data_out, size_t data_out_len,
-                                      struct virtio_scsi_cmd_resp *resp_out)
+static uint8_t virtio_scsi_do_command_vq(QVirtioSCSIQueues *vs,
+                                         QVirtQueue *vq,
+                                         const uint8_t *cdb,
+                                         const uint8_t *data_in,
+                                         size_t data_in_len,
+                                         uint8_t *data_out,
+                                         size_t data_out_len,
+                                         struct virtio_scsi_cmd_resp *resp_out)
 {
-    QVirtQueue *vq;
     struct virtio_scsi_cmd_req req = { { 0 } };
     struct virtio_scsi_cmd_resp resp = { .response = 0xff, .status = 0xff };
     uint64_t req_addr, resp_addr, data_in_addr = 0, data_out_addr = 0;
@@ -74,8 +83,6 @@ static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
     uint32_t free_head;
     QTestState *qts = global_qtest;
 
-    vq = vs->vq[2];
-
     req.lun[0] = 1; /* Select LUN */
     req.lun[1] = 1; /* Select target 1 */
     memcpy(req.cdb, cdb, VIRTIO_SCSI_CDB_SIZE);
@@ -118,6 +125,17 @@ static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
     return response;
 }
 
+static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
+                                      const uint8_t *cdb,
+                                      const uint8_t *data_in,
+                                      size_t data_in_len,
+                                      uint8_t *data_out, size_t data_out_len,
+                                      struct virtio_scsi_cmd_resp *resp_out)
+{
+    return virtio_scsi_do_command_vq(vs, vs->vq[2], cdb, data_in, data_in_len,
+                                     data_out, data_out_len, resp_out);
+}
+
 static QVirtioSCSIQueues *qvirtio_scsi_init(QVirtioDevice *dev)
 {
     QVirtioSCSIQueues *vs;
@@ -311,6 +329,149 @@ fail:
     unlink(tmp_path);
 }
 
+/*
+ * Send requests on all command virtqueues of a device whose virtqueues are
+ * spread over two IOThreads, and check that the writes reach the image.
+ */
+static void test_iothread_vq_mapping(void *obj, void *data,
+                                     QGuestAllocator *t_alloc)
+{
+    QVirtioSCSIPCI *scsi_pci = obj;
+    QVirtioPCIDevice *dev;
+    QVirtioSCSIQueues *vs;
+    uint8_t buf[512];
+    uint8_t cdb[VIRTIO_SCSI_CDB_SIZE];
+    struct virtio_scsi_cmd_resp resp;
+    int fd;
+    int i;
+
+    alloc = t_alloc;
+
+    dev = virtio_pci_new(scsi_pci->pci_vdev.pdev->bus,
+                         &(QPCIAddress) {
+                             .devfn = QPCI_DEVFN(PCI_SLOT_VQ_MAPPING, 0)
+                         });
+    g_assert_nonnull(dev);
+    g_assert_cmpint(dev->vdev.device_type, ==, VIRTIO_ID_SCSI);
+    qvirtio_pci_start_hw(&dev->obj);
+
+    vs = qvirtio_scsi_init(&dev->vdev);
+    g_assert_cmpint(vs->num_queues, ==, 4);
+
+    for (i = 0; i < vs->num_queues; i++) {
+        /* WRITE(10) to LBA i, transfer length 1 */
+        const uint8_t write_cdb[VIRTIO_SCSI_CDB_SIZE] = {
+            0x2a, 0x00, 0x00, 0x00, 0x00, i, 0x00, 0x00, 0x01, 0x00
+        };
+
+        memset(buf, i + 1, sizeof(buf));
+        virtio_scsi_do_command_vq(vs, vs->vq[i + 2], write_cdb, NULL, 0,
+                                  buf, sizeof(buf), &resp);
+        g_assert_cmphex(resp.response, ==, 0);
+        g_assert_cmphex(resp.status, ==, GOOD);
+    }
+
+    /* Read each block back through a different virtqueue */
+    for (i = 0; i < vs->num_queues; i++) {
+        /* READ(10) from LBA i, transfer length 1 */
+        const uint8_t read_cdb[VIRTIO_SCSI_CDB_SIZE] = {
+            0x28, 0x00, 0x00, 0x00, 0x00, i, 0x00, 0x00, 0x01, 0x00
+        };
+
+        virtio_scsi_do_command_vq(vs, vs->vq[(i + 1) % vs->num_queues + 2],
+                                  read_cdb, buf, sizeof(buf), NULL, 0, &resp);
+        g_assert_cmphex(resp.response, ==, 0);
+        g_assert_cmphex(resp.status, ==, GOOD);
+    }
+
+    /* SYNCHRONIZE CACHE(10) on the last virtqueue */
+    memset(cdb, 0, sizeof(cdb));
+    cdb[0] = 0x35;
+    virtio_scsi_do_command_vq(vs, vs->vq[vs->num_queues + 1], cdb, NULL, 0,
+                              NULL, 0, &resp);
+    g_assert_cmphex(resp.status, ==, GOOD);
+
+    fd = open(vq_mapping_img, O_RDONLY);
+    g_assert(fd >= 0);
+    for (i = 0; i < vs->num_queues; i++) {
+        uint8_t expected[512];
+
+        memset(expected, i + 1, sizeof(expected));
+        g_assert_cmpint(pread(fd, buf, sizeof(buf), i * 512), ==, sizeof(buf));
+        g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+    }
+    close(fd);
+
+    qvirtio_scsi_pci_free(vs);
+    qvirtio_pci_destructor(&dev->obj);
+    g_free(dev);
+    unlink(vq_mapping_img);
+    g_free(vq_mapping_img);
+    vq_mapping_img = NULL;
+}
+
+static void test_iothread_vq_mapping_error(QTestState *qts, const char *props,
+                                           const char *error)
+{
+    QDict *args = qobject_to(QDict, qobject_from_json(props, &error_abort));
+    QDict *resp;
+
+    qdict_put_str(args, "driver", "virtio-scsi-pci");
+    qdict_put_str(args, "id", "scsi2");
+    qdict_put_str(args, "addr", stringify(PCI_SLOT_HP) ".0");
+
+    resp = qtest_qmp(qts, "{'execute': 'device_add', 'arguments': %p}", args);
+    g_assert_cmpstr(qdict_get_str(qdict_get_qdict(resp, "error"), "desc"),
+                    ==, error);
+    qobject_unref(resp);
+}
+
+static void test_iothread_vq_mapping_invalid(void *obj, void *data,
+                                             QGuestAllocator *t_alloc)
+{
+    QVirtioSCSIPCI *scsi_pci = obj;
+    QTestState *qts = scsi_pci->pci_vdev.pdev->bus->qts;
+
+    if (scsi_pci->pci_vdev.pdev->bus->not_hotpluggable) {
+        g_test_skip("pci bus does not support hotplug");
+        return;
+    }
+
+    test_iothread_vq_mapping_error(qts,
+        "{'iothread-vq-mapping': [{'iothread': 'nonexistent'}]}",
+        "IOThread \"nonexistent\" object does not exist");
+    test_iothread_vq_mapping_error(qts,
+        "{'iothread-vq-mapping': [{'iothread': 'thread0'},"
+        "                        {'iothread': 'thread0'}]}",
+        "duplicate IOThread name \"thread0\" in iothread-vq-mapping");
+    test_iothread_vq_mapping_error(qts,
+        "{'num_queues': 2,"
+        "'iothread-vq-mapping': [{'iothread': 'thread0', 'vqs': [0]},"
+        "                        {'iothread': 'thread1'}]}",
+        "either all items in iothread-vq-mapping must have vqs or none of "
+        "them must have it");
+    test_iothread_vq_mapping_error(qts,
+        "{'num_queues': 2,"
+        "'iothread-vq-mapping': [{'iothread': 'thread0', 'vqs': [0, 2]}]}",
+        "vq index 2 for IOThread \"thread0\" must be less than num_queues 2 "
+        "in iothread-vq-mapping");
+    test_iothread_vq_mapping_error(qts,
+        "{'num_queues': 2,"
+        "'iothread-vq-mapping': [{'iothread': 'thread0', 'vqs': [0, 1]},"
+        "                        {'iothread': 'thread1', 'vqs': [1]}]}",
+        "cannot assign vq 1 to IOThread \"thread1\" because it is already "
+        "assigned");
+    test_iothread_vq_mapping_error(qts,
+        "{'num_queues': 2,"
+        "'iothread-vq-mapping': [{'iothread': 'thread0', 'vqs': [1]}]}",
+        "missing vq 0 IOThread assignment in iothread-vq-mapping");
+    test_iothread_vq_mapping_error(qts,
+        "{'iothread': 'thread0',"
+        "'iothread-vq-mapping': [{'iothread': 'thread1'}]}",
+        "iothread and iothread-vq-mapping properties cannot be set at the "
+        "same time");
+}
+
 static void *virtio_scsi_hotplug_setup(GString *cmd_line, void *arg)
 {
     g_string_append(cmd_line,
@@ -359,6 +520,38 @@ static void *virtio_scsi_setup_iothread(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_scsi_setup_iothreads(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -object iothread,id=thread0"
+                    " -object iothread,id=thread1");
+    return arg;
+}
+
+static void *virtio_scsi_setup_iothread_vq_mapping(GString *cmd_line,
+                                                   void *arg)
+{
+    int fd;
+
+    fd = g_file_open_tmp("qtest.XXXXXX", &vq_mapping_img, NULL);
+    g_assert(fd >= 0);
+    g_assert(ftruncate(fd, 1024 * 1024) == 0);
+    close(fd);
+
+    /* iothread-vq-mapping is a list, so it needs the JSON syntax */
+    g_string_append_printf(cmd_line,
+        " -object iothread,id=thread0"
+        " -object iothread,id=thread1"
+        " -blockdev driver=file,filename=%s,node-name=disk0"
+        " -device '{\"driver\": \"virtio-scsi-pci\", \"id\": \"scsi1\","
+        "           \"addr\": \"%02x.0\", \"num_queues\": 4,"
+        "           \"iothread-vq-mapping\": [{\"iothread\": \"thread0\"},"
+        "                                   {\"iothread\": \"thread1\"}]}'"
+        " -device scsi-hd,bus=scsi1.0,drive=disk0,scsi-id=1,lun=0",
+        vq_mapping_img, PCI_SLOT_VQ_MAPPING);
+    return arg;
+}
+
 static void register_virtio_scsi_test(void)
 {
     QOSGraphTestOptions opts = { };
@@ -383,6 +576,15 @@ static void register_virtio_scsi_test(void)
     };
     qos_add_test("iothread-attach-node", "virtio-scsi-pci",
                  test_iothread_attach_node, &opts);
+
+    opts.before = virtio_scsi_setup_iothread_vq_mapping;
+    opts.edge = (QOSGraphEdgeOptions) { };
+    qos_add_test("iothread-vq-mapping", "virtio-scsi-pci",
+                 test_iothread_vq_mapping, &opts);
+
+    opts.before = virtio_scsi_setup_iothreads;
+    qos_add_test("iothread-vq-mapping-invalid", "virtio-scsi-pci",
+                 test_iothread_vq_mapping_invalid, &opts);
 }
 
 libqos_init(register_virtio_scsi_test);
@@ -0,0 +1,85 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Superblocks keep one direction of each conditional branch and turn
+ * the other one into a side exit.  Form a superblock from a hot loop,
+ * then change the direction of its branches, and check that each
+ * iteration still runs the path selected by the branch.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ITERATIONS 100000
+
+static uint64_t run_loop(uint64_t n, uint64_t sw)
+{
+    uint64_t acc = 0;
+
+    asm volatile(
+        "1:  cmp   %[n], %[sw]\n"
+        /* Forward branch: the superblock follows the fall-through */
+        "    b.ls  2f\n"
+        "    add   %[acc], %[acc], #1\n"
+        "    b     3f\n"
+        "2:  eor   %[acc], %[acc], %[n]\n"
+        "    add   %[acc], %[acc], #3\n"
+        /* Changes direction every 16 iterations */
+        "3:  tbz   %[n], #4, 4f\n"
+        "    ror   %[acc], %[acc], #7\n"
+        "4:  subs  %[n], %[n], #1\n"
+        /* Backward branch: the superblock follows the loop */
+        "    b.ne  1b\n"
+        : [acc] "+r" (acc), [n] "+r" (n)
+        : [sw] "r" (sw)
+        : "cc");
+
+    return acc;
+}
+
+static uint64_t ref_loop(uint64_t n, uint64_t sw)
+{
+    uint64_t acc = 0;
+
+    for (; n; n--) {
+        if (n > sw) {
+            acc += 1;
+        } else {
+            acc = (acc ^ n) + 3;
+        }
+        if (n & 16) {
+            acc = (acc >> 7) | (acc << 57);
+        }
+    }
+
+    return acc;
+}
+
+int main(void)
+{
+    /*
+     * The first run forms the superblock on the fall-through path of
+     * the first branch.  The others take the side exit from the start,
+     * half-way through, and not at all.
+     */
+    static const uint64_t switch_points[] = {
+        0, ITERATIONS, ITERATIONS / 2, 0, ITERATIONS - 1, 1,
+    };
+    size_t i;
+    int err = 0;
+
+    for (i = 0; i < sizeof(switch_points) / sizeof(switch_points[0]); i++) {
+        uint64_t sw = switch_points[i];
+        uint64_t got = run_loop(ITERATIONS, sw);
+        uint64_t want = ref_loop(ITERATIONS, sw);
+
+        if (got != want) {
+            printf("FAIL: switch at %llu: got 0x%llx, expected 0x%llx\n",
+                   (unsigned long long)sw, (unsigned long long)got,
+                   (unsigned long long)want);
+            err = 1;
+        }
+    }
+
+    return err;
+}
@@ -0,0 +1,187 @@
+/*
+ * Level 2 TLB invalidation test
+ *
+ * Map more pages than the main and victim TLBs can hold, so that most
+ * of them are only cached in the level 2 TLB while the test loops over
+ * them, then remap pages and check that each kind of TLB invalidation
+ * drops the stale translations.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+/* grabbed from Linux */
+#define __stringify_1(x...) #x
+#define __stringify(x...)   __stringify_1(x)
+
+#define read_sysreg(r) ({                                           \
+            uint64_t __val;                                         \
+            asm volatile("mrs %0, " __stringify(r) : "=r" (__val)); \
+            __val;                                                  \
+})
+
+#define PAGE_SHIFT      12
+#define PAGE_SIZE       (1UL << PAGE_SHIFT)
+#define PTRS_PER_TABLE  (PAGE_SIZE / sizeof(uint64_t))
+
+/*
+ * boot.S identity maps the image in the GiB at 1 GiB; the test pages
+ * are mapped in the next one.
+ */
+#define TEST_VA         (2UL << 30)
+
+/*
+ * 1024 pages share the 256 main TLB entries four ways, which is
+ * enough to push most of them out through the victim TLB into the
+ * level 2 TLB without overflowing its 4-way sets.
+ */
+#define TEST_PAGES      1024
+#define TEST_PASSES     4
+
+/* Each test page maps to one of 16 physical pages of set A or set B */
+#define PHYS_PAGES      16
+#define SET_A           0
+#define SET_B           PHYS_PAGES
+
+/* Pages for TLBI RVAAE1: (NUM + 1) << (5 * SCALE + 1) pages from BaseADDR */
+#define RANGE_FIRST     256
+#define RANGE_NUM       31
+#define RANGE_PAGES     ((RANGE_NUM + 1) * 2)
+
+/* Descriptors for a 4 KiB granule: normal memory (MAIR index 0), AF, XN */
+#define DESC_TABLE      3UL
+#define DESC_PAGE       ((3UL << 53) | (1UL << 10) | 3UL)
+
+static uint64_t l2_table[PTRS_PER_TABLE] __attribute__((aligned(PAGE_SIZE)));
+static uint64_t l3_table[TEST_PAGES] __attribute__((aligned(PAGE_SIZE)));
+static uint64_t phys[2 * PHYS_PAGES][PTRS_PER_TABLE]
+    __attribute__((aligned(PAGE_SIZE)));
+
+/* The set each test page is currently mapped to */
+static int page_set[TEST_PAGES];
+
+static void map_page(int page, int set)
+{
+    l3_table[page] = (uint64_t)phys[set + page % PHYS_PAGES] | DESC_PAGE;
+    page_set[page] = set;
+}
+
+static void remap_page(int page)
+{
+    map_page(page, page_set[page] == SET_A ? SET_B : SET_A);
+}
+
+static uint64_t page_va(int page)
+{
+    return TEST_VA + ((uint64_t)page << PAGE_SHIFT);
+}
+
+static void tlbi_all(void)
+{
+    asm volatile("dsb ishst\n\t"
+                 "tlbi vmalle1\n\t"
+                 "dsb ish\n\t"
+                 "isb" : : : "memory");
+}
+
+static void tlbi_page(int page)
+{
+    asm volatile("dsb ishst\n\t"
+                 "tlbi vaae1, %0\n\t"
+                 "dsb ish\n\t"
+                 "isb" : : "r" (page_va(page) >> PAGE_SHIFT) : "memory");
+}
+
+static void tlbi_range(int page)
+{
+    uint64_t arg = (1UL << 46) |                   /* TG: 4 KiB */
+                   ((uint64_t)RANGE_NUM << 39) |   /* SCALE: 0 */
+                   (page_va(page) >> PAGE_SHIFT);
+
+    /* TLBI RVAAE1, spelt out for assemblers without FEAT_TLBIRANGE */
+    asm volatile("dsb ishst\n\t"
+                 "sys #0, c8, c6, #3, %0\n\t"
+                 "dsb ish\n\t"
+                 "isb" : : "r" (arg) : "memory");
+}
+
+/* Read every test page TEST_PASSES times and count the stale ones */
+static int thrash(const char *what)
+{
+    int errors = 0;
+    int pass, i;
+
+    for (pass = 0; pass < TEST_PASSES; pass++) {
+        for (i = 0; i < TEST_PAGES; i++) {
+            uint64_t expect = page_set[i] + i % PHYS_PAGES;
+            uint64_t val = *(volatile uint64_t *)page_va(i);
+
+            if (val != expect) {
+                if (errors++ < 8) {
+                    ml_printf("FAIL: %s: pass %d page %d read %ld, "
+                              "expected %ld\n", what, pass, i, val, expect);
+                }
+            }
+        }
+    }
+
+    ml_printf("%s: %d errors\n", what, errors);
+    return errors;
+}
+
+int main(void)
+{
+    uint64_t *l1 = (uint64_t *)(read_sysreg(ttbr0_el1) &
+                                ((1UL << 48) - PAGE_SIZE));
+    int errors = 0;
+    int i;
+
+    ml_printf("L2 TLB Test\n");
+
+    for (i = 0; i < 2 * PHYS_PAGES; i++) {
+        phys[i][0] = i;
+    }
+    for (i = 0; i < TEST_PAGES; i++) {
+        map_page(i, SET_A);
+    }
+    for (i = 0; i < TEST_PAGES / PTRS_PER_TABLE; i++) {
+        l2_table[i] = (uint64_t)&l3_table[i * PTRS_PER_TABLE] | DESC_TABLE;
+    }
+
+    /*
+     * The level 1 entry was invalid, so there is nothing to invalidate
+     * yet.  Avoid a full flush here: it could resize the main TLB.
+     */
+    l1[TEST_VA >> 30] = (uint64_t)l2_table | DESC_TABLE;
+    asm volatile("dsb ishst\n\tisb" : : : "memory");
+
+    errors += thrash("initial mapping");
+
+    /* Most stale entries are in the level 2 TLB when they are flushed */
+    for (i = 1; i < TEST_PAGES; i += 2) {
+        remap_page(i);
+        tlbi_page(i);
+    }
+    errors += thrash("TLBI VAAE1 of odd pages");
+
+    if (((read_sysreg(id_aa64isar0_el1) >> 56) & 0xf) >= 2) {
+        for (i = RANGE_FIRST; i < RANGE_FIRST + RANGE_PAGES; i++) {
+            remap_page(i);
+        }
+        tlbi_range(RANGE_FIRST);
+        errors += thrash("TLBI RVAAE1");
+    } else {
+        ml_printf("SKIP: TLBI RVAAE1 not supported\n");
+    }
+
+    for (i = 0; i < TEST_PAGES; i++) {
+        remap_page(i);
+    }
+    tlbi_all();
+    errors += thrash("TLBI VMALLE1");
+
+    ml_printf("%s\n", errors ? "FAIL" : "PASS");
+    return errors ? 1 : 0;
+}
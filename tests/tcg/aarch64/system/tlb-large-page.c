@@ -0,0 +1,268 @@
+/*
+ * Large page TLB test
+ *
+ * Touch every page of a 2 MiB block so that all but the first are
+ * filled from the remembered large page, then check that the large
+ * page is dropped after a single page is invalidated, after the block
+ * is remapped with pages, and after its permissions are downgraded.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <minilib.h>
+
+/* grabbed from Linux */
+#define __stringify_1(x...) #x
+#define __stringify(x...)   __stringify_1(x)
+
+#define read_sysreg(r) ({                                           \
+            uint64_t __val;                                         \
+            asm volatile("mrs %0, " __stringify(r) : "=r" (__val)); \
+            __val;                                                  \
+})
+
+#define write_sysreg(r, v) do {                     \
+        uint64_t __val = (uint64_t)(v);             \
+        asm volatile("msr " __stringify(r) ", %x0"  \
+                 : : "rZ" (__val));                 \
+} while (0)
+
+#define PAGE_SHIFT      12
+#define PAGE_SIZE       (1UL << PAGE_SHIFT)
+#define PTRS_PER_TABLE  (PAGE_SIZE / sizeof(uint64_t))
+#define BLOCK_SHIFT     21
+#define BLOCK_SIZE      (1UL << BLOCK_SHIFT)
+#define BLOCK_PAGES     (BLOCK_SIZE / PAGE_SIZE)
+
+/*
+ * boot.S identity maps the image in the GiB at 1 GiB; the test block
+ * and views of its two backing regions are mapped in the next one.
+ */
+#define TEST_VA         (2UL << 30)
+#define TEST_BLOCK      0
+#define VIEW_BLOCK      1
+
+/* Two 2 MiB regions of RAM well above the image */
+#define REGION_PA       ((1UL << 30) + 16 * BLOCK_SIZE)
+#define REGION_A        0
+#define REGION_B        1
+
+/* The page invalidated by TLBI VAAE1, away from the one touched first */
+#define FLUSH_PAGE      5
+
+/* Descriptors for a 4 KiB granule: normal memory (MAIR index 0), AF, XN */
+#define DESC_TABLE      3UL
+#define DESC_BLOCK      ((3UL << 53) | (1UL << 10) | 1UL)
+#define DESC_PAGE       ((3UL << 53) | (1UL << 10) | 3UL)
+#define DESC_AP_RO      (2UL << 6)
+
+/* Data abort taken without a change in exception level */
+#define ESR_EC_DABT_CUR 0x25
+/* Permission fault, at any level */
+#define ESR_DFSC_PERM   0x0c
+
+static uint64_t l2_table[PTRS_PER_TABLE] __attribute__((aligned(PAGE_SIZE)));
+static uint64_t l3_table[PTRS_PER_TABLE] __attribute__((aligned(PAGE_SIZE)));
+
+/* Written by the data abort handler below */
+uint64_t fault_esr, fault_far;
+extern char fault_vectors[];
+
+/*
+ * Synchronous exceptions at EL1 record the syndrome and fault address
+ * and skip the faulting instruction; anything else ends the test.
+ */
+asm(".pushsection .text\n"
+    ".balign 2048\n"
+    "fault_vectors:\n"
+    ".rept 4\n"
+    ".balign 128\n"
+    "b unexpected_exception\n"
+    ".endr\n"
+    ".balign 128\n"
+    "b data_abort\n"
+    ".rept 11\n"
+    ".balign 128\n"
+    "b unexpected_exception\n"
+    ".endr\n"
+    "data_abort:\n"
+    "stp x0, x1, [sp, #-16]!\n"
+    "mrs x0, esr_el1\n"
+    "adrp x1, fault_esr\n"
+    "str x0, [x1, :lo12:fault_esr]\n"
+    "mrs x0, far_el1\n"
+    "adrp x1, fault_far\n"
+    "str x0, [x1, :lo12:fault_far]\n"
+    "mrs x0, elr_el1\n"
+    "add x0, x0, #4\n"
+    "msr elr_el1, x0\n"
+    "ldp x0, x1, [sp], #16\n"
+    "eret\n"
+    "unexpected_exception:\n"
+    "mov x0, #0x18\n"               /* SYS_EXIT */
+    "mov x1, #1\n"
+    "hlt 0xf000\n"
+    ".popsection");
+
+static uint64_t region_pa(int region)
+{
+    return REGION_PA + region * BLOCK_SIZE;
+}
+
+static uint64_t page_va(int block, int page)
+{
+    return TEST_VA + block * BLOCK_SIZE + ((uint64_t)page << PAGE_SHIFT);
+}
+
+static uint64_t page_value(int region, int page)
+{
+    return ((uint64_t)region << 32) | page;
+}
+
+static void map_block(int region, bool read_only)
+{
+    l2_table[TEST_BLOCK] = region_pa(region) | DESC_BLOCK |
+                           (read_only ? DESC_AP_RO : 0);
+}
+
+static void map_pages(int region)
+{
+    int i;
+
+    for (i = 0; i < BLOCK_PAGES; i++) {
+        l3_table[i] = (region_pa(region) + i * PAGE_SIZE) | DESC_PAGE;
+    }
+    l2_table[TEST_BLOCK] = (uint64_t)l3_table | DESC_TABLE;
+}
+
+/* Break before make, when a block is replaced by a table or back */
+static void unmap(void)
+{
+    l2_table[TEST_BLOCK] = 0;
+}
+
+static void barrier(void)
+{
+    asm volatile("dsb ishst\n\tisb" : : : "memory");
+}
+
+static void tlbi_all(void)
+{
+    asm volatile("dsb ishst\n\t"
+                 "tlbi vmalle1\n\t"
+                 "dsb ish\n\t"
+                 "isb" : : : "memory");
+}
+
+static void tlbi_page(int page)
+{
+    asm volatile("dsb ishst\n\t"
+                 "tlbi vaae1, %0\n\t"
+                 "dsb ish\n\t"
+                 "isb"
+                 : : "r" (page_va(TEST_BLOCK, page) >> PAGE_SHIFT)
+                 : "memory");
+}
+
+/* Read every page of the test block and count the stale ones */
+static int check_pages(const char *what, int region)
+{
+    int errors = 0;
+    int i;
+
+    for (i = 0; i < BLOCK_PAGES; i++) {
+        uint64_t expect = page_value(region, i);
+        uint64_t val = *(volatile uint64_t *)page_va(TEST_BLOCK, i);
+
+        if (val != expect) {
+            if (errors++ < 8) {
+                ml_printf("FAIL: %s: page %d read %lx, expected %lx\n",
+                          what, i, val, expect);
+            }
+        }
+    }
+
+    ml_printf("%s: %d errors\n", what, errors);
+    return errors;
+}
+
+/* Store to a read-only page and check for a permission fault */
+static int check_store_faults(const char *what, int page)
+{
+    uint64_t va = page_va(TEST_BLOCK, page);
+
+    fault_esr = 0;
+    fault_far = 0;
+    asm volatile("str xzr, [%0]" : : "r" (va) : "memory");
+
+    if ((fault_esr >> 26) != ESR_EC_DABT_CUR ||
+        (fault_esr & 0x3c) != ESR_DFSC_PERM || fault_far != va) {
+        ml_printf("FAIL: %s: store to page %d: esr %lx far %lx\n",
+                  what, page, fault_esr, fault_far);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    uint64_t *l1 = (uint64_t *)(read_sysreg(ttbr0_el1) &
+                                ((1UL << 48) - PAGE_SIZE));
+    int errors = 0;
+    int region, i;
+
+    ml_printf("Large Page TLB Test\n");
+
+    write_sysreg(vbar_el1, fault_vectors);
+
+    /*
+     * Fill both regions through a view; the level 1 entry was invalid,
+     * so there is nothing to invalidate when it is installed.
+     */
+    l1[TEST_VA >> 30] = (uint64_t)l2_table | DESC_TABLE;
+    for (region = REGION_A; region <= REGION_B; region++) {
+        l2_table[VIEW_BLOCK] = region_pa(region) | DESC_BLOCK;
+        tlbi_all();
+        for (i = 0; i < BLOCK_PAGES; i++) {
+            *(uint64_t *)page_va(VIEW_BLOCK, i) = page_value(region, i);
+        }
+    }
+
+    map_block(REGION_A, false);
+    barrier();
+    errors += check_pages("block", REGION_A);
+
+    /* Any page of the block drops the whole large page */
+    map_block(REGION_B, false);
+    tlbi_page(FLUSH_PAGE);
+    errors += check_pages("remapped block, TLBI VAAE1", REGION_B);
+
+    /* With pages, nothing replaces the stale large page */
+    unmap();
+    tlbi_page(FLUSH_PAGE);
+    map_pages(REGION_A);
+    barrier();
+    errors += check_pages("block split into pages", REGION_A);
+
+    unmap();
+    tlbi_all();
+    map_block(REGION_A, false);
+    barrier();
+    errors += check_pages("block", REGION_A);
+
+    /* Stores must not be filled from the writable large page */
+    map_block(REGION_A, true);
+    tlbi_page(FLUSH_PAGE);
+    errors += check_store_faults("read-only block", BLOCK_PAGES - 1);
+    errors += check_pages("read-only block", REGION_A);
+    errors += check_store_faults("read-only block", 0);
+
+    map_block(REGION_B, false);
+    tlbi_all();
+    errors += check_pages("remapped block, TLBI VMALLE1", REGION_B);
+
+    ml_printf("%s\n", errors ? "FAIL" : "PASS");
+    return errors ? 1 : 0;
+}
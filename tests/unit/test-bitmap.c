@@ -117,10 +117,154 @@ static void bitmap_set_case(bmap_set_func set_func)
     g_free(bmap);
 }
 
+static void bitmap_test_and_set_atomic_void(unsigned long *map, long i,
+                                            long len)
+{
+    bitmap_test_and_set_atomic(map, i, len);
+}
+
 static void check_bitmap_set(void)
 {
     bitmap_set_case(bitmap_set);
     bitmap_set_case(bitmap_set_atomic);
+    bitmap_set_case(bitmap_test_and_set_atomic_void);
+}
+
+static void check_bitmap_test_and_set_atomic(void)
+{
+    unsigned long *bmap;
+    int offset;
+
+    bmap = bitmap_new(BMAP_SIZE);
+
+    for (offset = 0; offset <= BITS_PER_LONG; offset++) {
+        bitmap_clear(bmap, 0, BMAP_SIZE);
+        /* Range spanning partial, full and partial words */
+        g_assert_true(bitmap_test_and_set_atomic(bmap, offset,
+                                                 2 * BITS_PER_LONG + 1));
+        g_assert_false(bitmap_test_and_set_atomic(bmap, offset,
+                                                  2 * BITS_PER_LONG + 1));
+        g_assert_false(bitmap_test_and_set_atomic(bmap, offset + 1, 1));
+
+        /* A single clear bit in a full word is reported */
+        clear_bit(offset + BITS_PER_LONG, bmap);
+        g_assert_true(bitmap_test_and_set_atomic(bmap, offset,
+                                                 2 * BITS_PER_LONG + 1));
+        g_assert_true(test_bit(offset + BITS_PER_LONG, bmap));
+
+        /* Bits outside the range do not count */
+        g_assert_false(bitmap_test_and_set_atomic(bmap, offset + 1,
+                                                  2 * BITS_PER_LONG));
+        g_assert_cmpint(find_next_bit(bmap, BMAP_SIZE,
+                                      offset + 2 * BITS_PER_LONG + 1),
+                        ==, BMAP_SIZE);
+    }
+
+    g_free(bmap);
+}
+
+#define SUMMARY_SIZE  (BMAP_SIZE - 3)
+
+/*
+ * Every word of @bmap with a bit set must be marked in @summary, and
+ * bitmap_summary_find_next() must agree with find_next_bit().
+ */
+static void check_summary_consistent(unsigned long *bmap,
+                                     unsigned long *summary)
+{
+    unsigned long i;
+
+    for (i = 0; i < BITS_TO_LONGS(SUMMARY_SIZE); i++) {
+        if (bmap[i]) {
+            g_assert_true(test_bit(i, summary));
+        }
+    }
+
+    for (i = 0; i <= SUMMARY_SIZE; i++) {
+        g_assert_cmpint(bitmap_summary_find_next(bmap, summary,
+                                                 SUMMARY_SIZE, i),
+                        ==, find_next_bit(bmap, SUMMARY_SIZE, i));
+    }
+}
+
+static void check_bitmap_summary(void)
+{
+    unsigned long *bmap, *summary, *src;
+    unsigned long i, page;
+
+    bmap = bitmap_new(SUMMARY_SIZE);
+    summary = bitmap_new(BITS_TO_LONGS(SUMMARY_SIZE));
+    src = bitmap_new(SUMMARY_SIZE);
+
+    /* Empty bitmap, nothing to find */
+    check_summary_consistent(bmap, summary);
+    g_assert_cmpint(bitmap_summary_find_next(bmap, summary, SUMMARY_SIZE, 0),
+                    ==, SUMMARY_SIZE);
+
+    /* Initial all-dirty bitmap, including the partial last word */
+    bitmap_set(bmap, 0, SUMMARY_SIZE);
+    bitmap_summary_set(summary, 0, SUMMARY_SIZE);
+    check_summary_consistent(bmap, summary);
+
+    /* Clearing bits does not touch the summary, stale bits are dropped */
+    bitmap_clear(bmap, 0, SUMMARY_SIZE);
+    check_summary_consistent(bmap, summary);
+    g_assert_true(bitmap_empty(summary, BITS_TO_LONGS(SUMMARY_SIZE)));
+
+    /* Single pages, like the dirty ring or the unaligned sync path */
+    for (i = 0; i < 16; i++) {
+        page = g_test_rand_int_range(0, SUMMARY_SIZE);
+        set_bit(page, bmap);
+        bitmap_summary_set(summary, page, 1);
+        check_summary_consistent(bmap, summary);
+    }
+
+    /* A range crossing words, like host page canonicalization */
+    bitmap_set(bmap, BITS_PER_LONG - 5, BITS_PER_LONG + 10);
+    bitmap_summary_set(summary, BITS_PER_LONG - 5, BITS_PER_LONG + 10);
+    check_summary_consistent(bmap, summary);
+
+    /* Send some of the pages */
+    for (i = 0; i < SUMMARY_SIZE; i += 3) {
+        clear_bit(i, bmap);
+    }
+    check_summary_consistent(bmap, summary);
+
+    /* Word-wise merge, like the aligned sync path */
+    for (i = 0; i < BITS_TO_LONGS(SUMMARY_SIZE); i++) {
+        src[i] = (i & 1) ? g_test_rand_int() : 0;
+    }
+    src[BITS_TO_LONGS(SUMMARY_SIZE) - 1] &= BITMAP_LAST_WORD_MASK(SUMMARY_SIZE);
+    for (i = 0; i < BITS_TO_LONGS(SUMMARY_SIZE); i++) {
+        if (src[i]) {
+            bmap[i] |= src[i];
+            bitmap_summary_set(summary, i * BITS_PER_LONG, BITS_PER_LONG);
+        }
+    }
+    check_summary_consistent(bmap, summary);
+
+    /*
+     * Postcopy recovery: the received bitmap is complemented and the
+     * whole summary set, then discarded ranges are cleared.
+     */
+    bitmap_complement(bmap, bmap, SUMMARY_SIZE);
+    bitmap_summary_set(summary, 0, SUMMARY_SIZE);
+    check_summary_consistent(bmap, summary);
+    bitmap_clear(bmap, 2 * BITS_PER_LONG, 4 * BITS_PER_LONG);
+    check_summary_consistent(bmap, summary);
+
+    /* Drain everything as the migration thread would */
+    page = bitmap_summary_find_next(bmap, summary, SUMMARY_SIZE, 0);
+    while (page < SUMMARY_SIZE) {
+        clear_bit(page, bmap);
+        page = bitmap_summary_find_next(bmap, summary, SUMMARY_SIZE, page);
+    }
+    g_assert_true(bitmap_empty(bmap, SUMMARY_SIZE));
+    g_assert_true(bitmap_empty(summary, BITS_TO_LONGS(SUMMARY_SIZE)));
+
+    g_free(src);
+    g_free(summary);
+    g_free(bmap);
 }
 
 int main(int argc, char **argv)
@@ -131,6 +275,10 @@ int main(int argc, char **argv)
                     check_bitmap_copy_with_offset);
     g_test_add_func("/bitmap/bitmap_set",
                     check_bitmap_set);
+    g_test_add_func("/bitmap/bitmap_test_and_set_atomic",
+                    check_bitmap_test_and_set_atomic);
+    g_test_add_func("/bitmap/bitmap_summary",
+                    check_bitmap_summary);
 
     g_test_run();
 
@@ -0,0 +1,129 @@
+/*
+ * Test the per-thread pool of DMA bounce buffers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bounce-pool.h"
+#include "qemu/thread.h"
+
+#define LARGEST_CLASS (BOUNCE_POOL_CLASSES - 1)
+
+static BouncePoolEntry *entry_new(int size_class)
+{
+    BouncePoolEntry *entry;
+
+    entry = g_malloc(sizeof(*entry) + bounce_pool_class_size(size_class));
+    entry->size_class = size_class;
+    return entry;
+}
+
+/* Free what the calling thread's pool holds */
+static void drain(void)
+{
+    BouncePoolEntry *entry;
+    int i;
+
+    for (i = 0; i < BOUNCE_POOL_CLASSES; i++) {
+        while ((entry = bounce_pool_get(i))) {
+            g_free(entry);
+        }
+    }
+}
+
+static void test_size_class(void)
+{
+    g_assert_cmpint(bounce_pool_size_class(1), ==, 0);
+    g_assert_cmpint(bounce_pool_size_class(4 * KiB), ==, 0);
+    g_assert_cmpint(bounce_pool_size_class(4 * KiB + 1), ==, 1);
+    g_assert_cmpint(bounce_pool_size_class(8 * KiB), ==, 1);
+    g_assert_cmpint(bounce_pool_size_class(1 * MiB - 1), ==, LARGEST_CLASS);
+    g_assert_cmpint(bounce_pool_size_class(1 * MiB), ==, LARGEST_CLASS);
+    g_assert_cmpint(bounce_pool_size_class(1 * MiB + 1), ==, -1);
+
+    g_assert_cmpuint(bounce_pool_class_size(0), ==, 4 * KiB);
+    g_assert_cmpuint(bounce_pool_class_size(1), ==, 8 * KiB);
+    g_assert_cmpuint(bounce_pool_class_size(LARGEST_CLASS), ==, 1 * MiB);
+}
+
+static void test_reuse(void)
+{
+    BouncePoolEntry *entry = entry_new(0);
+
+    g_assert_null(bounce_pool_get(0));
+    g_assert_true(bounce_pool_put(entry));
+
+    /* Only a buffer of the same size class is reused */
+    g_assert_null(bounce_pool_get(1));
+    g_assert_true(bounce_pool_get(0) == entry);
+    g_assert_null(bounce_pool_get(0));
+
+    /* Buffers larger than 1 MiB are never pooled */
+    entry->size_class = bounce_pool_size_class(1 * MiB + 1);
+    g_assert_false(bounce_pool_put(entry));
+    g_free(entry);
+}
+
+static void test_max_cached(void)
+{
+    BouncePoolEntry *small = entry_new(0), *large;
+    int i;
+
+    for (i = 0; i < BOUNCE_POOL_MAX_CACHED / MiB; i++) {
+        g_assert_true(bounce_pool_put(entry_new(LARGEST_CLASS)));
+    }
+
+    /* The pool is full, even for the smallest buffers */
+    large = entry_new(LARGEST_CLASS);
+    g_assert_false(bounce_pool_put(large));
+    g_assert_false(bounce_pool_put(small));
+    g_free(large);
+
+    /* Taking a buffer out makes room again */
+    large = bounce_pool_get(LARGEST_CLASS);
+    g_assert_nonnull(large);
+    g_free(large);
+    g_assert_true(bounce_pool_put(small));
+
+    drain();
+}
+
+static void *put_in_thread(void *opaque)
+{
+    BouncePoolEntry *entry = opaque;
+
+    /* The main thread's buffer is not visible here */
+    g_assert_null(bounce_pool_get(0));
+    g_assert_true(bounce_pool_put(entry));
+    g_assert_true(bounce_pool_get(0) == entry);
+
+    /* Left for the thread exit notifier to free */
+    g_assert_true(bounce_pool_put(entry));
+    return NULL;
+}
+
+static void test_per_thread(void)
+{
+    BouncePoolEntry *entry = entry_new(0);
+    QemuThread thread;
+
+    g_assert_true(bounce_pool_put(entry));
+    qemu_thread_create(&thread, "bounce-pool", put_in_thread, entry_new(0),
+                       QEMU_THREAD_JOINABLE);
+    qemu_thread_join(&thread);
+
+    g_assert_true(bounce_pool_get(0) == entry);
+    g_assert_null(bounce_pool_get(0));
+    g_free(entry);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/bounce-pool/size-class", test_size_class);
+    g_test_add_func("/bounce-pool/reuse", test_reuse);
+    g_test_add_func("/bounce-pool/max-cached", test_max_cached);
+    g_test_add_func("/bounce-pool/per-thread", test_per_thread);
+    return g_test_run();
+}
@@ -0,0 +1,121 @@
+/*
+ * Test the host vector versions of the gvec helpers against the
+ * integer ones
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/gvec-accel.h"
+
+#define MAX_OPRSZ   256
+
+static const GVecAccel *accels[8];
+static int nb_accels;
+
+static uint8_t a[MAX_OPRSZ], b[MAX_OPRSZ];
+
+static void fill_inputs(void)
+{
+    for (int i = 0; i < MAX_OPRSZ; i++) {
+        a[i] = g_test_rand_int();
+        /* Make equal and saturating elements likely */
+        switch (g_test_rand_int_range(0, 4)) {
+        case 0:
+            b[i] = a[i];
+            break;
+        case 1:
+            b[i] = a[i] ^ 0x80;
+            break;
+        default:
+            b[i] = g_test_rand_int();
+            break;
+        }
+    }
+}
+
+static void check3(const char *op, GVecAccel3Fn *ref, GVecAccel3Fn *fn,
+                   intptr_t oprsz)
+{
+    uint8_t expected[MAX_OPRSZ], d[MAX_OPRSZ];
+
+    ref(expected, a, b, oprsz);
+    fn(d, a, b, oprsz);
+    if (memcmp(expected, d, oprsz)) {
+        g_test_message("%s with oprsz %" PRIdPTR, op, (intptr_t)oprsz);
+        g_assert_not_reached();
+    }
+
+    /* The destination may be one of the inputs */
+    memcpy(d, a, oprsz);
+    fn(d, d, b, oprsz);
+    g_assert(memcmp(expected, d, oprsz) == 0);
+}
+
+static void check_shift(const char *op, GVecAccelShiftFn *ref,
+                        GVecAccelShiftFn *fn, unsigned shift, intptr_t oprsz)
+{
+    uint8_t expected[MAX_OPRSZ], d[MAX_OPRSZ];
+
+    ref(expected, a, shift, oprsz);
+    fn(d, a, shift, oprsz);
+    if (memcmp(expected, d, oprsz)) {
+        g_test_message("%s by %u with oprsz %" PRIdPTR, op, shift,
+                       (intptr_t)oprsz);
+        g_assert_not_reached();
+    }
+}
+
+#define CHECK3(OP) \
+    check3(#OP, ref->OP[vece], acc->OP[vece], oprsz)
+#define CHECK_SHIFT(OP) \
+    check_shift(#OP, ref->OP[vece], acc->OP[vece], shift, oprsz)
+
+static void test_accel(const void *opaque)
+{
+    const GVecAccel *acc = opaque;
+    const GVecAccel *ref = accels[nb_accels - 1];
+
+    for (int iter = 0; iter < 1000; iter++) {
+        /* A multiple of 8 bytes, as for simd_oprsz() */
+        intptr_t oprsz = g_test_rand_int_range(1, MAX_OPRSZ / 8 + 1) * 8;
+
+        fill_inputs();
+        for (int vece = 0; vece < 4; vece++) {
+            unsigned shift = g_test_rand_int_range(0, 8 << vece);
+
+            CHECK3(ssadd);
+            CHECK3(sssub);
+            CHECK3(usadd);
+            CHECK3(ussub);
+            CHECK3(eq);
+            CHECK3(ne);
+            CHECK3(lt);
+            CHECK3(le);
+            CHECK3(ltu);
+            CHECK3(leu);
+            CHECK_SHIFT(shli);
+            CHECK_SHIFT(shri);
+            CHECK_SHIFT(sari);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    /* The last one is the integer version, used as the reference */
+    do {
+        g_assert(nb_accels < ARRAY_SIZE(accels));
+        accels[nb_accels++] = gvec_accel;
+    } while (test_gvec_next_accel());
+
+    for (int i = 0; i < nb_accels - 1; i++) {
+        g_autofree char *path = g_strdup_printf("/gvec-accel/%s",
+                                                accels[i]->name);
+        g_test_add_data_func(path, accels[i], test_accel);
+    }
+
+    return g_test_run();
+}
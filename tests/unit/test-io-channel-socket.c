@@ -26,6 +26,7 @@
 #include "qapi/error.h"
 #include "qemu/module.h"
 #include "qemu/main-loop.h"
+#include "qemu/thread.h"
 
 
 static void test_io_channel_set_socket_bufs(QIOChannel *src,
@@ -560,6 +561,123 @@ static void test_io_channel_ipv4_fd(void)
 }
 
 
+#define TEST_WAITALL_CHUNK 4096
+#define TEST_WAITALL_LEN (64 * TEST_WAITALL_CHUNK)
+
+typedef struct {
+    QIOChannel *src;
+    const char *buf;
+    size_t len;
+} TestWaitallWriter;
+
+/* Send the data in small chunks so that the reader sees short reads */
+static void *test_io_channel_waitall_writer(void *opaque)
+{
+    TestWaitallWriter *w = opaque;
+    size_t done;
+
+    for (done = 0; done < w->len; done += TEST_WAITALL_CHUNK) {
+        qio_channel_write_all(w->src, w->buf + done,
+                              MIN(TEST_WAITALL_CHUNK, w->len - done),
+                              &error_abort);
+        g_usleep(100);
+    }
+    qio_channel_shutdown(w->src, QIO_CHANNEL_SHUTDOWN_WRITE, &error_abort);
+    return NULL;
+}
+
+static void test_io_channel_waitall(size_t send_len)
+{
+    SocketAddress *listen_addr = g_new0(SocketAddress, 1);
+    SocketAddress *connect_addr = g_new0(SocketAddress, 1);
+    QIOChannel *src, *dst, *srv;
+    TestWaitallWriter w;
+    QemuThread thread;
+    g_autofree char *sendbuf = g_malloc(TEST_WAITALL_LEN);
+    g_autofree char *recvbuf = g_malloc0(TEST_WAITALL_LEN);
+    struct iovec iov[3];
+    Error *err = NULL;
+    size_t i;
+    int ret;
+
+    listen_addr->type = SOCKET_ADDRESS_TYPE_INET;
+    listen_addr->u.inet = (InetSocketAddress) {
+        .host = g_strdup("127.0.0.1"),
+        .port = NULL, /* Auto-select */
+    };
+
+    connect_addr->type = SOCKET_ADDRESS_TYPE_INET;
+    connect_addr->u.inet = (InetSocketAddress) {
+        .host = g_strdup("127.0.0.1"),
+        .port = NULL, /* Filled in later */
+    };
+
+    test_io_channel_setup_sync(listen_addr, connect_addr, &srv, &src, &dst);
+
+    g_assert(qio_channel_has_feature(src, QIO_CHANNEL_FEATURE_READ_WAITALL));
+    g_assert(qio_channel_has_feature(dst, QIO_CHANNEL_FEATURE_READ_WAITALL));
+
+    for (i = 0; i < TEST_WAITALL_LEN; i++) {
+        sendbuf[i] = i * 7;
+    }
+
+    /* Uneven iovecs, so that chunks straddle their boundaries */
+    iov[0].iov_base = recvbuf;
+    iov[0].iov_len = 1000;
+    iov[1].iov_base = recvbuf + 1000;
+    iov[1].iov_len = TEST_WAITALL_LEN / 2;
+    iov[2].iov_base = recvbuf + 1000 + TEST_WAITALL_LEN / 2;
+    iov[2].iov_len = TEST_WAITALL_LEN - 1000 - TEST_WAITALL_LEN / 2;
+
+    w = (TestWaitallWriter) {
+        .src = src,
+        .buf = sendbuf,
+        .len = send_len,
+    };
+    qemu_thread_create(&thread, "waitall-writer",
+                       test_io_channel_waitall_writer, &w,
+                       QEMU_THREAD_JOINABLE);
+
+    ret = qio_channel_readv_full_all_eof(dst, iov, G_N_ELEMENTS(iov),
+                                         NULL, NULL,
+                                         QIO_CHANNEL_READ_FLAG_WAITALL, &err);
+    qemu_thread_join(&thread);
+
+    if (send_len == TEST_WAITALL_LEN) {
+        g_assert_null(err);
+        g_assert_cmpint(ret, ==, 1);
+    } else {
+        /* The peer closed the connection in the middle of the data */
+        error_free_or_abort(&err);
+        g_assert_cmpint(ret, ==, -1);
+    }
+    g_assert(memcmp(sendbuf, recvbuf, send_len) == 0);
+
+    /* Listening sockets cannot wait for data */
+    g_assert(!qio_channel_has_feature(srv, QIO_CHANNEL_FEATURE_READ_WAITALL));
+    g_assert_cmpint(qio_channel_readv_full(srv, iov, 1, NULL, NULL,
+                                           QIO_CHANNEL_READ_FLAG_WAITALL,
+                                           &err), ==, -1);
+    error_free_or_abort(&err);
+
+    object_unref(OBJECT(src));
+    object_unref(OBJECT(dst));
+    object_unref(OBJECT(srv));
+    qapi_free_SocketAddress(listen_addr);
+    qapi_free_SocketAddress(connect_addr);
+}
+
+static void test_io_channel_ipv4_waitall(void)
+{
+    test_io_channel_waitall(TEST_WAITALL_LEN);
+}
+
+static void test_io_channel_ipv4_waitall_eof(void)
+{
+    test_io_channel_waitall(TEST_WAITALL_LEN / 2 + 3 * TEST_WAITALL_CHUNK);
+}
+
+
 int main(int argc, char **argv)
 {
     bool has_ipv4, has_ipv6, has_afunix;
@@ -587,6 +705,10 @@ int main(int argc, char **argv)
                         test_io_channel_ipv4_async);
         g_test_add_func("/io/channel/socket/ipv4-fd",
                         test_io_channel_ipv4_fd);
+        g_test_add_func("/io/channel/socket/ipv4-waitall",
+                        test_io_channel_ipv4_waitall);
+        g_test_add_func("/io/channel/socket/ipv4-waitall-eof",
+                        test_io_channel_ipv4_waitall_eof);
     }
     if (has_ipv6) {
         g_test_add_func("/io/channel/socket/ipv6-sync",
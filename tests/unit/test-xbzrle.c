@@ -12,10 +12,16 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qapi/error.h"
 #include "../migration/xbzrle.h"
+#include "../migration/page_cache.h"
 
 #define XBZRLE_PAGE_SIZE 4096
 
+/* From the best encoder for the host down to the integer one */
+static xbzrle_encode_fn accels[4];
+static int nb_accels;
+
 static void test_uleb(void)
 {
     uint32_t i, val;
@@ -173,10 +179,87 @@ static void test_encode_decode(void)
     }
 }
 
+static void test_encode_accel(void)
+{
+    xbzrle_encode_fn ref = accels[nb_accels - 1];
+    uint8_t *old_buf = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *new_buf = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *expected = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int i, j, k, dlen, slen, rc, ref_rc;
+
+    for (i = 0; i < 1000; i++) {
+        /* A multiple of 8 bytes, as for the integer version */
+        slen = g_test_rand_int_range(1, XBZRLE_PAGE_SIZE / 8 + 1) * 8;
+        dlen = g_test_rand_int_range(1, slen + 1);
+        for (j = 0; j < slen; j++) {
+            old_buf[j] = g_test_rand_int();
+            new_buf[j] = g_test_rand_int_range(0, 8) ? old_buf[j]
+                                                     : g_test_rand_int();
+        }
+
+        /* Each version must produce the same output as the integer one */
+        ref_rc = ref(old_buf, new_buf, slen, expected, dlen);
+        for (k = 0; k < nb_accels - 1; k++) {
+            rc = accels[k](old_buf, new_buf, slen, compressed, dlen);
+            g_assert_cmpint(rc, ==, ref_rc);
+            g_assert(rc <= 0 || memcmp(compressed, expected, rc) == 0);
+        }
+    }
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(expected);
+    g_free(compressed);
+}
+
+static void test_page_cache(void)
+{
+    const size_t page_size = 64;
+    uint8_t page[64], *data;
+    PageCache *cache;
+    uint64_t addr;
+
+    /* A single set: the pages all compete with each other */
+    cache = cache_init(4 * page_size, page_size, &error_abort);
+    for (addr = 0; addr < 4 * page_size; addr += page_size) {
+        memset(page, addr / page_size, page_size);
+        g_assert_cmpint(cache_insert(cache, addr, page, 1), ==, 0);
+    }
+    for (addr = 0; addr < 4 * page_size; addr += page_size) {
+        g_assert(cache_is_cached(cache, addr, 1));
+        data = get_cached_data(cache, addr);
+        g_assert_cmpint(data[0], ==, addr / page_size);
+    }
+
+    /* All pages are fresh, so nothing can be replaced */
+    g_assert_cmpint(cache_insert(cache, 4 * page_size, page, 2), ==, -1);
+    g_assert(!cache_is_cached(cache, 4 * page_size, 2));
+
+    /* Once they are old, the least recently used one goes */
+    g_assert(cache_is_cached(cache, 0, 3));
+    g_assert(cache_is_cached(cache, 2 * page_size, 3));
+    g_assert(cache_is_cached(cache, 3 * page_size, 3));
+    g_assert_cmpint(cache_insert(cache, 4 * page_size, page, 3), ==, 0);
+    g_assert(!cache_is_cached(cache, page_size, 3));
+    g_assert(cache_is_cached(cache, 4 * page_size, 3));
+    g_assert(cache_is_cached(cache, 0, 3));
+
+    cache_fini(cache);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
     g_test_rand_int();
+
+    do {
+        g_assert(nb_accels < ARRAY_SIZE(accels));
+        accels[nb_accels++] = xbzrle_encode_accel;
+    } while (test_xbzrle_next_accel());
+    /* The other tests use the best one, as migration does */
+    xbzrle_encode_accel = accels[0];
+
     g_test_add_func("/xbzrle/uleb", test_uleb);
     g_test_add_func("/xbzrle/encode_decode_zero", test_encode_decode_zero);
     g_test_add_func("/xbzrle/encode_decode_unchanged",
@@ -185,6 +268,8 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
+    g_test_add_func("/xbzrle/page_cache", test_page_cache);
 
     return g_test_run();
 }
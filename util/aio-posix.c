@@ -16,6 +16,7 @@
 #include "qemu/osdep.h"
 #include "block/block.h"
 #include "block/thread-pool.h"
+#include "qapi/error.h"
 #include "qemu/main-loop.h"
 #include "qemu/rcu.h"
 #include "qemu/rcu_queue.h"
@@ -787,3 +788,43 @@ void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 
     aio_notify(ctx);
 }
+
+void aio_context_set_io_uring_params(AioContext *ctx, IOThreadIoUringMode mode,
+                                     Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    unsigned flags = 0;
+
+    switch (mode) {
+    case IO_THREAD_IO_URING_MODE_DEFAULT:
+        break;
+    case IO_THREAD_IO_URING_MODE_SQPOLL:
+        flags = IORING_SETUP_SQPOLL;
+        break;
+    case IO_THREAD_IO_URING_MODE_DEFER_TASKRUN:
+#ifdef IORING_SETUP_DEFER_TASKRUN
+        flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+                IORING_SETUP_TASKRUN_FLAG;
+        break;
+#else
+        error_setg(errp, "io_uring mode 'defer-taskrun' requires liburing "
+                   "2.3 or newer");
+        return;
+#endif
+    default:
+        g_assert_not_reached();
+    }
+
+    if (ctx->linux_io_uring && flags != ctx->io_uring_setup_flags) {
+        error_setg(errp, "io_uring mode cannot be changed while block "
+                   "devices use io_uring");
+        return;
+    }
+
+    ctx->io_uring_setup_flags = flags;
+#else
+    if (mode != IO_THREAD_IO_URING_MODE_DEFAULT) {
+        error_setg(errp, "io_uring support is not available");
+    }
+#endif
+}
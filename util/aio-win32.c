@@ -441,3 +441,11 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
 }
+
+void aio_context_set_io_uring_params(AioContext *ctx, IOThreadIoUringMode mode,
+                                     Error **errp)
+{
+    if (mode != IO_THREAD_IO_URING_MODE_DEFAULT) {
+        error_setg(errp, "io_uring is not available on Windows");
+    }
+}
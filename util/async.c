@@ -464,17 +464,22 @@ LinuxAioState *aio_get_linux_aio(AioContext *ctx)
 #ifdef CONFIG_LINUX_IO_URING
 LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
 {
+    LuringState *s;
+
     if (ctx->linux_io_uring) {
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
-    if (!ctx->linux_io_uring) {
+    s = luring_init(ctx->io_uring_setup_flags, errp);
+    if (!s) {
         return NULL;
     }
 
-    luring_attach_aio_context(ctx->linux_io_uring, ctx);
-    return ctx->linux_io_uring;
+    luring_attach_aio_context(s, ctx);
+
+    /* Pairs with qatomic_read() in query-iothreads */
+    qatomic_set(&ctx->linux_io_uring, s);
+    return s;
 }
 
 LuringState *aio_get_linux_io_uring(AioContext *ctx)
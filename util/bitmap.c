@@ -218,6 +218,57 @@ void bitmap_set_atomic(unsigned long *map, long start, long nr)
     }
 }
 
+/*
+ * Like bitmap_set_atomic(), but returns true if any of the bits was
+ * clear before, i.e. if this caller is the one that set it.
+ */
+bool bitmap_test_and_set_atomic(unsigned long *map, long start, long nr)
+{
+    unsigned long *p = map + BIT_WORD(start);
+    const long size = start + nr;
+    int bits_to_set = BITS_PER_LONG - (start % BITS_PER_LONG);
+    unsigned long mask_to_set = BITMAP_FIRST_WORD_MASK(start);
+    unsigned long clean = 0;
+    unsigned long old_bits;
+
+    assert(start >= 0 && nr >= 0);
+
+    /* First word */
+    if (nr - bits_to_set > 0) {
+        old_bits = qatomic_fetch_or(p, mask_to_set);
+        clean |= ~old_bits & mask_to_set;
+        nr -= bits_to_set;
+        bits_to_set = BITS_PER_LONG;
+        mask_to_set = ~0UL;
+        p++;
+    }
+
+    /* Full words */
+    if (bits_to_set == BITS_PER_LONG) {
+        while (nr >= BITS_PER_LONG) {
+            if (~qatomic_read(p)) {
+                old_bits = qatomic_xchg(p, ~0UL);
+                clean |= ~old_bits;
+            }
+            nr -= BITS_PER_LONG;
+            p++;
+        }
+    }
+
+    /* Last word */
+    if (nr) {
+        mask_to_set &= BITMAP_LAST_WORD_MASK(size);
+        old_bits = qatomic_fetch_or(p, mask_to_set);
+        clean |= ~old_bits & mask_to_set;
+    } else {
+        if (!clean) {
+            smp_mb();
+        }
+    }
+
+    return clean != 0;
+}
+
 void bitmap_clear(unsigned long *map, long start, long nr)
 {
     unsigned long *p = map + BIT_WORD(start);
@@ -532,3 +583,54 @@ void bitmap_copy_with_dst_offset(unsigned long *dst, const unsigned long *src,
         *dst |= (*src & last_mask) << shift;
     }
 }
+
+/*
+ * Mark the words of a bitmap covering bits [start, start + nr) in its
+ * summary.  The summary has one bit per word of the bitmap it describes.
+ */
+void bitmap_summary_set(unsigned long *summary, long start, long nr)
+{
+    long first = BIT_WORD(start);
+
+    if (nr <= 0) {
+        return;
+    }
+
+    bitmap_set(summary, first, BIT_WORD(start + nr - 1) - first + 1);
+}
+
+/*
+ * Same as find_next_bit() on "map", but only read the words of "map"
+ * whose bit is set in "summary".  A clear summary bit means that the
+ * word is clean; a set one may be stale, and is cleared here if the
+ * word turns out to be clean.  This is still a linear scan, of the
+ * summary instead of the bitmap.
+ */
+unsigned long bitmap_summary_find_next(unsigned long *map,
+                                       unsigned long *summary,
+                                       unsigned long size,
+                                       unsigned long offset)
+{
+    unsigned long nwords = BITS_TO_LONGS(size);
+    unsigned long word, bits;
+
+    if (offset >= size) {
+        return size;
+    }
+
+    word = BIT_WORD(offset);
+    bits = map[word] & BITMAP_FIRST_WORD_MASK(offset);
+    while (!bits) {
+        /* Only drop the summary bit if the whole word is clean */
+        if (!map[word]) {
+            clear_bit(word, summary);
+        }
+        word = find_next_bit(summary, nwords, word + 1);
+        if (word >= nwords) {
+            return size;
+        }
+        bits = map[word];
+    }
+
+    return MIN(word * BITS_PER_LONG + ctzl(bits), size);
+}
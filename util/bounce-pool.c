@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Per-thread pool of DMA bounce buffers
+ *
+ * Freed bounce buffers are kept in a per-thread pool, with one list for
+ * each power-of-two size from 4 KiB to 1 MiB, so that devices that keep
+ * mapping indirect memory do not go through the allocator (and, for
+ * large buffers, mmap and page faults) for every mapping.  Larger
+ * buffers are not pooled, and each thread keeps at most
+ * BOUNCE_POOL_MAX_CACHED bytes.
+ *
+ * The pool only tracks the payload size of each buffer; users allocate
+ * bounce_pool_class_size() bytes of payload after their own header, of
+ * which BouncePoolEntry is the first member:
+ *
+ *   entry = bounce_pool_get(size_class);  <-- NULL if the pool is empty
+ *   ...
+ *   if (!bounce_pool_put(entry)) {        <-- false if the pool is full
+ *       g_free(entry);
+ *   }
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bounce-pool.h"
+#include "qemu/host-utils.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+
+typedef struct BouncePool {
+    QSLIST_HEAD(, BouncePoolEntry) free[BOUNCE_POOL_CLASSES];
+    size_t cached;
+} BouncePool;
+
+static __thread BouncePool bounce_pool;
+static __thread Notifier bounce_pool_cleanup_notifier;
+
+/* Called at thread cleanup time */
+static void bounce_pool_cleanup(Notifier *n, void *value)
+{
+    BouncePoolEntry *entry;
+    int i;
+
+    for (i = 0; i < BOUNCE_POOL_CLASSES; i++) {
+        while ((entry = QSLIST_FIRST(&bounce_pool.free[i]))) {
+            QSLIST_REMOVE_HEAD(&bounce_pool.free[i], next);
+            g_free(entry);
+        }
+    }
+    bounce_pool.cached = 0;
+}
+
+/**
+ * bounce_pool_size_class:
+ * @len: the number of bytes the buffer must hold
+ *
+ * Returns the size class of a buffer for @len bytes, or -1 if it is too
+ * large to be pooled.
+ */
+int bounce_pool_size_class(size_t len)
+{
+    int shift = len <= 1 ? 0 : 64 - clz64(len - 1);
+
+    if (shift > BOUNCE_POOL_MAX_SHIFT) {
+        return -1;
+    }
+    return MAX(shift, BOUNCE_POOL_MIN_SHIFT) - BOUNCE_POOL_MIN_SHIFT;
+}
+
+/**
+ * bounce_pool_class_size:
+ * @size_class: a size class returned by bounce_pool_size_class()
+ *
+ * Returns the number of bytes held by buffers of @size_class.
+ */
+size_t bounce_pool_class_size(int size_class)
+{
+    assert(size_class >= 0 && size_class < BOUNCE_POOL_CLASSES);
+    return (size_t)1 << (size_class + BOUNCE_POOL_MIN_SHIFT);
+}
+
+/**
+ * bounce_pool_get:
+ * @size_class: a size class returned by bounce_pool_size_class()
+ *
+ * Take a buffer of @size_class out of the calling thread's pool.  Returns
+ * NULL if there is none; the caller then allocates a new one.
+ */
+BouncePoolEntry *bounce_pool_get(int size_class)
+{
+    BouncePoolEntry *entry = QSLIST_FIRST(&bounce_pool.free[size_class]);
+
+    if (entry) {
+        QSLIST_REMOVE_HEAD(&bounce_pool.free[size_class], next);
+        bounce_pool.cached -= bounce_pool_class_size(size_class);
+    }
+    return entry;
+}
+
+/**
+ * bounce_pool_put:
+ * @entry: the buffer to give back, with its size_class set
+ *
+ * Keep @entry in the calling thread's pool.  Returns false if it is not
+ * pooled, because it is too large or the pool is full; the caller then
+ * frees it.
+ */
+bool bounce_pool_put(BouncePoolEntry *entry)
+{
+    size_t size;
+
+    if (entry->size_class < 0) {
+        return false;
+    }
+
+    size = bounce_pool_class_size(entry->size_class);
+    if (bounce_pool.cached + size > BOUNCE_POOL_MAX_CACHED) {
+        return false;
+    }
+
+    if (!bounce_pool_cleanup_notifier.notify) {
+        bounce_pool_cleanup_notifier.notify = bounce_pool_cleanup;
+        qemu_thread_atexit_add(&bounce_pool_cleanup_notifier);
+    }
+    QSLIST_INSERT_HEAD(&bounce_pool.free[entry->size_class], entry, next);
+    bounce_pool.cached += size;
+    return true;
+}
@@ -0,0 +1,156 @@
+/*
+ * Host vector acceleration for the TCG generic vector runtime
+ *
+ * When the TCG backend lacks a vector operation, the guest operation is
+ * expanded into a call to one of the helpers in tcg-runtime-gvec.c.
+ * The compiler does not reliably vectorize the element loops of the
+ * saturating, comparison and shift helpers, so they are implemented
+ * here with the intrinsics of each host vector extension, and the best
+ * version available is selected at startup.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/gvec-accel.h"
+#include "host/cpuinfo.h"
+
+/* Saturating arithmetic on elements narrower than int */
+#define DO_SAT(NAME, TYPE, OP, LO, HI)                                      \
+static void NAME(void *d, const void *a, const void *b, intptr_t oprsz)   \
+{                                                                         \
+    for (intptr_t i = 0; i < oprsz; i += sizeof(TYPE)) {                  \
+        int r = *(const TYPE *)(a + i) OP *(const TYPE *)(b + i);         \
+        *(TYPE *)(d + i) = r < LO ? LO : r > HI ? HI : r;                 \
+    }                                                                     \
+}
+
+/* Saturating arithmetic using the overflow helpers of host-utils.h */
+#define DO_SAT_OVF(NAME, TYPE, FN, SAT)                                     \
+static void NAME(void *d, const void *a, const void *b, intptr_t oprsz)   \
+{                                                                         \
+    for (intptr_t i = 0; i < oprsz; i += sizeof(TYPE)) {                  \
+        TYPE r;                                                           \
+        if (FN(*(const TYPE *)(a + i), *(const TYPE *)(b + i), &r)) {     \
+            r = SAT;                                                      \
+        }                                                                 \
+        *(TYPE *)(d + i) = r;                                             \
+    }                                                                     \
+}
+
+DO_SAT(gvec_ssadd8_int, int8_t, +, INT8_MIN, INT8_MAX)
+DO_SAT(gvec_ssadd16_int, int16_t, +, INT16_MIN, INT16_MAX)
+DO_SAT_OVF(gvec_ssadd32_int, int32_t, sadd32_overflow,
+           r < 0 ? INT32_MAX : INT32_MIN)
+DO_SAT_OVF(gvec_ssadd64_int, int64_t, sadd64_overflow,
+           r < 0 ? INT64_MAX : INT64_MIN)
+
+DO_SAT(gvec_sssub8_int, int8_t, -, INT8_MIN, INT8_MAX)
+DO_SAT(gvec_sssub16_int, int16_t, -, INT16_MIN, INT16_MAX)
+DO_SAT_OVF(gvec_sssub32_int, int32_t, ssub32_overflow,
+           r < 0 ? INT32_MAX : INT32_MIN)
+DO_SAT_OVF(gvec_sssub64_int, int64_t, ssub64_overflow,
+           r < 0 ? INT64_MAX : INT64_MIN)
+
+DO_SAT(gvec_usadd8_int, uint8_t, +, 0, UINT8_MAX)
+DO_SAT(gvec_usadd16_int, uint16_t, +, 0, UINT16_MAX)
+DO_SAT_OVF(gvec_usadd32_int, uint32_t, uadd32_overflow, UINT32_MAX)
+DO_SAT_OVF(gvec_usadd64_int, uint64_t, uadd64_overflow, UINT64_MAX)
+
+DO_SAT(gvec_ussub8_int, uint8_t, -, 0, UINT8_MAX)
+DO_SAT(gvec_ussub16_int, uint16_t, -, 0, UINT16_MAX)
+DO_SAT_OVF(gvec_ussub32_int, uint32_t, usub32_overflow, 0)
+DO_SAT_OVF(gvec_ussub64_int, uint64_t, usub64_overflow, 0)
+
+#undef DO_SAT
+#undef DO_SAT_OVF
+
+#define DO_CMP1(NAME, TYPE, OP)                                             \
+static void NAME(void *d, const void *a, const void *b, intptr_t oprsz)   \
+{                                                                         \
+    for (intptr_t i = 0; i < oprsz; i += sizeof(TYPE)) {                  \
+        *(TYPE *)(d + i) = -(*(const TYPE *)(a + i) OP                    \
+                             *(const TYPE *)(b + i));                     \
+    }                                                                     \
+}
+
+#define DO_CMP2(SZ) \
+    DO_CMP1(gvec_eq##SZ##_int, uint##SZ##_t, ==)    \
+    DO_CMP1(gvec_ne##SZ##_int, uint##SZ##_t, !=)    \
+    DO_CMP1(gvec_lt##SZ##_int, int##SZ##_t, <)      \
+    DO_CMP1(gvec_le##SZ##_int, int##SZ##_t, <=)     \
+    DO_CMP1(gvec_ltu##SZ##_int, uint##SZ##_t, <)    \
+    DO_CMP1(gvec_leu##SZ##_int, uint##SZ##_t, <=)
+
+DO_CMP2(8)
+DO_CMP2(16)
+DO_CMP2(32)
+DO_CMP2(64)
+
+#undef DO_CMP1
+#undef DO_CMP2
+
+#define DO_SHIFT1(NAME, TYPE, OP)                                           \
+static void NAME(void *d, const void *a, unsigned shift, intptr_t oprsz)  \
+{                                                                         \
+    for (intptr_t i = 0; i < oprsz; i += sizeof(TYPE)) {                  \
+        *(TYPE *)(d + i) = *(const TYPE *)(a + i) OP shift;               \
+    }                                                                     \
+}
+
+#define DO_SHIFT2(SZ) \
+    DO_SHIFT1(gvec_shl##SZ##i_int, uint##SZ##_t, <<)  \
+    DO_SHIFT1(gvec_shr##SZ##i_int, uint##SZ##_t, >>)  \
+    DO_SHIFT1(gvec_sar##SZ##i_int, int##SZ##_t, >>)
+
+DO_SHIFT2(8)
+DO_SHIFT2(16)
+DO_SHIFT2(32)
+DO_SHIFT2(64)
+
+#undef DO_SHIFT1
+#undef DO_SHIFT2
+
+#define GVEC_INT_OPS(OP) \
+    { gvec_##OP##8_int, gvec_##OP##16_int, gvec_##OP##32_int, gvec_##OP##64_int }
+#define GVEC_INT_SHIFT_OPS(OP) \
+    { gvec_##OP##8i_int, gvec_##OP##16i_int, \
+      gvec_##OP##32i_int, gvec_##OP##64i_int }
+
+static const GVecAccel gvec_accel_int = {
+    .name = "int",
+    .ssadd = GVEC_INT_OPS(ssadd),
+    .sssub = GVEC_INT_OPS(sssub),
+    .usadd = GVEC_INT_OPS(usadd),
+    .ussub = GVEC_INT_OPS(ussub),
+    .eq = GVEC_INT_OPS(eq),
+    .ne = GVEC_INT_OPS(ne),
+    .lt = GVEC_INT_OPS(lt),
+    .le = GVEC_INT_OPS(le),
+    .ltu = GVEC_INT_OPS(ltu),
+    .leu = GVEC_INT_OPS(leu),
+    .shli = GVEC_INT_SHIFT_OPS(shl),
+    .shri = GVEC_INT_SHIFT_OPS(shr),
+    .sari = GVEC_INT_SHIFT_OPS(sar),
+};
+
+#include "host/gvec-accel.c.inc"
+
+const GVecAccel *gvec_accel;
+static unsigned gvec_accel_index;
+
+bool test_gvec_next_accel(void)
+{
+    if (gvec_accel_index != 0) {
+        gvec_accel = gvec_accel_table[--gvec_accel_index];
+        return true;
+    }
+    return false;
+}
+
+static void __attribute__((constructor)) init_gvec_accel(void)
+{
+    gvec_accel_index = gvec_best_accel();
+    gvec_accel = gvec_accel_table[gvec_accel_index];
+}